@@ -58,6 +58,112 @@
  * CRC32  - CRC32 check sum of uncompressed member data.
  * SIZE   - size of the uncompressed member data.
  *
+ * # Line index (dzip --line-index):
+ *
+ * Newline counts of chunks are stored after the last DZIP_MEMBER in LN
+ * members - gzip members with the empty body, so gzip tools just skip
+ * them:
+ *
+ * 	+---+---+---+---+---+---+---+---+---+---+---+---+
+ * 	|x1F|x8B|x08|x04|   MTIME=0     |XFL|OS | XLEN  |->
+ * 	+---+---+---+---+---+---+---+---+---+---+---+---+
+ * 	+==========+---+---+---+---+---+---+---+---+---+---+
+ * 	| LN_EXTRA |x03|x00| CRC32=0       | SIZE=0        |
+ * 	+==========+---+---+---+---+---+---+---+---+---+---+
+ *
+ * LN_EXTRA:
+ *
+ * 	+---+---+---+---+---+---+---+---+---+---+---+---+========+
+ * 	|x4C|x4E| EXLEN | VER=1 | FIRST         | CHCNT | COUNTS |
+ * 	+---+---+---+---+---+---+---+---+---+---+---+---+========+
+ *
+ * 	FIRST  - number of the first chunk
+ * 	COUNTS - CHCNT 2-bytes counts of '\n' in the chunks
+ *
+ * Members follow each other in the chunks order and cover all chunks.
+ *
+ * # Chunk filters (dzip --bloom):
+ *
+ * Bloom filters of 4-byte n-grams of chunks are stored after the LN
+ * members (if any) in BF members, that are the same as LN ones, but
+ * with BF_EXTRA:
+ *
+ * 	+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+=========+
+ * 	|x42|x46| EXLEN | VER=1 | FIRST         | CHCNT | FSIZE |GRM|HSH| FILTERS |
+ * 	+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+---+=========+
+ *
+ * 	FIRST   - number of the first chunk
+ * 	FSIZE   - size of the filter in bytes (power of 2)
+ * 	GRM     - n-gram length (4)
+ * 	HSH     - bits per n-gram (2, see cfbloom_add)
+ * 	FILTERS - CHCNT filters of FSIZE bytes
+ *
+ * A filter has n-grams, that end in the chunk (the first 3 start in the
+ * previous one). All members, except the last, have the same CHCNT, so
+ * the filter offset is computed.
+ *
+ * # Trailer index (dzip --trailer-index):
+ *
+ * The writer doesn't seek back to fill RA_EXTRA, members are plain gzip
+ * members (FLG has no FEXTRA) and the index is at the end of the file
+ * in IX members (after LN and BF members), that are the same as LN
+ * ones, but with RI_EXTRA. The last IX member also has RE_EXTRA:
+ *
+ * 	+---+---+---+---+==========+      +---+---+---+---+---+...+---+
+ * 	|x52|x49| EXLEN | IX_SLICE |      |x52|x45|x08|x00| TOTAL     |
+ * 	+---+---+---+---+==========+      +---+---+---+---+---+...+---+
+ *
+ * 	TOTAL - size of all IX members in bytes (8 bytes)
+ *
+ * So the whole index is read from the end of file (RE_EXTRA is right
+ * before the empty body of the last member). IX_SLICEs of all members
+ * make the index:
+ *
+ * 	+---+---+---+---+---+...+---+---+---+---+---+---+---+---+---+===+===+
+ * 	| VER=1 | CHLEN | SIZE      | MCNT          | CHCNT         |MBR|LEN|
+ * 	+---+---+---+---+---+...+---+---+---+---+---+---+---+---+---+===+===+
+ *
+ * 	SIZE - uncompressed size (8 bytes)
+ * 	MBR  - MCNT members: distance from the first chunk of the member to
+ * 	       the first IX member (8 bytes) and count of chunks (4 bytes)
+ * 	LEN  - CHCNT 2-bytes lengths of compressed chunks
+ *
+ * Offsets are relative to the index, the writer doesn't need to know
+ * its position in the output (it may be a pipe).
+ *
+ * # Seekable zstd file structure (ZSTD_SEEKABLE):
+ *
+ * 	+=========+=...=+=========+============+
+ * 	| FRAME_1 |     | FRAME_N | SEEK_TABLE |
+ * 	+=========+=...=+=========+============+
+ *
+ * FRAME      - independent zstd frame with one chunk of the file (CHLEN
+ *              bytes, the last one may be shorter).
+ * SEEK_TABLE - skippable frame of the zstd seekable format (see
+ *              contrib/seekable_format in the zstd sources):
+ *
+ * 	+---+---+---+---+---+---+---+---+=========+---+---+---+---+---+---+---+---+---+
+ * 	| x5E2A4D18     | FRAME_SIZE    | ENTRIES | NFRAMES       |DSC| x B1EA928F    |
+ * 	+---+---+---+---+---+---+---+---+=========+---+---+---+---+---+---+---+---+---+
+ *
+ * 	ENTRIES - NFRAMES of {COMPRESSED_SIZE(4), DECOMPRESSED_SIZE(4)
+ * 	          [, CHECKSUM(4) if DSC bit 7 is set]}
+ *
+ * Only tables of frames with equal decompressed sizes (except the last)
+ * not greater then 0xffff and compressed sizes not greater then 0xffff
+ * are supported (dzip --format=zstd writes such files).
+ *
+ * # Seekable LZ4 file structure (LZ4_SEEKABLE):
+ *
+ * 	+=============+=========+=...=+=========+---+---+---+---+============+
+ * 	| FRAME_HDR   | BLOCK_1 |     | BLOCK_N | ENDMARK=0     | SEEK_TABLE |
+ * 	+=============+=========+=...=+=========+---+---+---+---+============+
+ *
+ * One LZ4 frame with independent blocks (FLG bit 5), block per chunk.
+ * BLOCK is 4-byte size (bit 31 - the block is stored uncompressed) and
+ * the data. SEEK_TABLE is the same as for zstd, COMPRESSED_SIZE includes
+ * the 4-byte block size (and the block checksum, if it is on). LZ4 tools
+ * skip the table as a skippable frame.
  * */
 
 #ifndef __CSIO_H__
@@ -65,6 +171,7 @@
 
 #include <stdio.h>
 #include <stdint.h>
+#include <sys/types.h>
 #include <zlib.h>
 #include "csio_config.h"
 
@@ -76,6 +183,8 @@ typedef enum
 {
 	GZIP    = 1,
 	DICTZIP = 2,
+	ZSTD_SEEKABLE = 3,
+	LZ4_SEEKABLE  = 4,
 	NONE = 0
 } CompressionMethod;
 
@@ -93,7 +202,111 @@ static const char OS_CODE_UNIX = 3;
 static const size_t CHUNKS_PER_MEMBER = (0xffff - (2 + 2) - (2 + 2 + 2)) / 2;
 static const size_t EMPTY_FINISH_BLOCK_LEN = 2;
 static const size_t GZIP_CRC32_LEN = 4;
+static const size_t LN_CHUNKS_PER_MEMBER = (0xffff - (2 + 2) - (2 + 4 + 2)) / 2;
+static const char EMPTY_DEFLATE_BODY[2] = {(char)0x03, (char)0x00};
+static const size_t CFBLOOM_GRAM = 4;
+static const size_t IX_HEADER_LEN = 2 + 2 + 8 + 4 + 4;
+static const size_t IX_MEMBER_LEN = 8 + 4;
+static const size_t IX_LOCATOR_LEN = 2 + 2 + 8;
+static const size_t IX_SLICE_MAX = 0xffff - (2 + 2) - IX_LOCATOR_LEN;
+#define CFBLOOM_HASHES 2
+#define CFBLOOM_MAX_SIZE 8192
+static const size_t CFBLOOM_MIN_SIZE = 64;
+
+static const char ZSTD_FRAME_ID[4] = {(char)0x28, (char)0xb5, (char)0x2f, (char)0xfd};
+static const uint32_t SEEKABLE_SKIPPABLE_MAGIC = 0x184D2A5E;
+static const uint32_t SEEKABLE_FOOTER_MAGIC = 0x8F92EAB1;
+static const size_t SEEKABLE_FOOTER_LEN = 9;
+static const size_t SEEKABLE_ENTRY_LEN = 8;
+static const char SEEKABLE_CHECKSUM_FLAG = (char)0x80;
+static const char LZ4_FRAME_ID[4] = {(char)0x04, (char)0x22, (char)0x4d, (char)0x18};
+/**@brief LZ4 frame header: version 1, independent blocks, 64K blocks*/
+static const char LZ4_FRAME_HEADER[7] = {(char)0x04, (char)0x22, (char)0x4d,
+	(char)0x18, (char)0x60, (char)0x40, (char)0x82};
+static const uint32_t LZ4_BLOCK_UNCOMPRESSED = 0x80000000;
+
+
+/**@brief Inflate implementation of the dictzip chunks (see cfsetbackend)
+ *
+ * Chunks are self-contained raw deflate blocks of the known size, so
+ * whole-buffer decompressors can be used instead of zlib. Backends
+ * other than zlib are optional (CMake options WITH_LIBDEFLATE and
+ * WITH_ISAL).*/
+typedef enum
+{
+	CFBACKEND_ZLIB       = 0,
+	CFBACKEND_LIBDEFLATE = 1,
+	CFBACKEND_ISAL       = 2
+} CFBackend;
+
+/**@brief Compact chunk index of the dictzip stream (see csio.c)*/
+typedef struct CFINDEX CFINDEX;
+
+/**@brief Decompressed chunks cache shared by handles (see cfsetcache)*/
+typedef struct CFCACHE CFCACHE;
+
+/**@brief Pool of handles and indexes for many-file workloads (see
+ * cfpool_open)*/
+typedef struct CFPOOL CFPOOL;
+
+/**@brief Counters of the handles pool (see cfpool_getstats)*/
+struct cfpool_stats
+{
+	uint64_t opens;        //!< cfpool_open calls
+	uint64_t reuses;       //!< handles taken from the pool
+	uint64_t index_hits;   //!< indexes found in the cache
+	uint64_t index_misses; //!< files scanned
+	size_t   free;         //!< closed handles in the pool
+};
+
+/**@brief Asynchronous reads engine (see cfread_async)*/
+typedef struct CFAIO CFAIO;
 
+/**@brief Completion callback of cfread_async
+ * @param rs - count of bytes read, -1 on error
+ * @param err - errno value on error*/
+typedef void (*cfaio_cb)(void* arg, ssize_t rs, int err);
+
+/**@brief Memory used by the handle in bytes (see cfgetmem)*/
+struct cfmemstats
+{
+	size_t handle; //!< CFILE structure
+	size_t buffer; //!< decompression window (0 before the first read)
+	size_t index;  //!< chunk index (shared with cfdup handles)
+	size_t stats;  //!< statistics
+	size_t codec;  //!< decompressor state, if its size is known
+	size_t total;  //!< sum of the above
+};
+
+/**@brief Counters of the chunk cache (see cfcache_getstats)*/
+struct cfcache_stats
+{
+	uint64_t hits;      //!< chunks found in the cache
+	uint64_t misses;    //!< chunks not found
+	uint64_t evictions; //!< chunks replaced by others
+	size_t   slots;     //!< capacity in chunks
+	size_t   used;      //!< occupied slots
+};
+
+/**@brief Runtime statistics of the handle (see cfgetstats)
+ *
+ * All times are cumulative nanoseconds (CLOCK_MONOTONIC).*/
+struct cfstats
+{
+	uint64_t index_ns;        //!< stream scan and index build in cfinit
+	uint64_t fetches;         //!< buffer window renewals
+	uint64_t fetch_ns;        //!< time of renewals (lookup+read+inflate)
+	uint64_t disk_reads;      //!< read calls
+	uint64_t disk_bytes;      //!< bytes read from the disk
+	uint64_t disk_ns;         //!< time of disk reads
+	uint64_t inflates;        //!< inflated chunks
+	uint64_t inflate_ns;      //!< time of inflate
+	uint64_t delivered_bytes; //!< bytes returned to the caller
+	uint64_t buf_hits;        //!< fill_buf found pos in the window
+	uint64_t buf_misses;      //!< fill_buf had to fetch
+	uint64_t seeks;           //!< cfseek/cfseeko calls
+	uint64_t cache_hits;      //!< fetches served by the shared cache
+};
 
 typedef struct {
 	FILE*             stream;
@@ -104,26 +317,80 @@ typedef struct {
 	uint16_t          bufsz;
 	char              need_close;
 	CompressionMethod compression;
-	char              buf[0x10000];
+	char*             buf;   //!< chlen bytes, allocated on the first read
 	size_t            idxsz;
-	char*             idx;
+	CFINDEX*          idx;
 	z_stream          zst;
 	int               init_magic;
 	int               eof;
+	struct cfstats*   stats;
+	CFBackend         backend;
+	void*             backend_state;
+	void*             codec_state;
+	CFCACHE*          cache;
+	uint64_t          cache_file[3];
 } CFILE;
 
 
 CSIO_API CFILE* cfopen(const char* name, const char* mode);
+CSIO_API CFILE* cfdup(CFILE* stream);
 CSIO_API int    cferror(CFILE* stream);
 CSIO_API CFILE* cfinit(FILE* stream);
 CSIO_API void   cfclose(CFILE** stream);
 CSIO_API int    cfeof(CFILE* stream);
 CSIO_API int    cfseek(CFILE* stream, long pos, int mode);
 CSIO_API int    cfseeko(CFILE* stream, off_t offset, int mode);
+CSIO_API int    cfseekline(CFILE* stream, uint64_t line);
+CSIO_API int    cfchunk_may_contain(CFILE* stream, size_t chunk,
+                                    size_t count, const void* data,
+                                    size_t len);
+CSIO_API void   cfbloom_add(uint8_t* filter, size_t fsize, const void* data,
+                            size_t len);
 CSIO_API long   cftell(CFILE* stream);
 CSIO_API off_t  cftello(CFILE* stream);
 CSIO_API size_t cfread(void* dest, size_t size, size_t count, CFILE* stream);
-CSIO_API int    cfgetc(CFILE* stream);
+CSIO_API int    cfgetc_slow(CFILE* stream);
+CSIO_API const char* cfgetbuf(CFILE* stream, size_t* len);
+CSIO_API char*  cfgets(char* s, int size, CFILE* stream);
+CSIO_API ssize_t cfgetline(char** lineptr, size_t* n, CFILE* stream);
+CSIO_API int    cfsetstats(CFILE* stream, int enable);
+CSIO_API int    cfgetstats(CFILE* stream, struct cfstats* stats);
+CSIO_API int    cfgetmem(CFILE* stream, struct cfmemstats* mem);
+CSIO_API int    cfsetbackend(CFILE* stream, CFBackend backend);
+CSIO_API int    cfbackend_available(CFBackend backend);
+CSIO_API const char* cfbackend_name(CFBackend backend);
+CSIO_API int    cfbackend_parse(const char* name, CFBackend* backend);
+CSIO_API CFCACHE* cfcache_create(size_t budget, size_t shards);
+CSIO_API void   cfcache_destroy(CFCACHE* cache);
+CSIO_API int    cfcache_getstats(CFCACHE* cache, struct cfcache_stats* stats);
+CSIO_API int    cfsetcache(CFILE* stream, CFCACHE* cache);
+CSIO_API CFPOOL* cfpool_create(size_t handles, size_t indexes);
+CSIO_API void   cfpool_destroy(CFPOOL* pool);
+CSIO_API int    cfpool_getstats(CFPOOL* pool, struct cfpool_stats* stats);
+CSIO_API CFILE* cfpool_open(CFPOOL* pool, const char* name);
+CSIO_API void   cfpool_close(CFPOOL* pool, CFILE** stream);
+CSIO_API CFAIO* cfaio_create(unsigned depth, unsigned workers);
+CSIO_API void   cfaio_destroy(CFAIO* aio);
+CSIO_API int    cfaio_fd(CFAIO* aio);
+CSIO_API int    cfaio_uring(CFAIO* aio);
+CSIO_API int    cfaio_poll(CFAIO* aio, int timeout_ms);
+CSIO_API int    cfread_async(CFAIO* aio, CFILE* stream, void* dest,
+                             size_t count, off_t offset, cfaio_cb cb,
+                             void* arg);
+
+/**@brief fgetc analogue
+ *
+ * Bytes of the current buffer window are returned without calling into
+ * the library, cfgetc_slow() is used only to renew the window.*/
+static inline int
+cfgetc(CFILE* stream)
+{
+	if (stream->currpos >= stream->bufoff
+	 && stream->currpos - stream->bufoff < stream->bufsz)
+		return (int)(unsigned char)
+			stream->buf[stream->currpos++ - stream->bufoff];
+	return cfgetc_slow(stream);
+}
 
 #ifdef __cplusplus
 }
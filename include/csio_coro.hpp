@@ -0,0 +1,352 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 21:05:43
+ *
+ * C++20 coroutine interface of csio asynchronous reads (header only,
+ * over cfread_async).
+ *
+ * 	csio::Reader reader(file, 64);  // up to 64 reads in flight
+ * 	...
+ * 	csio::ReadResult rs = co_await reader.read_at(off, buf, stop);
+ *
+ * Coroutines are resumed by Reader::poll in the thread that calls it
+ * (event loop: register Reader::fd() and call poll(0) on POLLIN).*/
+
+#ifndef __CSIO_CORO_HPP__
+#define __CSIO_CORO_HPP__
+
+#include <csio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <coroutine>
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <span>
+#include <stop_token>
+
+namespace csio {
+
+/**@brief Result of the read: bytes read (less then requested at the
+ * end of the stream) or errno value (ECANCELED on cancellation)*/
+struct ReadResult
+{
+	size_t size;
+	int    err;
+};
+
+class Reader;
+
+/**@brief Awaitable of Reader::read_at*/
+class ReadOp
+{
+public:
+	ReadOp(ReadOp&&) = delete;
+
+	bool await_ready() const noexcept
+	{
+		return stop_.stop_requested();
+	}
+
+	bool await_suspend(std::coroutine_handle<> h);
+
+	ReadResult await_resume() noexcept
+	{
+		if (state_ == IDLE)
+			return ReadResult{0, ECANCELED};
+		return result_;
+	}
+
+private:
+	friend class Reader;
+
+	enum State { IDLE, QUEUED, INFLIGHT, DONE };
+
+	struct Cancel
+	{
+		ReadOp* op;
+		void operator()() noexcept;
+	};
+
+	ReadOp(Reader* reader, off_t offset, std::span<char> buf,
+	       std::stop_token stop)
+		: reader_(reader)
+		, offset_(offset)
+		, buf_(buf)
+		, stop_(std::move(stop))
+	{
+	}
+
+	Reader*                 reader_;
+	off_t                   offset_;
+	std::span<char>         buf_;
+	std::stop_token         stop_;
+	std::coroutine_handle<> handle_;
+	ReadOp*                 next_ = nullptr;
+	State                   state_ = IDLE;
+	bool                    cancelled_ = false;
+	ReadResult              result_ = {0, 0};
+	std::optional<std::stop_callback<Cancel>> cancel_;
+};
+
+/**@brief Coroutine reader of the CFILE
+ *
+ * Owns the asynchronous reads engine (see cfaio_create) and bounds the
+ * reads in flight: read_at above the limit waits in the FIFO queue
+ * without a thread. Cancellation (stop_token) of a waiting read resumes
+ * it with ECANCELED on the next poll; a read in flight can't be taken
+ * back from the engine (it writes into the buffer), it is resumed with
+ * ECANCELED after completion. The handle must outlive the reader, the
+ * reader must outlive the reads (destructor waits for reads in flight,
+ * but doesn't resume them).*/
+class Reader
+{
+public:
+	Reader(CFILE* file, size_t limit = 64, unsigned workers = 2)
+		: file_(file)
+		, aio_(cfaio_create(limit, workers))
+		, limit_(limit ? limit : 1)
+	{
+	}
+
+	~Reader()
+	{
+		cfaio_destroy(aio_);
+	}
+
+	Reader(const Reader&) = delete;
+	Reader& operator=(const Reader&) = delete;
+
+	/**@brief false if the engine can't be created*/
+	bool Valid() const { return aio_ != NULL; }
+
+	/**@brief Descriptor, that is readable when poll has work*/
+	int  fd() const { return cfaio_fd(aio_); }
+
+	/**@brief Reads submitted or waiting*/
+	size_t Pending()
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		return inflight_ + waiting_;
+	}
+
+	/**@brief Read buf.size() bytes at offset of the decompressed stream*/
+	ReadOp read_at(off_t offset, std::span<char> buf,
+	               std::stop_token stop = std::stop_token())
+	{
+		return ReadOp(this, offset, buf, std::move(stop));
+	}
+
+	/**@brief Resume coroutines of completed and cancelled reads
+	 * @param timeout_ms - time to wait for a completion (-1 - infinitely)
+	 * @return count of resumed coroutines*/
+	size_t poll(int timeout_ms = -1)
+	{
+		size_t resumed = resumeReady();
+		if (resumed)
+			timeout_ms = 0;
+		int rs = cfaio_poll(aio_, timeout_ms);
+		if (rs > 0)
+			resumed += rs;
+		return resumed + resumeReady();
+	}
+
+private:
+	friend class ReadOp;
+
+	/**@brief Take a slot or queue the op
+	 * @return INFLIGHT - the op has the slot, QUEUED - it waits, DONE -
+	 * it is cancelled*/
+	ReadOp::State acquire(ReadOp* op)
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		if (op->cancelled_)
+		{
+			op->state_ = ReadOp::DONE;
+			op->result_ = ReadResult{0, ECANCELED};
+		}
+		else if (inflight_ < limit_)
+		{
+			++inflight_;
+			op->state_ = ReadOp::INFLIGHT;
+		}
+		else
+		{
+			op->state_ = ReadOp::QUEUED;
+			*wtail_ = op;
+			wtail_ = &op->next_;
+			++waiting_;
+		}
+		return op->state_;
+	}
+
+	/**@brief Hand the slot of the completed op to the first waiting one
+	 * @return the op to submit or nullptr (the slot is released)
+	 * @note lock must be held*/
+	ReadOp* release()
+	{
+		ReadOp* next = waiters_;
+		if (!next)
+		{
+			--inflight_;
+			return nullptr;
+		}
+		waiters_ = next->next_;
+		if (!waiters_)
+			wtail_ = &waiters_;
+		--waiting_;
+		next->state_ = ReadOp::INFLIGHT;
+		return next;
+	}
+
+	/**@brief Submit the op, that holds a slot
+	 * @return 0 or errno value*/
+	int submit(ReadOp* op)
+	{
+		if (cfread_async(aio_, file_, op->buf_.data(), op->buf_.size(),
+		                 op->offset_, &Reader::done, op) == 0)
+			return 0;
+		return errno ? errno : EIO;
+	}
+
+	/**@brief Submit waiting ops, that got the slot (failed are resumed
+	 * by poll)*/
+	void start(ReadOp* op)
+	{
+		while (op)
+		{
+			int err = submit(op);
+			if (err == 0)
+				return;
+			std::lock_guard<std::mutex> lock(mtx_);
+			finish(op, ReadResult{0, err});
+			op = release();
+		}
+	}
+
+	/**@brief Mark the op completed and put it to the ready list
+	 * @note lock must be held*/
+	void finish(ReadOp* op, ReadResult rs)
+	{
+		op->state_ = ReadOp::DONE;
+		op->result_ = rs;
+		op->next_ = ready_;
+		ready_ = op;
+	}
+
+	/**@brief Cancel waiting op (stop_callback)*/
+	void cancel(ReadOp* op)
+	{
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			if (op->state_ != ReadOp::QUEUED)
+			{
+				op->cancelled_ = true;
+				return;
+			}
+			ReadOp** p = &waiters_;
+			while (*p != op)
+				p = &(*p)->next_;
+			*p = op->next_;
+			if (wtail_ == &op->next_)
+				wtail_ = p;
+			--waiting_;
+			finish(op, ReadResult{0, ECANCELED});
+		}
+		// wake up poll
+		uint64_t one = 1;
+		while (write(cfaio_fd(aio_), &one, sizeof(one)) == -1
+		       && errno == EINTR);
+	}
+
+	/**@brief Completion of cfread_async (called by cfaio_poll)*/
+	static void done(void* arg, ssize_t rs, int err)
+	{
+		ReadOp* op = (ReadOp*)arg;
+		Reader* self = op->reader_;
+		ReadOp* next;
+		{
+			std::lock_guard<std::mutex> lock(self->mtx_);
+			op->state_ = ReadOp::DONE;
+			if (op->cancelled_)
+				op->result_ = ReadResult{0, ECANCELED};
+			else
+				op->result_ = rs < 0 ? ReadResult{0, err}
+				                     : ReadResult{(size_t)rs, 0};
+			next = self->release();
+		}
+		self->start(next);
+		op->cancel_.reset();
+		op->handle_.resume();
+	}
+
+	size_t resumeReady()
+	{
+		ReadOp* ready;
+		{
+			std::lock_guard<std::mutex> lock(mtx_);
+			ready = ready_;
+			ready_ = nullptr;
+		}
+		size_t rs = 0;
+		while (ready)
+		{
+			ReadOp* op = ready;
+			ready = op->next_;
+			op->cancel_.reset();
+			op->handle_.resume();
+			++rs;
+		}
+		return rs;
+	}
+
+	CFILE*     file_;
+	CFAIO*     aio_;
+	size_t     limit_;
+	std::mutex mtx_;
+	size_t     inflight_ = 0;
+	size_t     waiting_ = 0;
+	ReadOp*    waiters_ = nullptr;
+	ReadOp**   wtail_ = &waiters_;
+	ReadOp*    ready_ = nullptr;
+};
+
+inline void
+ReadOp::Cancel::operator()() noexcept
+{
+	op->reader_->cancel(op);
+}
+
+inline bool
+ReadOp::await_suspend(std::coroutine_handle<> h)
+{
+	handle_ = h;
+	// cancellation before acquire only marks the op
+	cancel_.emplace(stop_, Cancel{this});
+	switch (reader_->acquire(this))
+	{
+		case QUEUED:
+			// the op may be resumed by other thread from now
+			return true;
+		case INFLIGHT: {
+			int err = reader_->submit(this);
+			if (err == 0)
+				return true;
+			result_ = ReadResult{0, err};
+			ReadOp* next;
+			{
+				std::lock_guard<std::mutex> lock(reader_->mtx_);
+				state_ = DONE;
+				next = reader_->release();
+			}
+			reader_->start(next);
+			} break;
+		default:
+			break;
+	}
+	cancel_.reset();
+	return false;
+}
+
+} // namespace
+
+#endif // __CSIO_CORO_HPP__
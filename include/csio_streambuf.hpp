@@ -0,0 +1,167 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 22:10:27
+ *
+ * std::streambuf over CFILE (header only).
+ *
+ * 	csio::cistream in("log.dz");
+ * 	std::string line;
+ * 	while (std::getline(in, line))
+ * 		...*/
+
+#ifndef __CSIO_STREAMBUF_HPP__
+#define __CSIO_STREAMBUF_HPP__
+
+#include <csio.h>
+#include <istream>
+#include <streambuf>
+
+namespace csio {
+
+/**@brief Input stream buffer of the CFILE
+ *
+ * The get area is the decompressed window of the handle itself (see
+ * cfgetbuf), so bytes are copied only once: from the window to the
+ * caller. Seeks inside the window only move the get pointer, others
+ * are cfseeko and the window is renewed on the next read. While the
+ * buffer is used, it owns the handle position: sync() (or destruction)
+ * moves the handle to the logical position of the stream.*/
+class cistreambuf : public std::streambuf
+{
+public:
+	/**@brief Use the handle (not owned)*/
+	explicit cistreambuf(CFILE* file)
+		: file_(file)
+		, own_(false)
+	{
+	}
+
+	/**@brief Open the file (check with is_open)*/
+	explicit cistreambuf(const char* name)
+		: file_(cfopen(name, "rb"))
+		, own_(true)
+	{
+	}
+
+	~cistreambuf()
+	{
+		if (!file_)
+			return;
+		sync();
+		if (own_)
+			cfclose(&file_);
+	}
+
+	bool   is_open() const { return file_ != NULL; }
+	CFILE* file() { return file_; }
+
+protected:
+	/**@brief Expose the next window as the get area*/
+	int_type underflow()
+	{
+		if (gptr() < egptr())
+			return traits_type::to_int_type(*gptr());
+		if (!file_)
+			return traits_type::eof();
+		if (eback())
+			cfseeko(file_, pos(), SEEK_SET);
+		size_t len;
+		const char* p = cfgetbuf(file_, &len);
+		setg(NULL, NULL, NULL);
+		if (!p)
+			return traits_type::eof();
+		char* window = file_->buf;
+		setg(window, (char*)p, (char*)p + len);
+		return traits_type::to_int_type(*gptr());
+	}
+
+	std::streamsize showmanyc()
+	{
+		if (!file_)
+			return -1;
+		off_t rest = (off_t)file_->size - pos();
+		return rest > 0 ? rest : -1;
+	}
+
+	pos_type seekoff(off_type off, std::ios_base::seekdir dir,
+	                 std::ios_base::openmode which = std::ios_base::in)
+	{
+		if (!file_ || (which & std::ios_base::out))
+			return pos_type(off_type(-1));
+		off_t base = 0;
+		if (dir == std::ios_base::cur)
+			base = pos();
+		else if (dir == std::ios_base::end)
+			base = file_->size;
+		off_t target = base + off;
+		if (target < 0)
+			return pos_type(off_type(-1));
+		if (eback() && target >= file_->bufoff
+		 && target < file_->bufoff + (off_t)(egptr() - eback()))
+		{
+			setg(eback(), eback() + (target - file_->bufoff), egptr());
+			return pos_type(target);
+		}
+		if (cfseeko(file_, target, SEEK_SET) != 0)
+			return pos_type(off_type(-1));
+		setg(NULL, NULL, NULL);
+		return pos_type(target);
+	}
+
+	pos_type seekpos(pos_type pos,
+	                 std::ios_base::openmode which = std::ios_base::in)
+	{
+		return seekoff(off_type(pos), std::ios_base::beg, which);
+	}
+
+	int sync()
+	{
+		if (file_ && eback())
+			cfseeko(file_, pos(), SEEK_SET);
+		return 0;
+	}
+
+private:
+	cistreambuf(const cistreambuf&);
+	cistreambuf& operator=(const cistreambuf&);
+
+	/**@brief Logical position of the stream*/
+	off_t pos() const
+	{
+		if (eback())
+			return file_->bufoff + (gptr() - eback());
+		return cftello(file_);
+	}
+
+	CFILE* file_;
+	bool   own_;
+};
+
+/**@brief Input stream of the (compressed) file*/
+class cistream : public std::istream
+{
+public:
+	explicit cistream(const char* name)
+		: std::istream(NULL)
+		, buf_(name)
+	{
+		init(&buf_);
+		if (!buf_.is_open())
+			setstate(std::ios_base::failbit);
+	}
+
+	explicit cistream(CFILE* file)
+		: std::istream(NULL)
+		, buf_(file)
+	{
+		init(&buf_);
+	}
+
+	cistreambuf* rdbuf() { return &buf_; }
+
+private:
+	cistreambuf buf_;
+};
+
+} // namespace
+
+#endif // __CSIO_STREAMBUF_HPP__
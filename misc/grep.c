@@ -1,19 +1,62 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 12:40:31
+ *
+ * Binary grep over (compressed) files.
+ *
+ * Usage: csio_grep [-j <threads>] [-v] <file> <hexbytes> [<hexbytes> ...]
+ *
+ * Prints "<file> <offset>" for every occurrence of every pattern
+ * (offset of the first byte of the occurrence). If more then one
+ * pattern is given, the pattern is printed as the third column.
+ *
+ * The file is split into ranges of whole chunks, which are decompressed
+ * and scanned by -j worker threads (see Search). Each range is scanned
+ * for all the patterns. Candidates are filtered by the first two bytes
+ * of the pattern with SSE2/AVX2 (AVX2 is selected at runtime) and
+ * verified with memcmp. Ranges are read with (maxlen - 1) bytes of
+ * overlap, so occurrences on the range boundaries are not lost.
+ *
+ * Files compressed with `dzip --bloom` have n-gram filters of chunks,
+ * ranges, where no pattern may start (see cfchunk_may_contain), are not
+ * decompressed at all. -v prints count of the skipped ranges to
+ * stderr.*/
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <errno.h>
-#include <malloc.h>
+#include <ctype.h>
+#include <limits.h>
 #include <locale.h>
+#include <unistd.h>
+#include <pthread.h>
 #include <csio.h>
 
-char hex2char(unsigned char n)
+#if defined(__GNUC__) && defined(__SSE2__) \
+ && (defined(__x86_64__) || defined(__i386__))
+#	include <immintrin.h>
+#	define GREP_X86_SIMD
+#endif
+
+typedef struct
 {
-	if(0 <= n && n <= 9)
-		return n + 48;
-	if(0xA <= n && n <= 0xF)
-		return n - 0xA + 'a';
-	return '?';
-}
+	unsigned char* bytes;
+	size_t         len;
+	const char*    hex;
+} Pattern;
+
+typedef struct
+{
+	off_t  off;
+	size_t pat;
+} Match;
+
+typedef struct
+{
+	Match* items;
+	size_t count;
+	size_t capacity;
+} Matches;
 
 int hex2int(unsigned char c)
 {
@@ -26,22 +69,8 @@ int hex2int(unsigned char c)
 	return -1;
 }
 
-char* byte2str(char* begin, char* end, char* buf)
-{
-	int len = end - begin;
-	size_t i = 0;
-	for(; begin != end; ++begin)
-	{
-		buf[i]   = hex2char((((unsigned char)*begin)/0x10)%0x10);
-		buf[i+1] = hex2char(((unsigned char)*begin)%0x10);
-		i += 2;
-	}
-	buf[i] = 0;
-	return buf;
-}
-
 int
-str2bytes(char* dst, const char* src, int srclen)
+str2bytes(unsigned char* dst, const char* src, int srclen)
 {
 	if (srclen == 0 || src == NULL || dst == NULL)
 		return 0;
@@ -49,96 +78,480 @@ str2bytes(char* dst, const char* src, int srclen)
 	int rs = 0;
 	for(; pos < srclen; ++pos)
 	{
-		if(!isxdigit(src[pos]))
+		if(!isxdigit((unsigned char)src[pos]))
 			return rs;
 		int c = hex2int(src[pos]);
 		if (c == -1)
 			return rs;
-		dst[rs] = pos%2 ?  dst[rs++] + c : c*0x10;
+		if (pos%2)
+			dst[rs++] += c;
+		else
+			dst[rs] = c*0x10;
 	}
 	return rs;
 }
 
-int main(int argc, char* argv[])
+int
+matches_add(Matches* m, off_t off, size_t pat)
 {
-	if (argc < 3)
+	if (m->count == m->capacity)
 	{
-		printf("Usage: <file> <bytes>\n");
+		size_t capacity = m->capacity ? m->capacity*2 : 256;
+		Match* items = (Match*)realloc(m->items,
+				capacity*sizeof(Match));
+		if (!items)
+			return -1;
+		m->items = items;
+		m->capacity = capacity;
+	}
+	m->items[m->count].off = off;
+	m->items[m->count].pat = pat;
+	++m->count;
+	return 0;
+}
+
+int
+match_cmp(const void* lhv, const void* rhv)
+{
+	const Match* l = (const Match*)lhv;
+	const Match* r = (const Match*)rhv;
+	if (l->off != r->off)
+		return l->off < r->off ? -1 : 1;
+	if (l->pat != r->pat)
+		return l->pat < r->pat ? -1 : 1;
+	return 0;
+}
+
+/**@brief verify candidate at data[pos]*/
+static inline int
+verify(const unsigned char* data, size_t datasz, size_t pos,
+		const Pattern* p, off_t base, size_t pat, Matches* m)
+{
+	if (pos + p->len > datasz)
 		return 0;
+	if (memcmp(data + pos, p->bytes, p->len) != 0)
+		return 0;
+	return matches_add(m, base + pos, pat);
+}
+
+/**@brief scalar scan of positions [from, limit)*/
+int
+scan_scalar(const unsigned char* data, size_t datasz, size_t from,
+		size_t limit, const Pattern* p, off_t base, size_t pat,
+		Matches* m)
+{
+	while (from < limit)
+	{
+		const unsigned char* c = (const unsigned char*)
+			memchr(data + from, p->bytes[0], limit - from);
+		if (!c)
+			break;
+		from = c - data;
+		if (verify(data, datasz, from, p, base, pat, m) != 0)
+			return -1;
+		++from;
 	}
+	return 0;
+}
 
-	size_t btlen = strlen(argv[2]);
-	if (btlen%2 != 0 || btlen == 0)
+#ifdef GREP_X86_SIMD
+
+/**@brief SSE2 scan of positions [0, limit)*/
+int
+scan_sse2(const unsigned char* data, size_t datasz, size_t limit,
+		const Pattern* p, off_t base, size_t pat, Matches* m)
+{
+	const __m128i first = _mm_set1_epi8((char)p->bytes[0]);
+	const __m128i second = _mm_set1_epi8(
+			(char)p->bytes[p->len > 1 ? 1 : 0]);
+	size_t i = 0;
+	for (; i + 16 < datasz && i < limit; i += 16)
 	{
-		printf("Wrong pattern length.");
-		return 1;
+		__m128i b0 = _mm_loadu_si128((const __m128i*)(data + i));
+		unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(b0, first));
+		if (p->len > 1)
+		{
+			__m128i b1 = _mm_loadu_si128(
+					(const __m128i*)(data + i + 1));
+			mask &= _mm_movemask_epi8(_mm_cmpeq_epi8(b1, second));
+		}
+		while (mask)
+		{
+			size_t pos = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+			if (pos >= limit)
+				break;
+			if (verify(data, datasz, pos, p, base, pat, m) != 0)
+				return -1;
+		}
 	}
-	char* target = (char*)malloc(btlen/2 + 1);
-	if (!target)
+	return scan_scalar(data, datasz, i, limit, p, base, pat, m);
+}
+
+/**@brief AVX2 scan of positions [0, limit)*/
+__attribute__((target("avx2"))) int
+scan_avx2(const unsigned char* data, size_t datasz, size_t limit,
+		const Pattern* p, off_t base, size_t pat, Matches* m)
+{
+	const __m256i first = _mm256_set1_epi8((char)p->bytes[0]);
+	const __m256i second = _mm256_set1_epi8(
+			(char)p->bytes[p->len > 1 ? 1 : 0]);
+	size_t i = 0;
+	for (; i + 32 < datasz && i < limit; i += 32)
 	{
-		fprintf(stderr, "Error memory allocation.\n");
-		return 1;
+		__m256i b0 = _mm256_loadu_si256((const __m256i*)(data + i));
+		unsigned mask = (unsigned)_mm256_movemask_epi8(
+				_mm256_cmpeq_epi8(b0, first));
+		if (p->len > 1)
+		{
+			__m256i b1 = _mm256_loadu_si256(
+					(const __m256i*)(data + i + 1));
+			mask &= (unsigned)_mm256_movemask_epi8(
+					_mm256_cmpeq_epi8(b1, second));
+		}
+		while (mask)
+		{
+			size_t pos = i + __builtin_ctz(mask);
+			mask &= mask - 1;
+			if (pos >= limit)
+				break;
+			if (verify(data, datasz, pos, p, base, pat, m) != 0)
+				return -1;
+		}
 	}
-	int targetsz = str2bytes(target, argv[2], btlen);
-	if (targetsz != (btlen%2 == 0 ? btlen/2 : btlen/2 + 1))
+	return scan_scalar(data, datasz, i, limit, p, base, pat, m);
+}
+
+#endif // GREP_X86_SIMD
+
+typedef int (*ScanFunc)(const unsigned char*, size_t, size_t,
+		const Pattern*, off_t, size_t, Matches*);
+
+int
+scan_generic(const unsigned char* data, size_t datasz, size_t limit,
+		const Pattern* p, off_t base, size_t pat, Matches* m)
+{
+	return scan_scalar(data, datasz, 0, limit, p, base, pat, m);
+}
+
+ScanFunc
+select_scan()
+{
+#ifdef GREP_X86_SIMD
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+		return scan_avx2;
+	return scan_sse2;
+#else
+	return scan_generic;
+#endif
+}
+
+/**@brief find all occurrences starting at [0, limit) of data
+ *
+ * Occurrences are appended to m sorted by offset.*/
+int
+scan_block(ScanFunc scan, const unsigned char* data, size_t datasz,
+		size_t limit, const Pattern* patterns, size_t npatterns,
+		off_t base, Matches* m)
+{
+	size_t first = m->count;
+	size_t i;
+	for (i = 0; i < npatterns; ++i)
+		if (scan(data, datasz, limit, &patterns[i], base, i, m) != 0)
+			return -1;
+	if (npatterns > 1)
+		qsort(m->items + first, m->count - first, sizeof(Match),
+				match_cmp);
+	return 0;
+}
+
+void
+print_matches(const char* fname, const Pattern* patterns,
+		size_t npatterns, const Matches* m)
+{
+	size_t i;
+	for (i = 0; i < m->count; ++i)
 	{
-		fprintf(stderr, "Error converting second argument,"
-		                " processed %d bytes.\n", targetsz);
-		return 1;
+		if (npatterns > 1)
+			printf("%s %lu %s\n", fname,
+				(unsigned long)m->items[i].off,
+				patterns[m->items[i].pat].hex);
+		else
+			printf("%s %lu\n", fname,
+				(unsigned long)m->items[i].off);
 	}
+}
 
-	char realp[PATH_MAX];
-	if (realpath(argv[1], realp) == NULL)
+int
+parse_patterns(int argc, char* argv[], Pattern* patterns)
+{
+	int i;
+	for (i = 0; i < argc; ++i)
 	{
-		fprintf(stderr, "Error getting realpath of \"%s\". Message: %s\n", argv[1], strerror(errno));
-		return 1;
+		size_t btlen = strlen(argv[i]);
+		if (btlen%2 != 0 || btlen == 0)
+		{
+			fprintf(stderr, "Wrong pattern length: \"%s\".\n",
+					argv[i]);
+			return -1;
+		}
+		patterns[i].hex = argv[i];
+		patterns[i].len = btlen/2;
+		patterns[i].bytes = (unsigned char*)malloc(btlen/2);
+		if (!patterns[i].bytes)
+		{
+			fprintf(stderr, "Error memory allocation.\n");
+			return -1;
+		}
+		int rs = str2bytes(patterns[i].bytes, argv[i], btlen);
+		if ((size_t)rs != btlen/2)
+		{
+			fprintf(stderr, "Error converting pattern \"%s\","
+			                " processed %d bytes.\n", argv[i], rs);
+			return -1;
+		}
 	}
-	CFILE* fin = cfopen(realp, "rb");
-	if (!fin)
+	return 0;
+}
+
+/**@brief parallel search state
+ *
+ * The file is split into tasks - ranges of TASK_CHUNKS chunks. Workers
+ * take tasks in order, each worker has its own CFILE (and inflate
+ * state), reads the range plus (maxlen - 1) bytes of overlap and keeps
+ * matches starting inside the range. The main thread prints task
+ * results strictly in task order, workers are not allowed to run more
+ * then `window` tasks ahead of the printing.*/
+typedef struct
+{
+	const char*     fname;
+	const Pattern*  patterns;
+	size_t          npatterns;
+	size_t          keep;
+	off_t           size;
+	off_t           rangesz;
+	size_t          tasks;
+	size_t          window;
+	ScanFunc        scan;
+	pthread_mutex_t mtx;
+	pthread_cond_t  cond;
+	size_t          next;
+	size_t          printed;
+	size_t          skipped;
+	Matches*        results;
+	char*           done;
+	int             error;
+} Search;
+
+static const size_t TASK_CHUNKS = 16;
+
+void
+search_fail(Search* s, const char* msg)
+{
+	pthread_mutex_lock(&s->mtx);
+	if (!s->error)
+		fprintf(stderr, "%s\n", msg);
+	s->error = 1;
+	pthread_cond_broadcast(&s->cond);
+	pthread_mutex_unlock(&s->mtx);
+}
+
+/**@brief Check chunk filters of the task range
+ * @return 1 if any pattern may start in the range, 0 - no, -1 on error*/
+int
+may_contain(Search* s, CFILE* fin, size_t task)
+{
+	size_t i;
+	for (i = 0; i < s->npatterns; ++i)
 	{
-		fprintf(stderr, "Error opening \"%s\". Message: %s\n", argv[1], strerror(errno));
-		return 1;
+		int rs = cfchunk_may_contain(fin, task*TASK_CHUNKS, TASK_CHUNKS,
+				s->patterns[i].bytes, s->patterns[i].len);
+		if (rs != 0)
+			return rs;
 	}
-	char* buf = (char*)malloc(targetsz);
-	if (!buf)
+	return 0;
+}
+
+void*
+search_worker(void* arg)
+{
+	Search* s = (Search*)arg;
+	CFILE* fin = cfopen(s->fname, "rb");
+	unsigned char* buf = (unsigned char*)malloc(s->rangesz + s->keep);
+	if (!fin || !buf)
 	{
-		fprintf(stderr, "Error memory allocation for readbuf. Size: %d\n", targetsz);
-		return 1;
+		search_fail(s, "Error initializing worker.");
+		free(buf);
+		cfclose(&fin);
+		return NULL;
 	}
-	int readrs = cfread(buf, 1, targetsz, fin);
-	if (readrs != targetsz)
+	for (;;)
 	{
-		if (read == 0)
-			fprintf(stderr, "Error reading file.\n");
-		return 1;
+		pthread_mutex_lock(&s->mtx);
+		while (!s->error && s->next < s->tasks
+		    && s->next >= s->printed + s->window)
+			pthread_cond_wait(&s->cond, &s->mtx);
+		if (s->error || s->next >= s->tasks)
+		{
+			pthread_mutex_unlock(&s->mtx);
+			break;
+		}
+		size_t task = s->next++;
+		pthread_mutex_unlock(&s->mtx);
+
+		off_t start = task*s->rangesz;
+		size_t len = s->rangesz + s->keep;
+		if (len > (size_t)(s->size - start))
+			len = s->size - start;
+		size_t limit = len < (size_t)s->rangesz ? len : (size_t)s->rangesz;
+		Matches* m = &s->results[task % s->window];
+		m->count = 0;
+		int may = may_contain(s, fin, task);
+		if (may < 0)
+		{
+			search_fail(s, "Error reading chunk filters.");
+			break;
+		}
+		if (may && (cfseeko(fin, start, SEEK_SET) != 0
+		         || cfread(buf, 1, len, fin) != len))
+		{
+			search_fail(s, "Error reading file.");
+			break;
+		}
+		if (may && scan_block(s->scan, buf, len, limit, s->patterns,
+				s->npatterns, start, m) != 0)
+		{
+			search_fail(s, "Error memory allocation for matches.");
+			break;
+		}
+		pthread_mutex_lock(&s->mtx);
+		if (!may)
+			++s->skipped;
+		s->done[task % s->window] = 1;
+		pthread_cond_broadcast(&s->cond);
+		pthread_mutex_unlock(&s->mtx);
+	}
+	free(buf);
+	cfclose(&fin);
+	return NULL;
+}
+
+int
+search(Search* s, size_t threads)
+{
+	pthread_t* workers = (pthread_t*)calloc(threads, sizeof(pthread_t));
+	s->results = (Matches*)calloc(s->window, sizeof(Matches));
+	s->done = (char*)calloc(s->window, 1);
+	if (!workers || !s->results || !s->done)
+	{
+		fprintf(stderr, "Error memory allocation.\n");
+		return -1;
 	}
-	if (memcmp(buf, target, targetsz) == 0)
+	pthread_mutex_init(&s->mtx, NULL);
+	pthread_cond_init(&s->cond, NULL);
+	size_t i, started = 0;
+	for (i = 0; i < threads; ++i, ++started)
+		if (pthread_create(&workers[i], NULL, search_worker, s) != 0)
+			break;
+	if (started == 0)
+		search_fail(s, "Error starting workers.");
+	size_t task;
+	for (task = 0; task < s->tasks; ++task)
 	{
-		printf("0\n");
-		return 0;
+		size_t slot = task % s->window;
+		pthread_mutex_lock(&s->mtx);
+		while (!s->done[slot] && !s->error)
+			pthread_cond_wait(&s->cond, &s->mtx);
+		pthread_mutex_unlock(&s->mtx);
+		if (!s->done[slot])
+			break;
+		print_matches(s->fname, s->patterns, s->npatterns,
+				&s->results[slot]);
+		pthread_mutex_lock(&s->mtx);
+		s->done[slot] = 0;
+		++s->printed;
+		pthread_cond_broadcast(&s->cond);
+		pthread_mutex_unlock(&s->mtx);
 	}
-	while (!cfeof(fin))
+	for (i = 0; i < started; ++i)
+		pthread_join(workers[i], NULL);
+	for (i = 0; i < s->window; ++i)
+		free(s->results[i].items);
+	free(s->results);
+	free(s->done);
+	free(workers);
+	pthread_cond_destroy(&s->cond);
+	pthread_mutex_destroy(&s->mtx);
+	return s->error ? -1 : 0;
+}
+
+int main(int argc, char* argv[])
+{
+	long threads = 1;
+	int opt, verbose = 0;
+	while ((opt = getopt(argc, argv, "j:v")) != -1)
 	{
-		int c = cfgetc(fin);
-		if (c == EOF)
+		if (opt == 'v')
 		{
-			if (cferror(fin))
-			{
-				fprintf(stderr, "Error reading file.\n");
-				return 1;
-			}
-			return 0;
+			verbose = 1;
+			continue;
 		}
-		size_t i;
-		for (i = 0; i < targetsz - 1; ++i) // targetsz > 0 by logic
-			buf[i] = buf[i+1];
-		buf[targetsz - 1] =c;
-		if (memcmp(buf, target, targetsz) == 0)
+		if (opt != 'j')
+			return 1;
+		threads = atol(optarg);
+		if (threads < 1 || threads > 256)
 		{
-			off_t off = cftello(fin);
-			printf("%s %lu\n", realp, (unsigned long)off);
+			fprintf(stderr, "Wrong threads count: %s.\n", optarg);
+			return 1;
 		}
 	}
-	return 0;
-}
+	if (argc - optind < 2)
+	{
+		printf("Usage: [-j <threads>] [-v] <file> <bytes> [<bytes> ...]\n");
+		return 0;
+	}
 
+	size_t npatterns = argc - optind - 1;
+	Pattern* patterns = (Pattern*)calloc(npatterns, sizeof(Pattern));
+	if (!patterns
+	 || parse_patterns(npatterns, argv + optind + 1, patterns) != 0)
+		return 1;
+	size_t i, maxlen = 0;
+	for (i = 0; i < npatterns; ++i)
+		if (patterns[i].len > maxlen)
+			maxlen = patterns[i].len;
+
+	char realp[PATH_MAX];
+	if (realpath(argv[optind], realp) == NULL)
+	{
+		fprintf(stderr, "Error getting realpath of \"%s\". Message: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	CFILE* fin = cfopen(realp, "rb");
+	if (!fin)
+	{
+		fprintf(stderr, "Error opening \"%s\". Message: %s\n", argv[optind], strerror(errno));
+		return 1;
+	}
+	Search s;
+	memset(&s, 0, sizeof(s));
+	s.fname = realp;
+	s.patterns = patterns;
+	s.npatterns = npatterns;
+	s.keep = maxlen - 1;
+	s.size = fin->size;
+	s.rangesz = (off_t)fin->chlen*TASK_CHUNKS;
+	s.tasks = s.size/s.rangesz + (s.size%s.rangesz ? 1 : 0);
+	s.window = threads*4;
+	s.scan = select_scan();
+	cfclose(&fin);
+	int rs = search(&s, threads);
+	if (verbose)
+		fprintf(stderr, "Skipped %lu of %lu ranges.\n",
+				(unsigned long)s.skipped, (unsigned long)s.tasks);
+	for (i = 0; i < npatterns; ++i)
+		free(patterns[i].bytes);
+	free(patterns);
+	return rs == 0 ? 0 : 1;
+}
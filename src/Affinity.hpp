@@ -0,0 +1,121 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 18:40:12 */
+
+#ifndef __AFFINITY_HPP__
+#define __AFFINITY_HPP__
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <string>
+#include <vector>
+
+namespace csio {
+
+/**@brief Parse CPU list in the sysfs/taskset format ("0-3,8,10-11")
+ * @return false on malformed list*/
+inline bool
+parse_cpu_list(const std::string& str, std::vector<int>& cpus)
+{
+	cpus.clear();
+	const char* p = str.c_str();
+	while (*p)
+	{
+		char* end;
+		long first = strtol(p, &end, 10);
+		if (end == p || first < 0 || first >= CPU_SETSIZE)
+			return false;
+		long last = first;
+		p = end;
+		if (*p == '-')
+		{
+			last = strtol(++p, &end, 10);
+			if (end == p || last < first || last >= CPU_SETSIZE)
+				return false;
+			p = end;
+		}
+		for (long i = first; i <= last; ++i)
+			cpus.push_back(i);
+		if (*p == ',')
+			++p;
+		else if (*p != '\0' && *p != '\n')
+			return false;
+		else
+			break;
+	}
+	return !cpus.empty();
+}
+
+/**@brief Bind the calling thread to the cpus (empty - do nothing)
+ *
+ * Memory allocated by the thread after that is placed on the node of
+ * these cpus (first touch policy).*/
+inline bool
+pin_thread(const std::vector<int>& cpus)
+{
+	if (cpus.empty())
+		return true;
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (size_t i = 0; i < cpus.size(); ++i)
+		CPU_SET(cpus[i], &set);
+	int rs = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+	if (rs != 0)
+		errno = rs;
+	return rs == 0;
+}
+
+/**@brief NUMA node of the block device holding the file
+ * @return -1 if unknown (not a block device, no NUMA, etc.)*/
+inline int
+device_numa_node(int fd)
+{
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+		return -1;
+	char path[PATH_MAX];
+	snprintf(path, sizeof(path), "/sys/dev/block/%u:%u",
+			major(st.st_dev), minor(st.st_dev));
+	std::string dev(path);
+	// partitions have no "device" link, their parent disk has
+	if (std::ifstream((dev + "/partition").c_str()).good())
+		dev += "/..";
+	if (!realpath((dev + "/device").c_str(), path))
+		return -1;
+	// virtio and nvme devices are children of the PCI device that
+	// knows the node
+	for (std::string dir(path);
+	     dir.size() > sizeof("/sys/devices") - 1;
+	     dir.erase(dir.rfind('/')))
+	{
+		std::ifstream f((dir + "/numa_node").c_str());
+		int node;
+		if (f >> node)
+			return node;
+	}
+	return -1;
+}
+
+/**@brief CPUs of the NUMA node the file's device is attached to
+ * @return false if unknown*/
+inline bool
+device_cpus(int fd, std::vector<int>& cpus)
+{
+	int node = device_numa_node(fd);
+	if (node < 0)
+		return false;
+	std::ifstream f(("/sys/devices/system/node/node"
+	                 + std::to_string(node) + "/cpulist").c_str());
+	std::string list;
+	return std::getline(f, list) && parse_cpu_list(list, cpus);
+}
+
+} // namespace
+
+#endif // __AFFINITY_HPP__
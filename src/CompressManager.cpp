@@ -8,29 +8,56 @@
 #include <unistd.h>
 #include <algorithm>
 #include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
 
 #include "CompressManager.hpp"
 #include "Utils.hpp"
+#include "Affinity.hpp"
 #include "Messages.hpp"
 #include "logging.hpp"
 
 namespace csio {
 
+/**@brief Count of '\n' in the chunk*/
+inline uint16_t
+count_newlines(const uint8_t* p, size_t len)
+{
+	uint16_t rs = 0;
+	const uint8_t* end = p + len;
+	while ((p = (const uint8_t*)memchr(p, '\n', end - p)) != NULL)
+	{
+		++rs;
+		++p;
+	}
+	return rs;
+}
 
 CompressManager::CompressManager(const Config& cfg)
 	: zmq_ctx_(zmq_init(0))
 	, sock_inbox_(NULL)
 	, sock_outbox_(NULL)
 	, sock_writer_(NULL)
+	, sock_control_(NULL)
+	, sock_loop_ctl_(NULL)
 	, cfg_(cfg)
 	, ifs_()
 	, ofd_(-1)
 	, stop_(false)
 	, MSG_QUEUE_HWM(cfg_.CompressorsCount()*2 + 5)
-	, ORDERING_SET_HWM(cfg.CompressorsCount()*3)
+	, ORDERING_SET_HWM(cfg.CompressorsCount()*3*cfg.BatchSize())
 	, msg_pushed_(0)
-	, compressors_count_(0)
+	, jobs_max_(cfg.CompressorsCount()*2)
+	, level_chunks_(Z_BEST_COMPRESSION + 1)
+	, blooms_(NULL)
+	, bloom_tailsz_(0)
+	, last_bytes_tx_(0)
+	, poll_timeouts_(0)
 {
+	if (cfg_.TargetMbps() > 0)
+		tuner_.reset(new LevelTuner(cfg_.TargetMbps()*1048576,
+			cfg_.CompressorsCount(), cfg_.CompressionLevel()));
 	LOG_IF(!zmq_ctx_, ERROR)
 		<< _("CompressManager: error creating communication context.")
 		<< _(" Message: ") << zmq_strerror(errno);
@@ -38,25 +65,13 @@ CompressManager::CompressManager(const Config& cfg)
 
 CompressManager::~CompressManager()
 {
-	zmq_close(sock_outbox_);
-	zmq_close(sock_inbox_);
-	zmq_close(sock_writer_);
 	zmq_ctx_destroy(zmq_ctx_);
 };
 
 bool
 CompressManager::makeInitialPush()
 {
-	size_t rdbufsz = ifs_.chunksz*cfg_.CompressorsCount();
-	std::unique_ptr<uint8_t[]> rdbuf(new uint8_t[rdbufsz]);
-	int rdbytes = read(ifs_.handler, rdbuf.get(), rdbufsz);
-	if (rdbytes == -1)
-	{
-		LOG(ERROR) << _("CompressManager: error reading file.")
-		           << _(" Message: ") << strerror(errno);
-		return false;
-	}
-	if (rdbytes == 0)
+	if (ifs_.bytes == 0)
 	{
 		VLOG(2) << _("CompressManager: the file is empty.");
 		return false;
@@ -72,28 +87,8 @@ CompressManager::makeInitialPush()
 		        << _(" Message: ") << zmq_strerror(errno);
 		return false;
 	}
-	while(ifs_.bytes_rx < rdbytes)
-	{
-		u16le chunksz = std::min(rdbytes - ifs_.bytes_rx, ifs_.chunksz);
-		Message fchunk(rdbuf.get() + ifs_.bytes_rx,
-		               chunksz,
-		               ifs_.cur_chunks_rx + 1);
-		if (!fchunk.Send(sock_outbox_, Message::BLOCKING_MODE))
-		{
-			VLOG(2) << _("CompressManager: error initially"
-			             " pushing chunk #") << ifs_.chunks_rx;
-			return false;
-		}
-		ifs_.cur_crc32 = crc32(ifs_.cur_crc32, 
-		                       (Bytef*)rdbuf.get() + ifs_.bytes_rx,
-		                       chunksz);
-		ifs_.bytes_rx += chunksz;
-		ifs_.cur_bytes_rx += chunksz;
-		++ifs_.chunks_rx;
-		++ifs_.cur_chunks_rx;
-		++compressors_count_;
-		++msg_pushed_;
-	}
+	if (!makeRegularPush() || msg_pushed_ == 0)
+		return false;
 	VLOG(2) << _("CompressManager: initial push with ")
 	        << ifs_.chunks_rx << (" elements.");
 	return true;
@@ -119,8 +114,8 @@ CompressManager::flushOrderingSet()
 		}
 		ifs_.bytes_tx += os_head->DataSize();
 		ifs_.cur_bytes_tx += os_head->DataSize();
-		++ifs_.cur_chunks_tx;
-		++ifs_.chunks_tx;
+		ifs_.cur_chunks_tx += os_head->Count();
+		ifs_.chunks_tx += os_head->Count();
 		ordering_set_.erase(os_head);
 		os_head = ordering_set_.begin();
 	}
@@ -131,8 +126,8 @@ CompressManager::PollStatus
 CompressManager::processCompressorIncoming()
 {
 #		ifndef NDEBUG
-		VLOG(2) << "Pushed messages count / compressors count: "
-			<< msg_pushed_ << "/" << compressors_count_ << ")";
+		VLOG(2) << "Pushed messages count / maximum: "
+			<< msg_pushed_ << "/" << jobs_max_ << ")";
 #		endif // NDEBUG
 	Message msg;
 	msg.Fetch(sock_inbox_);
@@ -148,7 +143,7 @@ CompressManager::processCompressorIncoming()
 		             " from one of the Compressors.");
 		return POLL_BREAK;
 	}
-	if (msg.Type() != Message::TYPE_FCHUNK || msg.DataSize() == 0)
+	if (msg.Type() != Message::TYPE_FBATCH || msg.DataSize() == 0)
 	{
 		LOG(ERROR) << _("CompressManager: error"
 		                " fetching regular message")
@@ -156,6 +151,11 @@ CompressManager::processCompressorIncoming()
 		return POLL_BREAK;
 	}
 	--msg_pushed_;
+	if (msg.Level() < level_chunks_.size())
+		level_chunks_[msg.Level()] += msg.Count();
+	if (tuner_ && msg.Usec() > 0)
+		tuner_->Account(msg.Level(), msg.Count()*ifs_.chunksz,
+		                msg.Usec()*1000ULL);
 	ordering_set_.insert(msg);
 	if (!flushOrderingSet())
 	{
@@ -174,7 +174,6 @@ CompressManager::processCompressorIncoming()
 				_("ComrpessManager: error sending mclose."));
 			return POLL_BREAK;
 		}
-		MSG_STOP.Send(sock_outbox_);
 		return POLL_CONTINUE;
 	}
 	std::set<Message>::reverse_iterator os_last = ordering_set_.rbegin();
@@ -183,6 +182,7 @@ CompressManager::processCompressorIncoming()
 	{
 		VLOG(2) << _("CompressManager: skipping file chunk reading,"
 		             " because ordering set is full");
+		++reader_stats_.stalls;
 		if (msg_pushed_ == 0)
 		{
 			VLOG(2) << ("CompressManager: oredering set if full and"
@@ -200,7 +200,7 @@ CompressManager::processCompressorIncoming()
 bool
 CompressManager::makeRegularPush()
 {
-	while (msg_pushed_ < compressors_count_ && ifs_.bytes_rx < ifs_.bytes)
+	while (msg_pushed_ < jobs_max_ && ifs_.bytes_rx < ifs_.bytes)
 	{
 		if (ifs_.cur_chunks_rx == ifs_.cur_chunks_mx)
 		{
@@ -240,19 +240,48 @@ CompressManager::makeRegularPush()
 				return false;
 			}
 		}
-		uint8_t buf[CHUNK_SIZE];
-		memset(buf, 0, sizeof(buf));
-		int rdsize = read(ifs_.handler, buf, sizeof(buf));
-		if (rdsize < 0)
+		// batch of contiguous chunks, that doesn't cross the member
+		size_t count = std::min<size_t>(cfg_.BatchSize(),
+			ifs_.cur_chunks_mx - ifs_.cur_chunks_rx);
+		size_t want = std::min<size_t>(count*ifs_.chunksz,
+			ifs_.bytes - ifs_.bytes_rx);
+		if (rdbuf_.size() < cfg_.BatchSize()*ifs_.chunksz)
+			rdbuf_.resize(cfg_.BatchSize()*ifs_.chunksz);
+		Clock::time_point read_start = Clock::now();
+		size_t rdsize = 0;
+		while (rdsize < want)
 		{
-			LOG(ERROR) << _("CompressManager: error file read.")
-			           << _(" Message: ") << strerror(errno);
-			return false;
+			ssize_t rs = read(ifs_.handler, &rdbuf_[rdsize],
+			                  want - rdsize);
+			if (rs < 0 && errno == EINTR)
+				continue;
+			if (rs < 0)
+			{
+				LOG(ERROR) << _("CompressManager: error file read.")
+				           << _(" Message: ") << strerror(errno);
+				return false;
+			}
+			if (rs == 0)
+				break;
+			rdsize += rs;
 		}
+		reader_stats_.busy_ns += ns_since(read_start);
 		if (rdsize == 0)
 			return true;
-		Message msg(buf, rdsize, ifs_.cur_chunks_rx + 1);
-		if (!msg.Send(sock_outbox_))
+		uint16_t lens[1024];
+		count = 0;
+		for (size_t off = 0; off < rdsize; off += ifs_.chunksz)
+		{
+			lens[count++] = std::min<size_t>(ifs_.chunksz, rdsize - off);
+			if (cfg_.LineIndex())
+				lines_.push_back(count_newlines(&rdbuf_[off],
+				                                lens[count - 1]));
+			if (blooms_ && !addBloom(&rdbuf_[off], lens[count - 1]))
+				return false;
+		}
+		Message msg(&rdbuf_[0], lens, count, ifs_.cur_chunks_rx + 1,
+		            tuner_ ? tuner_->Level() : ifs_.level);
+		if (!msg.Send(sock_outbox_, Message::BLOCKING_MODE))
 		{
 			LOG(ERROR) << _("CompressManager: error transmitting "
 			                " chunk to compress.")
@@ -261,10 +290,49 @@ CompressManager::makeRegularPush()
 		}
 		ifs_.cur_bytes_rx += rdsize;
 		ifs_.bytes_rx += rdsize;
-		++ifs_.chunks_rx;
-		++ifs_.cur_chunks_rx;
-		ifs_.cur_crc32 = crc32(ifs_.cur_crc32, (Bytef*)buf, rdsize);
+		ifs_.chunks_rx += count;
+		ifs_.cur_chunks_rx += count;
+		ifs_.cur_crc32 = crc32(ifs_.cur_crc32, (Bytef*)&rdbuf_[0], rdsize);
 		++msg_pushed_;
+		reader_stats_.items += count;
+		reader_stats_.bytes += rdsize;
+	}
+	return true;
+}
+
+/**@brief Write the bloom filter of the chunk to the temporary file
+ *
+ * The filter has n-grams ending in the chunk, so the last
+ * CFBLOOM_GRAM - 1 bytes of the previous chunk are kept.*/
+bool
+CompressManager::addBloom(const uint8_t* chunk, size_t len)
+{
+	const size_t tail = CFBLOOM_GRAM - 1;
+	bloom_.assign(cfg_.BloomSize(), 0);
+	cfbloom_add(&bloom_[0], bloom_.size(), chunk, len);
+	uint8_t edge[2*tail];
+	size_t head = std::min(tail, len);
+	std::copy(bloom_tail_, bloom_tail_ + bloom_tailsz_, edge);
+	std::copy(chunk, chunk + head, edge + bloom_tailsz_);
+	cfbloom_add(&bloom_[0], bloom_.size(), edge, bloom_tailsz_ + head);
+	if (len >= tail)
+	{
+		std::copy(chunk + len - tail, chunk + len, bloom_tail_);
+		bloom_tailsz_ = tail;
+	}
+	else
+	{
+		// the whole chunk is in the edge
+		size_t edgesz = bloom_tailsz_ + head;
+		bloom_tailsz_ = std::min(tail, edgesz);
+		std::copy(edge + edgesz - bloom_tailsz_, edge + edgesz,
+		          bloom_tail_);
+	}
+	if (fwrite_unlocked(&bloom_[0], bloom_.size(), 1, blooms_) != 1)
+	{
+		LOG(ERROR) << _("CompressManager: error bloom filter writing.")
+		           << _(" Message: ") << strerror(errno);
+		return false;
 	}
 	return true;
 }
@@ -290,20 +358,39 @@ CompressManager::loop(CompressManager* self)
 		self->ifs_.cur_chunks_mx = CHUNKS_PER_MEMBER;
 	else
 		self->ifs_.cur_chunks_mx = self->ifs_.chunks;
-	if (!self->makeInitialPush()
-	 || self->msg_pushed_ != self->compressors_count_)
+	if (!self->makeInitialPush())
 	{
 		self->Stop();
 		VLOG(2) << _("CompressManager: error making initial push.");
 		return;
 	}
-	zmq_pollitem_t items[2] =  {
-		{self->sock_inbox_, 0, ZMQ_POLLIN, 0},
-		{self->sock_writer_,   0, ZMQ_POLLIN, 0}
+	zmq_pollitem_t items[3] =  {
+		{self->sock_inbox_,    0, ZMQ_POLLIN, 0},
+		{self->sock_writer_,   0, ZMQ_POLLIN, 0},
+		{self->sock_loop_ctl_, 0, ZMQ_POLLIN, 0}
 	};
 	while(!self->stop_)
 	{
-		int rs = zmq_poll(items, 2, TICK);
+		// sleep until an event, wake up only for the progress report
+		long timeout = -1;
+		if (self->cfg_.Stats())
+		{
+			Clock::time_point next = self->last_report_
+			                       + std::chrono::seconds(1);
+			Clock::time_point now = Clock::now();
+			if (now >= next)
+			{
+				self->report(false);
+				next = now + std::chrono::seconds(1);
+			}
+			timeout = std::chrono::duration_cast<
+				std::chrono::milliseconds>(next - now).count() + 1;
+		}
+		Clock::time_point wait_start = Clock::now();
+		int rs = zmq_poll(items, 3, timeout);
+		self->reader_stats_.wait_ns += ns_since(wait_start);
+		if (rs < 0 && errno == EINTR)
+			continue;
 		if (rs < 0)
 		{
 			LOG(ERROR) << _("CompressManager: error polling.")
@@ -311,7 +398,15 @@ CompressManager::loop(CompressManager* self)
 			break;
 		}
 		if (rs == 0)
+		{
+			++self->poll_timeouts_;
 			continue;
+		}
+		if (items[2].revents & ZMQ_POLLIN)
+		{
+			VLOG(2) << _("CompressManager: received stop request.");
+			break;
+		}
 		if (items[0].revents & ZMQ_POLLIN)
 		{
 			if (self->processCompressorIncoming()
@@ -336,22 +431,41 @@ CompressManager::loop(CompressManager* self)
 bool
 CompressManager::createSocks()
 {
+	// outbox pipes are short: batches go to compressors, that are free
 	sock_outbox_  = createBindSock(zmq_ctx_,
 	                                "inproc://outbox",
 	                                ZMQ_PUSH,
-	                                MSG_QUEUE_HWM);
+	                                1,
+	                                cfg_.MsgMaxSize());
 	sock_inbox_   = createBindSock(zmq_ctx_,
 	                                "inproc://inbox",
 	                                ZMQ_PULL,
-	                                MSG_QUEUE_HWM);
+	                                MSG_QUEUE_HWM,
+	                                cfg_.MsgMaxSize());
 	sock_writer_   = createBindSock(zmq_ctx_,
 	                                "inproc://writer",
 	                                ZMQ_PAIR,
-	                                MSG_QUEUE_HWM);
+	                                MSG_QUEUE_HWM,
+	                                cfg_.MsgMaxSize());
 	VLOG_IF(sock_outbox_ == NULL, 2) << _("Error with jobs socket.");
 	VLOG_IF(sock_inbox_  == NULL, 2) << _("Error with feedback socket.");
+	sock_control_  = createBindSock(zmq_ctx_,
+	                                "inproc://control",
+	                                ZMQ_PUB);
+	sock_loop_ctl_ = createConnectSock(zmq_ctx_,
+	                                "inproc://control",
+	                                ZMQ_SUB);
+	if (sock_loop_ctl_
+	 && zmq_setsockopt(sock_loop_ctl_, ZMQ_SUBSCRIBE, "", 0) == -1)
+	{
+		zmq_close(sock_loop_ctl_);
+		sock_loop_ctl_ = NULL;
+	}
 	VLOG_IF(sock_writer_ == NULL, 2) << _("Error with writer socket.");
-	if (!sock_outbox_ || !sock_inbox_ || !sock_writer_)
+	VLOG_IF(sock_control_ == NULL || sock_loop_ctl_ == NULL, 2)
+		<< _("Error with control sockets.");
+	if (!sock_outbox_ || !sock_inbox_ || !sock_writer_
+	 || !sock_control_ || !sock_loop_ctl_)
 		return false;
 	return true;
 }
@@ -392,6 +506,14 @@ CompressManager::openFiles()
 	ifs_.level = cfg_.CompressionLevel();
 	ifs_.chunksz = CHUNK_SIZE;
 
+	if (cfg_.BloomSize() && !(blooms_ = tmpfile()))
+	{
+		LOG(ERROR) << _("Error creating temporary file for bloom"
+		                " filters.")
+		           << _(" Message: ") << strerror(errno);
+		return false;
+	}
+
 	ifs_.handler = open(cfg_.IFName().c_str(), O_RDONLY);
 	if (ifs_.handler == -1)
 	{
@@ -424,18 +546,22 @@ CompressManager::openFiles()
 bool
 CompressManager::waitChildrenReady(const size_t timeout_ms)
 {
-	std::chrono::time_point<std::chrono::system_clock> deadline
-		= std::chrono::system_clock::now()
-			+ std::chrono::milliseconds(timeout_ms);
+	Clock::time_point deadline = Clock::now()
+		+ std::chrono::milliseconds(timeout_ms);
 	zmq_pollitem_t poll_items[2] = {
 		{sock_inbox_,  0, ZMQ_POLLIN, 0},
 		{sock_writer_, 0, ZMQ_POLLIN, 0}
 	};
 	size_t compressors_ready = 0;
 	bool writer_ready = false;
-	while(deadline > std::chrono::system_clock::now())
+	Clock::time_point now;
+	while(deadline > (now = Clock::now()))
 	{
-		int rs = zmq_poll(poll_items, 2, TICK);
+		int rs = zmq_poll(poll_items, 2,
+			std::chrono::duration_cast<std::chrono::milliseconds>(
+				deadline - now).count() + 1);
+		if (rs == -1 && errno == EINTR)
+			continue;
 		VLOG_IF(rs == -1, 2)
 			<< _("CompressManager: error threads initialization.")
 			<< _(" Message: ") << zmq_strerror(errno);
@@ -488,8 +614,21 @@ CompressManager::doStart()
 	}
 	for(size_t i = 0; i < cfg_.CompressorsCount(); ++i)
 		compressors_instances_.push_back(std::unique_ptr<Compressor>(
-			new Compressor(zmq_ctx_, cfg_)));
-	writer_instance_.reset(new Writer(zmq_ctx_, MSG_QUEUE_HWM));
+			new Compressor(zmq_ctx_, cfg_, i)));
+	last_compressors_.resize(cfg_.CompressorsCount());
+	start_time_ = last_report_ = Clock::now();
+	std::vector<int> writer_cpus = cfg_.WriterCpus();
+	if (cfg_.WriterCpusAuto() && !device_cpus(ofd_, writer_cpus))
+		VLOG(2) << _("CompressManager: unknown NUMA node of the output"
+		             " device, writer is not pinned.");
+	writer_instance_.reset(new Writer(zmq_ctx_, MSG_QUEUE_HWM,
+	                                  cfg_.MsgMaxSize(), writer_cpus,
+	                                  cfg_.Format()));
+	if (cfg_.LineIndex())
+		writer_instance_->SetLineIndex(&lines_);
+	if (blooms_)
+		writer_instance_->SetBlooms(blooms_, cfg_.BloomSize());
+	writer_instance_->SetTrailerIndex(cfg_.TrailerIndex());
 	VLOG(2) << _("CompressManager: sockets created.");
 	writer_thread_.reset(new std::thread(
 				Writer::Start, writer_instance_.get(), ofd_));
@@ -501,7 +640,7 @@ CompressManager::doStart()
 			                cfg_.CompressionLevel())
 		));
 	}
-	if (!waitChildrenReady(10*TICK))
+	if (!waitChildrenReady(1000))
 	{
 		LOG(ERROR) << _("CompressManager: Some threads wasn't ready in"
 		                " the given timeout.");
@@ -518,21 +657,28 @@ CompressManager::doStop()
 {
 	VLOG(2) << _("CompressManger: stopping.");
 	stop_ = true;
-	MSG_STOP.Send(sock_writer_);
-	for(size_t i = 0; i < compressors_instances_.size(); ++i)
-		MSG_STOP.Send(sock_outbox_);
-	if (writer_thread_)
-	{
-		writer_thread_->join();
-		writer_thread_.reset();
-	}
-	writer_thread_ = NULL;
+	// wake up the loop and the compressors
+	MSG_STOP.Send(sock_control_);
 	if (loop_thread_)
 	{
 		loop_thread_->join();
 		loop_thread_.reset();
 	}
 	loop_thread_ = NULL;
+	// the loop is joined, so MSG_STOP is the last message for the
+	// writer. Timeout saves from hanging, if the writer has failed.
+	if (writer_thread_)
+	{
+		const int timeout = 1000;
+		zmq_setsockopt(sock_writer_, ZMQ_SNDTIMEO,
+		               &timeout, sizeof(timeout));
+		MSG_STOP.Send(sock_writer_, Message::BLOCKING_MODE);
+		writer_thread_->join();
+		writer_thread_.reset();
+		// the writer closes output itself
+		ofd_ = -1;
+	}
+	writer_thread_ = NULL;
 	for (size_t i = 0; i < workers_threads_.size(); ++i)
 	{
 		if (workers_threads_[i])
@@ -542,12 +688,162 @@ CompressManager::doStop()
 		}
 	}
 	workers_threads_.clear();
+	if (cfg_.Stats() && writer_instance_)
+		report(true);
+	if (tuner_ && writer_instance_)
+		reportLevels();
 	close(ofd_);
 	close(ifs_.handler);
+	if (blooms_)
+		fclose(blooms_);
+	blooms_ = NULL;
+	ofd_ = ifs_.handler = -1;
 	zmq_close(sock_outbox_);
 	zmq_close(sock_inbox_);
 	zmq_close(sock_writer_);
+	zmq_close(sock_control_);
+	zmq_close(sock_loop_ctl_);
+	sock_outbox_ = sock_inbox_ = sock_writer_ = NULL;
+	sock_control_ = sock_loop_ctl_ = NULL;
 	return true;
 }
 
+inline double
+to_mib(uint64_t bytes)
+{
+	return bytes/1048576.0;
+}
+
+inline double
+to_sec(uint64_t ns)
+{
+	return ns/1e9;
+}
+
+inline int
+percent(uint64_t part, uint64_t total)
+{
+	return total ? (int)(100.0*part/total + 0.5) : 0;
+}
+
+/**@brief Print histogram of the levels used with --target-mbps*/
+void
+CompressManager::reportLevels()
+{
+	uint64_t elapsed = ns_since(start_time_);
+	uint64_t total = 0;
+	for (size_t i = 0; i < level_chunks_.size(); ++i)
+		total += level_chunks_[i];
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1)
+	   << "dzip levels (target " << cfg_.TargetMbps() << " MiB/s, achieved "
+	   << to_mib(ifs_.bytes_rx/to_sec(elapsed ? elapsed : 1)) << " MiB/s):"
+	   << std::endl;
+	for (size_t i = level_chunks_.size(); i-- > 0;)
+	{
+		if (level_chunks_[i] == 0)
+			continue;
+		ss << "  level " << i << std::setw(12) << level_chunks_[i]
+		   << " chunks " << std::setw(5)
+		   << 100.0*level_chunks_[i]/total << "%" << std::endl;
+	}
+	std::cerr << ss.str();
+}
+
+/**@brief Print pipeline telemetry to stderr
+ *
+ * Periodic report is one line: progress, throughput, queues (chunks in
+ * compressors and in the ordering set), compressors and writer
+ * utilization since the last report and ETA. The summary (on stop)
+ * gives totals for every stage and names the bottleneck - the stage
+ * with the highest utilization.*/
+void
+CompressManager::report(bool summary)
+{
+	Clock::time_point now = Clock::now();
+	uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		now - start_time_).count();
+	uint64_t interval = summary ? elapsed :
+		std::chrono::duration_cast<std::chrono::nanoseconds>(
+			now - last_report_).count();
+	if (interval == 0)
+		interval = 1;
+	std::vector<StageSnapshot> cmprs;
+	for (size_t i = 0; i < compressors_instances_.size(); ++i)
+		cmprs.push_back(StageSnapshot(compressors_instances_[i]->Stats()));
+	StageSnapshot writer(writer_instance_->Stats());
+	StageSnapshot reader(reader_stats_);
+	std::stringstream ss;
+	ss << std::fixed << std::setprecision(1);
+	if (!summary)
+	{
+		// bytes_tx counts compressed bytes, all chunks but the last
+		// are full
+		uint64_t done = std::min<uint64_t>(ifs_.chunks_tx*ifs_.chunksz,
+		                                   ifs_.bytes);
+		double speed = (done - last_bytes_tx_)/to_sec(interval);
+		double avg_speed = done/to_sec(elapsed);
+		ss << "dzip: " << std::setw(5)
+		   << (ifs_.bytes ? 100.0*done/ifs_.bytes : 100.0) << "% "
+		   << to_mib(done) << "/" << to_mib(ifs_.bytes) << " MiB "
+		   << to_mib(speed) << " MiB/s"
+		   << " out " << to_mib(writer.bytes) << " MiB"
+		   << " | queue " << msg_pushed_
+		   << " ordering " << ordering_set_.size()
+		   << " | compressors";
+		for (size_t i = 0; i < cmprs.size(); ++i)
+			ss << " " << percent(cmprs[i].busy_ns
+				- last_compressors_[i].busy_ns, interval) << "%";
+		ss << " | writer " << percent(writer.busy_ns - last_writer_.busy_ns,
+		                              interval) << "%"
+		   << " | ETA ";
+		if (avg_speed > 0)
+			ss << (ifs_.bytes - done)/avg_speed << "s";
+		else
+			ss << "?";
+		std::cerr << ss.str() << std::endl;
+		last_report_ = now;
+		last_bytes_tx_ = done;
+		last_compressors_ = cmprs;
+		last_writer_ = writer;
+		return;
+	}
+	ss << std::setprecision(3);
+	ss << "dzip stats:" << std::endl
+	   << "  elapsed       " << to_sec(elapsed) << " s" << std::endl
+	   << "  input         " << to_mib(ifs_.bytes_rx) << " MiB ("
+	   << to_mib(ifs_.bytes_rx/to_sec(elapsed)) << " MiB/s)" << std::endl
+	   << "  output        " << to_mib(writer.bytes) << " MiB (ratio "
+	   << (ifs_.bytes_rx ? (double)writer.bytes/ifs_.bytes_rx : 0.0)
+	   << ")" << std::endl
+	   << "  reader        read " << to_sec(reader.busy_ns) << " s ("
+	   << percent(reader.busy_ns, elapsed) << "%), wait "
+	   << to_sec(reader.wait_ns) << " s, " << reader.items << " chunks, "
+	   << "ordering set full " << reader.stalls << " times" << std::endl;
+	uint64_t cmprs_busy = 0;
+	for (size_t i = 0; i < cmprs.size(); ++i)
+	{
+		ss << "  compressor #" << i << " busy " << to_sec(cmprs[i].busy_ns)
+		   << " s (" << percent(cmprs[i].busy_ns, elapsed) << "%), idle "
+		   << to_sec(cmprs[i].wait_ns) << " s, " << cmprs[i].items
+		   << " chunks" << std::endl;
+		cmprs_busy += cmprs[i].busy_ns;
+	}
+	ss << "  writer        busy " << to_sec(writer.busy_ns) << " s ("
+	   << percent(writer.busy_ns, elapsed) << "%), stalled "
+	   << to_sec(writer.wait_ns) << " s waiting for chunks" << std::endl;
+	int reader_util = percent(reader.busy_ns, elapsed);
+	int cmprs_util = cmprs.empty() ? 0 :
+		percent(cmprs_busy/cmprs.size(), elapsed);
+	int writer_util = percent(writer.busy_ns, elapsed);
+	ss << "  bottleneck    ";
+	if (cmprs_util >= reader_util && cmprs_util >= writer_util)
+		ss << "compressors (add threads with -j)";
+	else if (reader_util >= writer_util)
+		ss << "reader (input I/O)";
+	else
+		ss << "writer (output I/O)";
+	std::cerr << ss.str() << std::endl;
+}
+
 } // namespace
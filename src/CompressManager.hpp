@@ -17,6 +17,8 @@
 #include "Writer.hpp"
 #include "Compressor.hpp"
 #include "Messages.hpp"
+#include "Telemetry.hpp"
+#include "LevelTuner.hpp"
 
 namespace csio {
 
@@ -25,6 +27,9 @@ class CompressManager : public ProcessManagerBase
 public:
 	CompressManager(const Config& cfg);
 	~CompressManager();
+	/**@brief Loop wake ups without events (the progress report of
+	 * --stats only)*/
+	size_t PollTimeouts() const { return poll_timeouts_; }
 
 protected:
 	virtual bool doStart();
@@ -67,6 +72,7 @@ private:
 	bool makeRegularPush();
 	bool flushOrderingSet();
 	bool openFiles();
+	bool addBloom(const uint8_t* chunk, size_t len);
 
 	enum PollStatus :bool
 	{
@@ -75,12 +81,16 @@ private:
 	};
 	PollStatus processCompressorIncoming();
 	PollStatus processWriterIncoming();
+	void       report(bool summary);
+	void       reportLevels();
 
 private:
 	void* zmq_ctx_;
 	void* sock_inbox_;
 	void* sock_outbox_;
 	void* sock_writer_;
+	void* sock_control_;  //!< PUB, stop requests to all threads
+	void* sock_loop_ctl_; //!< SUB of the loop thread to sock_control_
 
 	std::unique_ptr<Writer>                    writer_instance_;
 	std::vector<std::unique_ptr<Compressor> >  compressors_instances_;
@@ -95,8 +105,27 @@ private:
 	bool         stop_;
 	const size_t ORDERING_SET_HWM;
 	const size_t MSG_QUEUE_HWM;
-	int          msg_pushed_;
-	size_t       compressors_count_;
+	int          msg_pushed_;   //!< batches in compressors
+	int          jobs_max_;     //!< maximum of msg_pushed_
+	std::vector<uint8_t> rdbuf_;
+	std::unique_ptr<LevelTuner> tuner_; //!< only with --target-mbps
+	std::vector<uint64_t> level_chunks_; //!< chunks compressed per level
+	std::vector<uint16_t> lines_;        //!< newlines per chunk (for the
+	                                     //!< writer, with --line-index)
+	FILE*                 blooms_;       //!< chunk filters (for the writer,
+	                                     //!< with --bloom)
+	std::vector<uint8_t>  bloom_;
+	uint8_t               bloom_tail_[3];//!< end of the previous chunk
+	size_t                bloom_tailsz_;
+
+	// telemetry (see report)
+	StageStats                 reader_stats_;
+	Clock::time_point          start_time_;
+	Clock::time_point          last_report_;
+	size_t                     last_bytes_tx_;
+	std::vector<StageSnapshot> last_compressors_;
+	StageSnapshot              last_writer_;
+	size_t                     poll_timeouts_;
 
 };
 
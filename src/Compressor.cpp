@@ -6,6 +6,7 @@
 #include <gettext.h>
 #include <zmq.h>
 #include "Utils.hpp"
+#include "Affinity.hpp"
 #include "Messages.hpp"
 #include "CompressManager.hpp"
 #include <zlib.h>
@@ -18,27 +19,214 @@ namespace csio {
 #  define DEF_MEM_LEVEL  MAX_MEM_LEVEL
 #endif
 
+/**@brief Sockets are created here (not in the thread), so they are
+ * connected and subscribed to the control channel before the manager
+ * can send anything.*/
+Compressor::Compressor(void* zmq_ctx, Config& cfg, size_t id)
+	: zmq_ctx_(zmq_ctx)
+	, sock_in_(NULL)
+	, sock_out_(NULL)
+	, sock_ctl_(NULL)
+	, break_(false)
+	, cfg_(cfg)
+{
+	const std::vector<int>& cpus = cfg_.CompressorsCpus();
+	if (!cpus.empty())
+		cpus_.push_back(cpus[id % cpus.size()]);
+	int hwm = cfg_.MsgHWM();
+	// small input pipe, so idle compressors take the next batch, while
+	// busy ones don't accumulate it
+	sock_in_ = createConnectSock(zmq_ctx_, "inproc://outbox", ZMQ_PULL,
+			1, cfg_.MsgMaxSize());
+	sock_out_ = createConnectSock(zmq_ctx_, "inproc://inbox", ZMQ_PUSH,
+			hwm, cfg_.MsgMaxSize());
+	sock_ctl_ = createConnectSock(zmq_ctx_, "inproc://control", ZMQ_SUB);
+	if (sock_ctl_ && zmq_setsockopt(sock_ctl_, ZMQ_SUBSCRIBE, "", 0) == -1)
+	{
+		zmq_close(sock_ctl_);
+		sock_ctl_ = NULL;
+	}
+}
+
+/**@brief Compress one chunk (Z_NO_FLUSH, then Z_FULL_FLUSH)
+ * @param produced compressed size
+ * @return false on error*/
+bool
+Compressor::compress(z_stream& zst, const uint8_t* data, size_t datasz,
+                     uint8_t* out, size_t outsz, uint16_t& produced)
+{
+	zst.avail_in = datasz;
+	zst.avail_out = outsz;
+	zst.next_in = (Bytef*)data;
+	zst.next_out = (Bytef*)out;
+	zst.total_in = 0;
+	zst.total_out = 0;
+	int rs = deflate(&zst, Z_NO_FLUSH);
+	if (rs != Z_OK || zst.avail_in != 0)
+	{
+		LOG(ERROR) << "Compressor (" << this << "):"
+		           << _(" compression error.")
+		           << _(" Message: ") << (zst.msg ? zst.msg :
+		              _(" not all data was compressed"));
+		return false;
+	}
+	zst.avail_in = 0;
+	zst.next_in = NULL;
+	rs = deflate(&zst, Z_FULL_FLUSH);
+	if (rs != Z_OK || zst.avail_out == 0)
+	{
+		LOG(ERROR) << "Compressor (" << this << "):"
+		           << _(" compression error.")
+		           << _(" Message: ") << (zst.msg ? zst.msg :
+		              _(" not enough space for the chunk"));
+		return false;
+	}
+	if (zst.total_out == 0)
+	{
+		LOG(ERROR) << "Compressor (" << this << "):"
+		           << _(" compression error.")
+		           << _(" Wrong available out value ");
+		return false;
+	}
+	produced = zst.total_out;
+	return true;
+}
+
+#ifdef CSIO_WITH_ISAL
+/**@brief Init ISA-L stream, zlib levels 0..9 are mapped to 0..3*/
+void
+Compressor::initIsal(isal_zstream& zst, int level)
+{
+	static const uint32_t LVLBUF_SIZES[] = {ISAL_DEF_LVL0_DEFAULT,
+		ISAL_DEF_LVL1_DEFAULT, ISAL_DEF_LVL2_DEFAULT, ISAL_DEF_LVL3_DEFAULT};
+	isal_deflate_init(&zst);
+	zst.level = level*ISAL_DEF_MAX_LEVEL/9;
+	zst.level_buf_size = LVLBUF_SIZES[zst.level];
+	if (zst.level_buf_size)
+	{
+		isal_lvlbuf_.reset(new uint8_t[zst.level_buf_size]);
+		zst.level_buf = isal_lvlbuf_.get();
+	}
+	zst.gzip_flag = IGZIP_DEFLATE;
+	// like Z_FULL_FLUSH - byte aligned non-final blocks and the history
+	// reset after every call
+	zst.flush = FULL_FLUSH;
+	zst.end_of_stream = 0;
+}
+
+/**@brief Compress one chunk with ISA-L
+ * @param produced compressed size
+ * @return false on error*/
+bool
+Compressor::compress(isal_zstream& zst, const uint8_t* data, size_t datasz,
+                     uint8_t* out, size_t outsz, uint16_t& produced)
+{
+	zst.next_in = (uint8_t*)data;
+	zst.avail_in = datasz;
+	zst.next_out = out;
+	zst.avail_out = outsz;
+	uint32_t total_out = zst.total_out;
+	if (isal_deflate(&zst) != COMP_OK || zst.avail_in != 0
+	 || zst.avail_out == 0 || zst.total_out == total_out)
+	{
+		LOG(ERROR) << "Compressor (" << this << "):"
+		           << _(" ISA-L compression error.");
+		return false;
+	}
+	produced = zst.total_out - total_out;
+	return true;
+}
+#endif
+
+#ifdef CSIO_WITH_ZSTD
+/**@brief Compress one chunk into the independent zstd frame
+ * @param produced compressed size
+ * @return false on error*/
+bool
+Compressor::compress(ZSTD_CCtx* cctx, int level, const uint8_t* data,
+                     size_t datasz, uint8_t* out, size_t outsz,
+                     uint16_t& produced)
+{
+	size_t rs = ZSTD_compressCCtx(cctx, out, outsz, data, datasz, level);
+	if (ZSTD_isError(rs))
+	{
+		LOG(ERROR) << "Compressor (" << this << "):"
+		           << _(" zstd compression error.")
+		           << _(" Message: ") << ZSTD_getErrorName(rs);
+		return false;
+	}
+	produced = rs;
+	return true;
+}
+#endif
+
+#ifdef CSIO_WITH_LZ4
+/**@brief Compress one chunk into the LZ4 block with the block size
+ *
+ * Levels below LZ4HC_CLEVEL_MIN use the fast compressor. Incompressible
+ * chunks are stored.
+ * @param produced compressed size
+ * @return false on error*/
+bool
+Compressor::compressLz4(int level, const uint8_t* data, size_t datasz,
+                        uint8_t* out, size_t outsz, uint16_t& produced)
+{
+	const bool hc = level >= LZ4HC_CLEVEL_MIN;
+	if (!lz4_state_)
+		lz4_state_.reset(new char[hc ? LZ4_sizeofStateHC()
+		                             : LZ4_sizeofState()]);
+	if (outsz < 4 + datasz)
+	{
+		LOG(ERROR) << "Compressor (" << this << "):"
+		           << _(" not enough space for the LZ4 block.");
+		return false;
+	}
+	int rs = hc
+		? LZ4_compress_HC_extStateHC(lz4_state_.get(), (const char*)data,
+			(char*)out + 4, datasz, datasz - 1, level)
+		: LZ4_compress_fast_extState(lz4_state_.get(), (const char*)data,
+			(char*)out + 4, datasz, datasz - 1, 1);
+	uint32_t bsize = rs;
+	if (rs <= 0)
+	{
+		memcpy(out + 4, data, datasz);
+		bsize = datasz | LZ4_BLOCK_UNCOMPRESSED;
+	}
+	u32le tmp(bsize);
+	memcpy(out, tmp.bytes, 4);
+	produced = 4 + (bsize & ~LZ4_BLOCK_UNCOMPRESSED);
+	return true;
+}
+#endif
+
 void*
 Compressor::Start(Compressor* self, int level)
 {
 	self->break_ = false;
-	int hwm = self->cfg_.MsgHWM();
-	void* sock_in_  =
-		createConnectSock(self->zmq_ctx_, "inproc://outbox", ZMQ_PULL,
-				hwm);
-	void* sock_out_ =
-		createConnectSock(self->zmq_ctx_, "inproc://inbox", ZMQ_PUSH,
-				hwm);
-	VLOG_IF(2, !sock_in_) << "Compressor (" << self << "):"
+	void* sock_in_ = self->sock_in_;
+	void* sock_out_ = self->sock_out_;
+	void* sock_ctl_ = self->sock_ctl_;
+	VLOG_IF(!sock_in_, 2) << "Compressor (" << self << "):"
 	                      <<_(" error with input socket.");
-	VLOG_IF(2, !sock_out_) << "Compressor (" << self << "):"
+	VLOG_IF(!sock_out_, 2) << "Compressor (" << self << "):"
 	                       <<_(" error with output socket.");
-	if (!sock_in_ || !sock_out_)
+	VLOG_IF(!sock_ctl_, 2) << "Compressor (" << self << "):"
+	                       <<_(" error with control socket.");
+	if (!sock_in_ || !sock_out_ || !sock_ctl_)
 	{
 		LOG(ERROR) << "Compressor (" << self << "):"
 		           << _(" error initializing communications.");
+		zmq_close(sock_in_);
+		zmq_close(sock_out_);
+		zmq_close(sock_ctl_);
 		return NULL;
 	}
+	// before any allocation, so the zstream and the buffers are on the
+	// local node
+	if (!pin_thread(self->cpus_))
+		LOG(WARNING) << "Compressor (" << self << "):"
+		             << _(" error setting CPU affinity.")
+		             << _(" Message: ") << strerror(errno);
 	z_stream zst;
 	zst.zalloc    = Z_NULL;
 	zst.zfree     = Z_NULL;
@@ -49,21 +237,55 @@ Compressor::Start(Compressor* self, int level)
 	zst.total_out = 0;
 	zst.next_in   = NULL;
 	zst.next_out  = NULL;
-	int rs = deflateInit2(&zst, level, Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, 0);
+	const bool zstd = self->cfg_.Format() == ZSTD_SEEKABLE;
+	const bool lz4 = self->cfg_.Format() == LZ4_SEEKABLE;
+	// zstd and lz4 levels are above zlib's, the zstream is not used then
+	int rs = deflateInit2(&zst, zstd || lz4 ? Z_DEFAULT_COMPRESSION : level,
+			Z_DEFLATED, -MAX_WBITS, DEF_MEM_LEVEL, 0);
 	if (rs != Z_OK)
 	{
 		LOG(ERROR) << "Compressor (" << self << "):"
 		           << _(" error initializing zstream.");
 		zmq_close(sock_in_);
 		zmq_close(sock_out_);
+		zmq_close(sock_ctl_);
 		return NULL;
 	}
+#ifdef CSIO_WITH_ISAL
+	const bool isal = self->cfg_.Backend() == CFBACKEND_ISAL;
+	isal_zstream izst;
+	if (isal)
+		self->initIsal(izst, level);
+#endif
+#ifdef CSIO_WITH_ZSTD
+	std::unique_ptr<ZSTD_CCtx, size_t(*)(ZSTD_CCtx*)> cctx(
+		zstd ? ZSTD_createCCtx() : NULL, ZSTD_freeCCtx);
+	if (zstd && !cctx)
+	{
+		LOG(ERROR) << "Compressor (" << self << "):"
+		           << _(" error initializing zstd context.");
+		deflateEnd(&zst);
+		zmq_close(sock_in_);
+		zmq_close(sock_out_);
+		zmq_close(sock_ctl_);
+		return NULL;
+	}
+#endif
+	int cur_level = level;
+	const size_t batch = self->cfg_.BatchSize();
+	self->buf_.reset(new uint8_t[batch*0xffff]);
+	self->lens_.reset(new uint16_t[batch]);
 	MSG_READY.Send(sock_out_);
-	zmq_pollitem_t event = {sock_in_, 0, ZMQ_POLLIN, 0};
+	// sleep until a chunk or a stop request arrives
+	zmq_pollitem_t events[2] = {
+		{sock_in_,  0, ZMQ_POLLIN, 0},
+		{sock_ctl_, 0, ZMQ_POLLIN, 0}
+	};
+	Clock::time_point wait_start = Clock::now();
 	while(!self->break_)
 	{
-		int rs = zmq_poll(&event, 1, TICK);
-		if (rs == 0)
+		int rs = zmq_poll(events, 2, -1);
+		if (rs == -1 && errno == EINTR)
 		{
 			continue;
 		}
@@ -74,14 +296,25 @@ Compressor::Start(Compressor* self, int level)
 			MSG_ERROR.Send(sock_out_);
 			break;
 		}
+		if (events[1].revents & ZMQ_POLLIN)
+		{
+			Message ctl(sock_ctl_);
+			VLOG(2) << "Compressor (" << self << "):"
+			        << _(" received stop request. Stopping.");
+			break;
+		}
+		if (!(events[0].revents & ZMQ_POLLIN))
+			continue;
 		Message msg(sock_in_);
+		Clock::time_point busy_start = Clock::now();
+		self->stats_.wait_ns += ns_since(wait_start);
 		if (msg == MSG_STOP)
 		{
 			VLOG(2) << "Compressor (" << self << "):"
 			        << _(" received MSG_STOP. Stopping.");
 			break;
 		}
-		if (msg.Type() != Message::TYPE_FCHUNK)
+		if (msg.Type() != Message::TYPE_FBATCH)
 		{
 			VLOG(2) << "Compressor (" << self << "):"
 			        << _(" received unexpected message type.")
@@ -89,60 +322,91 @@ Compressor::Start(Compressor* self, int level)
 			MSG_ERROR.Send(sock_out_);
 			break;
 		}
-		if (msg.DataSize() == 0 || msg.Data() == NULL)
+		const size_t count = msg.Count();
+		if (count == 0 || count > batch || msg.Data() == NULL)
 		{
 			VLOG(2) << "Compressor (" << self << "):"
-			        << _(" failed receiving file chunk.");
+			        << _(" failed receiving file chunks.");
 			MSG_ERROR.Send(sock_out_);
 			break;
 		}
-		zst.avail_in = msg.DataSize();
-		zst.avail_out = sizeof(self->buf_);
-		zst.next_in = (Bytef*)msg.Data();
-		zst.next_out = (Bytef*)self->buf_;
-		zst.total_in = 0;
-		zst.total_out = 0;
-		rs = deflate(&zst, Z_NO_FLUSH);
-		if (rs != Z_OK || zst.avail_in != 0)
+		// the manager may retune the level between batches (see
+		// LevelTuner), all chunks are flushed, so nothing is pending
+		if (msg.Level() != cur_level && !zstd && !lz4)
 		{
-			std::stringstream info;
-			if (zst.avail_in != 0)
-				info << strerror(errno);
-			else
-				info << _(" not all data was compressed");
-			LOG(ERROR) << "Compressor (" << self << "):"
-			           << _(" compression error.")
-			           << _(" Message: ") << info.str();
-			MSG_ERROR.Send(sock_out_);
-			break;
+			zst.next_out = self->buf_.get();
+			zst.avail_out = 0xffff;
+			if (msg.Level() > Z_BEST_COMPRESSION
+			 || deflateParams(&zst, msg.Level(), Z_DEFAULT_STRATEGY)
+			    != Z_OK)
+			{
+				LOG(ERROR) << "Compressor (" << self << "):"
+				           << _(" error changing level to ")
+				           << (int)msg.Level();
+				MSG_ERROR.Send(sock_out_);
+				break;
+			}
+#ifdef CSIO_WITH_ISAL
+			if (isal)
+				self->initIsal(izst, msg.Level());
+#endif
+			cur_level = msg.Level();
 		}
-		zst.avail_in = 0;
-		zst.avail_out = sizeof(self->buf_) - zst.total_out;
-		zst.next_in = NULL;
-		zst.next_out = (Bytef*)self->buf_ + zst.total_out;
-		rs = deflate(&zst, Z_FULL_FLUSH);
-		if (rs != Z_OK || zst.avail_in != 0)
+		else if (zstd || lz4)
 		{
-			std::stringstream info;
-			if (zst.avail_in != 0)
-				info << strerror(errno);
+			// the level is the argument of every frame compression
+#ifdef CSIO_WITH_LZ4
+			if (lz4 && (cur_level >= LZ4HC_CLEVEL_MIN)
+			        != (msg.Level() >= LZ4HC_CLEVEL_MIN))
+				self->lz4_state_.reset();
+#endif
+			cur_level = msg.Level();
+		}
+		// chunks of the batch are compressed back-to-back
+		const uint8_t* in = msg.Data();
+		size_t outsz = 0;
+		size_t i;
+		for (i = 0; i < count; ++i)
+		{
+			bool ok;
+#ifdef CSIO_WITH_LZ4
+			if (lz4)
+				ok = self->compressLz4(cur_level, in, msg.ChunkSize(i),
+				                       self->buf_.get() + outsz, 0xffff,
+				                       self->lens_[i]);
 			else
-				info << _(" not all data was compressed");
-			LOG(ERROR) << "Compressor (" << self << "):"
-			           << _(" compression error.")
-			           << _(" Message: ") << info.str();
-			MSG_ERROR.Send(sock_out_);
-			break;
+#endif
+#ifdef CSIO_WITH_ZSTD
+			if (zstd)
+				ok = self->compress(cctx.get(), cur_level, in,
+				                    msg.ChunkSize(i),
+				                    self->buf_.get() + outsz, 0xffff,
+				                    self->lens_[i]);
+			else
+#endif
+#ifdef CSIO_WITH_ISAL
+			if (isal)
+				ok = self->compress(izst, in, msg.ChunkSize(i),
+				                    self->buf_.get() + outsz, 0xffff,
+				                    self->lens_[i]);
+			else
+#endif
+				ok = self->compress(zst, in, msg.ChunkSize(i),
+				                    self->buf_.get() + outsz, 0xffff,
+				                    self->lens_[i]);
+			if (!ok)
+				break;
+			in += msg.ChunkSize(i);
+			outsz += self->lens_[i];
 		}
-		if (zst.total_out == 0)
+		if (i != count)
 		{
-			LOG(ERROR) << "Compressor (" << self << "):"
-			           << _(" compression error.")
-			           << _(" Wrong available out value ");
 			MSG_ERROR.Send(sock_out_);
 			break;
 		}
-		Message result((uint8_t*)self->buf_, zst.total_out, msg.Num());
+		Message result(self->buf_.get(), self->lens_.get(), count,
+		               msg.Num(), cur_level,
+		               u32le(ns_since(busy_start)/1000));
 		if (result.DataSize() == 0)
 		{
 			VLOG(2) << "Compressor (" << self << "):"
@@ -157,14 +421,21 @@ Compressor::Start(Compressor* self, int level)
 			MSG_ERROR.Send(sock_out_);
 			break;
 		}
+		self->stats_.items += count;
+		self->stats_.bytes += outsz;
+		wait_start = Clock::now();
+		self->stats_.busy_ns += std::chrono::duration_cast<
+			std::chrono::nanoseconds>(wait_start - busy_start).count();
 	}
 	if (self->break_)
 		VLOG(2) << "Compressor (" << self << "): breaked.";
 	rs = deflateEnd(&zst);
-	VLOG_IF(2, rs != Z_DATA_ERROR && rs != Z_OK)
+	VLOG_IF(rs != Z_DATA_ERROR && rs != Z_OK, 2)
 		<< _("compressor cleaning error.") << _(" Code:") << rs;
 	zmq_close(sock_in_);
 	zmq_close(sock_out_);
+	zmq_close(sock_ctl_);
+	return NULL;
 }
 
 } // namespace
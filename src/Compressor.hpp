@@ -5,31 +5,63 @@
 #define __COMPRESSOR_HPP__
 
 #include "Config.hpp"
+#include "Telemetry.hpp"
 #include <csio.h>
+#include <zlib.h>
+#ifdef CSIO_WITH_ISAL
+#	include <isa-l/igzip_lib.h>
+#endif
+#ifdef CSIO_WITH_ZSTD
+#	include <zstd.h>
+#endif
+#ifdef CSIO_WITH_LZ4
+#	include <lz4hc.h>
+#endif
+#include <memory>
+#include <vector>
 
 namespace csio {
 
 class Compressor
 {
 public:
-	Compressor(void* zmq_ctx, Config& cfg)
-		: zmq_ctx_(zmq_ctx)
-		, break_(false)
-		, cfg_(cfg)
-	{
-	}
+	Compressor(void* zmq_ctx, Config& cfg, size_t id = 0);
 
 	static void* Start(Compressor* self, int level);
 	void Break() { break_ = true; }
+	const StageStats& Stats() const { return stats_; }
 private:
-	int compress(char* data, size_t datasz);
+	bool compress(z_stream& zst, const uint8_t* data, size_t datasz,
+	              uint8_t* out, size_t outsz, uint16_t& produced);
+#ifdef CSIO_WITH_ISAL
+	void initIsal(isal_zstream& zst, int level);
+	bool compress(isal_zstream& zst, const uint8_t* data, size_t datasz,
+	              uint8_t* out, size_t outsz, uint16_t& produced);
+	std::unique_ptr<uint8_t[]> isal_lvlbuf_;
+#endif
+#ifdef CSIO_WITH_ZSTD
+	bool compress(ZSTD_CCtx* cctx, int level, const uint8_t* data,
+	              size_t datasz, uint8_t* out, size_t outsz,
+	              uint16_t& produced);
+#endif
+#ifdef CSIO_WITH_LZ4
+	bool compressLz4(int level, const uint8_t* data, size_t datasz,
+	                 uint8_t* out, size_t outsz, uint16_t& produced);
+	std::unique_ptr<char[]> lz4_state_;
+#endif
 	Compressor() = delete;
 	Compressor& operator=(const Compressor&) = delete;
 	Compressor(const Compressor&) = delete;
 	void* zmq_ctx_;
+	void* sock_in_;
+	void* sock_out_;
+	void* sock_ctl_;
 	bool  break_;
 	Config cfg_;
-	char buf_[CHUNK_SIZE*2];
+	StageStats stats_;
+	std::vector<int> cpus_;            //!< affinity (empty - any)
+	std::unique_ptr<uint8_t[]>  buf_;  //!< compressed batch
+	std::unique_ptr<uint16_t[]> lens_; //!< compressed chunks lengths
 };
 
 } // namespace
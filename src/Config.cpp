@@ -9,6 +9,7 @@
 #include <iomanip>
 #include <sstream>
 #include <csio.h>
+#include "Affinity.hpp"
 
 namespace csio {
 
@@ -21,8 +22,41 @@ Config::SetDefaults()
 {
 	force_ = false;
 	verbose_ = false;
+	stats_ = false;
 	compressors_count_ = 2;
 	compression_level_ = 9;
+	batch_size_ = 16;
+	target_mbps_ = 0;
+	format_ = DICTZIP;
+	backend_ = CFBACKEND_ZLIB;
+	cpus_.clear();
+	writer_cpus_.clear();
+	writer_cpus_auto_ = false;
+	line_index_ = false;
+	trailer_index_ = false;
+	bloom_size_ = 0;
+}
+
+inline const char*
+format_name(CompressionMethod format)
+{
+	switch (format)
+	{
+		case ZSTD_SEEKABLE: return "zstd";
+		case LZ4_SEEKABLE:  return "lz4";
+		default:            return "dictzip";
+	}
+}
+
+inline const char*
+format_suffix(CompressionMethod format)
+{
+	switch (format)
+	{
+		case ZSTD_SEEKABLE: return ".zst";
+		case LZ4_SEEKABLE:  return ".lz4";
+		default:            return ".dz";
+	}
 }
 
 inline std::string
@@ -48,17 +82,29 @@ expand_path(const std::string path)
 int
 Config::ParseArgs(int argc, char* argv[])
 {
-	std::string opt_v, opt_j, opt_o, opt_f, opt_h, opt_l;
-	bool verbose = false, force = false;
+	std::string opt_v, opt_j, opt_o, opt_f, opt_h, opt_l, opt_b,
+	            opt_c, opt_w, opt_z, opt_t, opt_F, opt_B;
+	bool verbose = false, force = false, stats = false, line_index = false,
+	     trailer_index = false;
 
-	const char *sopts = "vj:l:o:fh";
+	const char *sopts = "vj:l:o:b:c:w:z:t:F:B:fsnTh";
 
 	const struct option lopts[] = {
 		{ "verbose", no_argument, NULL, 'v' },
 		{ "threads", required_argument, NULL, 'j' },
 		{ "level", required_argument, NULL, 'l' },
 		{ "output", required_argument, NULL, 'o' },
+		{ "batch", required_argument, NULL, 'b' },
+		{ "cpus", required_argument, NULL, 'c' },
+		{ "writer-cpus", required_argument, NULL, 'w' },
+		{ "backend", required_argument, NULL, 'z' },
+		{ "target-mbps", required_argument, NULL, 't' },
+		{ "format", required_argument, NULL, 'F' },
 		{ "force", no_argument, NULL, 'f' },
+		{ "stats", no_argument, NULL, 's' },
+		{ "line-index", no_argument, NULL, 'n' },
+		{ "bloom", required_argument, NULL, 'B' },
+		{ "trailer-index", no_argument, NULL, 'T' },
 
 		{ "help", no_argument, NULL, 'h' },
 		{ NULL, no_argument, NULL, '\0'}
@@ -74,29 +120,155 @@ Config::ParseArgs(int argc, char* argv[])
 			case 'j': opt_j = optarg; break;
 			case 'l': opt_l = optarg; break;
 			case 'o': opt_o = optarg; break;
+			case 'b': opt_b = optarg; break;
+			case 'c': opt_c = optarg; break;
+			case 'w': opt_w = optarg; break;
+			case 'z': opt_z = optarg; break;
+			case 't': opt_t = optarg; break;
+			case 'F': opt_F = optarg; break;
+			case 'B': opt_B = optarg; break;
 			case 'f': force = true; break;
+			case 's': stats = true; break;
+			case 'n': line_index = true; break;
+			case 'T': trailer_index = true; break;
 			case 'h': PrintHelp(); return 0;
 			case  -1: return -1;
 			case '?': return -1;
 		}
 		opt = getopt_long( argc, argv, sopts, lopts, &i );
 	}
-	VLOG_IF(2, !opt_j.empty() && atoi(opt_j.c_str()) > 256)
+	VLOG_IF(!opt_j.empty() && atoi(opt_j.c_str()) > 256, 2)
 		<< _("Config: Too many threads requested. Resetting to 256.");
 	if (!opt_j.empty()) compressors_count_ = 
 		atoi(opt_j.c_str()) < 256 ? atoi(opt_j.c_str()) : 256;
-	VLOG_IF(2, !opt_l.empty() && atoi(opt_l.c_str()) > 9)
-		<< _("Config: Compression level is too big. Resetting to 9.");
+	if (opt_F == "zstd")
+	{
+#ifdef CSIO_WITH_ZSTD
+		format_ = ZSTD_SEEKABLE;
+#else
+		LOG(ERROR) << _("Config: zstd format is not supported (build"
+		                " WITH_ZSTD)");
+		return -1;
+#endif
+	}
+	else if (opt_F == "lz4")
+	{
+#ifdef CSIO_WITH_LZ4
+		format_ = LZ4_SEEKABLE;
+#else
+		LOG(ERROR) << _("Config: lz4 format is not supported (build"
+		                " WITH_LZ4)");
+		return -1;
+#endif
+	}
+	else if (!opt_F.empty() && opt_F != "dictzip")
+	{
+		LOG(ERROR) << _("Config: Unsupported format: ") << opt_F;
+		return -1;
+	}
+	const int max_level = format_ == ZSTD_SEEKABLE ? 19
+	                    : (format_ == LZ4_SEEKABLE ? 12 : 9);
+	VLOG_IF(!opt_l.empty() && atoi(opt_l.c_str()) > max_level, 2)
+		<< _("Config: Compression level is too big. Resetting to ")
+		<< max_level;
 	if (!opt_l.empty()) compression_level_ = 
-		atoi(opt_l.c_str()) < 9 ? atoi(opt_l.c_str()) : 9;
+		atoi(opt_l.c_str()) < max_level ? atoi(opt_l.c_str()) : max_level;
+	if (!opt_b.empty())
+	{
+		int batch = atoi(opt_b.c_str());
+		batch_size_ = batch < 1 ? 1 : (batch > 1024 ? 1024 : batch);
+	}
+	if (!opt_t.empty())
+	{
+		target_mbps_ = atof(opt_t.c_str());
+		if (target_mbps_ <= 0)
+		{
+			LOG(ERROR) << _("Config: Wrong throughput target: ") << opt_t;
+			return -1;
+		}
+		// the tuner models zlib levels 1..9 speeds
+		if (format_ != DICTZIP)
+		{
+			LOG(ERROR) << _("Config: Throughput target is supported only by"
+			                " the dictzip format");
+			return -1;
+		}
+	}
+	if (!opt_z.empty())
+	{
+		// libdeflate can't finish a chunk without the final block, so
+		// its output can't be a dictzip chunk
+		if (cfbackend_parse(opt_z.c_str(), &backend_) != 0
+		 || backend_ == CFBACKEND_LIBDEFLATE
+		 || !cfbackend_available(backend_))
+		{
+			LOG(ERROR) << _("Config: Unsupported compression backend: ")
+			           << opt_z;
+			return -1;
+		}
+	}
+	if (!opt_c.empty() && !parse_cpu_list(opt_c, cpus_))
+	{
+		LOG(ERROR) << _("Config: Wrong CPU list: ") << opt_c;
+		return -1;
+	}
+	if (opt_w == "auto")
+	{
+		writer_cpus_auto_ = true;
+	}
+	else if (!opt_w.empty() && !parse_cpu_list(opt_w, writer_cpus_))
+	{
+		LOG(ERROR) << _("Config: Wrong writer CPU list: ") << opt_w;
+		return -1;
+	}
 	if (!opt_o.empty()) ofname_ = opt_o;
 	if (verbose) verbose_ = true;
 	if (force) force_ = true;
+	if (stats) stats_ = true;
+	if (line_index)
+	{
+		// zstd and lz4 have no room for it, csio counts lines of them on
+		// the first cfseekline
+		if (format_ != DICTZIP)
+		{
+			LOG(ERROR) << _("Config: Line index is supported only by the"
+			                " dictzip format");
+			return -1;
+		}
+		line_index_ = true;
+	}
+	if (!opt_B.empty())
+	{
+		size_t sz = atoi(opt_B.c_str());
+		if (sz < CFBLOOM_MIN_SIZE || sz > CFBLOOM_MAX_SIZE
+		 || (sz & (sz - 1)) != 0)
+		{
+			LOG(ERROR) << _("Config: Wrong bloom filter size: ") << opt_B;
+			return -1;
+		}
+		if (format_ != DICTZIP)
+		{
+			LOG(ERROR) << _("Config: Bloom filters are supported only by"
+			                " the dictzip format");
+			return -1;
+		}
+		bloom_size_ = sz;
+	}
+	if (trailer_index)
+	{
+		if (format_ != DICTZIP)
+		{
+			LOG(ERROR) << _("Config: Trailer index is supported only by the"
+			                " dictzip format");
+			return -1;
+		}
+		trailer_index_ = true;
+	}
 
 	if (optind < argc)
 		ifname_ = expand_path(argv[optind++]);
 	if (ofname_.empty())
-		ofname_ = ifname_ + ".dz";
+		ofname_ = ifname_ + format_suffix(format_);
 	return 1;
 }
 
@@ -110,6 +282,15 @@ append_opt(std::stringstream& ss, std::string varname, T val, bool endl = true)
 	return ss;
 }
 
+inline std::string
+cpus_str(const std::vector<int>& cpus)
+{
+	std::stringstream ss;
+	for (size_t i = 0; i < cpus.size(); ++i)
+		ss << (i ? "," : "") << cpus[i];
+	return ss.str();
+}
+
 inline std::vector<std::string>
 split(std::string str, size_t len)
 {
@@ -174,6 +355,17 @@ Config::GetOptions() const
 	append_opt(ss, "Verbose", verbose_);
 	append_opt(ss, "Threads", CompressorsCount());
 	append_opt(ss, "Level"  , CompressionLevel());
+	append_opt(ss, "Batch"  , BatchSize());
+	append_opt(ss, "Target MiB/s", target_mbps_);
+	append_opt(ss, "Format" , format_name(format_));
+	append_opt(ss, "Backend", cfbackend_name(backend_));
+	append_opt(ss, "CPUs"   , cpus_str(cpus_));
+	append_opt(ss, "Writer CPUs", writer_cpus_auto_ ? std::string("auto")
+	                                : cpus_str(writer_cpus_));
+	append_opt(ss, "Stats"  , stats_);
+	append_opt(ss, "Line index", line_index_);
+	append_opt(ss, "Bloom"  , bloom_size_);
+	append_opt(ss, "Trailer index", trailer_index_);
 	append_opt(ss, "Force"  , force_, false);
 	return ss.str();
 }
@@ -200,8 +392,39 @@ Config::PrintHelp() const
 		"compressors count (tip: use number of CPU cores)");
 	append_hlp(ss, "l", "level", CompressionLevel(), 
 		"compression level (tip: it is fast enough for 9 here)");
+	append_hlp(ss, "b", "batch", BatchSize(),
+		"chunks per compressor job (1..1024)");
+	append_hlp(ss, "t", "target-mbps", "",
+		"input throughput target in MiB/s, the level (up to --level) is "
+		"tuned to meet it (dictzip only)");
+	append_hlp(ss, "F", "format", "dictzip",
+		"output format: dictzip, zstd (seekable zstd, one frame per "
+		"chunk, levels 1..19, if built WITH_ZSTD) or lz4 (frame with "
+		"a block per chunk, levels 1..2 - fast, 3..12 - HC, if built "
+		"WITH_LZ4)");
+	append_hlp(ss, "z", "backend", cfbackend_name(Backend()),
+		"deflate implementation: zlib or isal (if built WITH_ISAL)");
+	append_hlp(ss, "c", "cpus", "",
+		"pin compressors to the CPUs (list like 0-7,16), i-th compressor "
+		"gets i-th CPU of the list, buffers are allocated on its node");
+	append_hlp(ss, "w", "writer-cpus", "",
+		"pin the writer to the CPUs (list or \"auto\" - CPUs of the "
+		"output device's NUMA node)");
 	append_hlp(ss, "f", "force", Force(), 
 		"ignore all warnings (rewrite output on exists)");
+	append_hlp(ss, "s", "stats", Stats(),
+		"report progress every second and pipeline summary at the end");
+	append_hlp(ss, "n", "line-index", LineIndex(),
+		"store newline counts of chunks in a trailer member for "
+		"cfseekline (dictzip only)");
+	append_hlp(ss, "B", "bloom", "",
+		"store bloom filters of 4-byte n-grams of chunks of this size in "
+		"bytes (power of 2, 64..8192) in trailer members for "
+		"cfchunk_may_contain (dictzip only)");
+	append_hlp(ss, "T", "trailer-index", TrailerIndex(),
+		"write members strictly sequentially (to a pipe or appending) "
+		"and store the chunk index in trailer members at the end "
+		"(dictzip only)");
 	append_hlp(ss, "h", "help", "", "print this message");
 	std::cout << std::boolalpha << ss.str() << std::endl;
 }
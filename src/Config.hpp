@@ -5,6 +5,9 @@
 #define __CONFIG_HPP__
 
 #include <string>
+#include <vector>
+#include <stdint.h>
+#include <csio.h>
 
 namespace csio {
 
@@ -25,19 +28,53 @@ public:
 
 	bool        Force()            const { return force_; }
 	bool        Verbose()          const { return verbose_; }
+	bool        Stats()            const { return stats_; }
 	std::string IFName()           const { return ifname_; }
 	std::string OFName()           const { return ofname_; }
 	int         CompressionLevel() const { return compression_level_; }
 	int         CompressorsCount() const { return compressors_count_; }
 	int         MsgHWM()           const { return compressors_count_*2 + 5;}
+	int         BatchSize()        const { return batch_size_; }
+	/**@brief Input throughput target in MiB/s (0 - fixed level)*/
+	double      TargetMbps()       const { return target_mbps_; }
+	int64_t     MsgMaxSize()       const
+		{ return (int64_t)batch_size_*(2 + CHUNK_SIZE + 64) + 16; }
+	/**@brief Output format (DICTZIP, ZSTD_SEEKABLE or LZ4_SEEKABLE)*/
+	CompressionMethod Format()     const { return format_; }
+	/**@brief Deflate implementation (zlib or isal)*/
+	CFBackend   Backend()          const { return backend_; }
+	/**@brief CPUs to pin compressors to (i-th on cpus[i % size])*/
+	const std::vector<int>& CompressorsCpus() const { return cpus_; }
+	/**@brief CPUs to pin the writer to (empty - don't pin)*/
+	const std::vector<int>& WriterCpus()      const { return writer_cpus_; }
+	/**@brief pin the writer to the output device's NUMA node*/
+	bool        WriterCpusAuto()   const { return writer_cpus_auto_; }
+	/**@brief write the line index trailer (see cfseekline)*/
+	bool        LineIndex()        const { return line_index_; }
+	/**@brief chunk filter size in bytes (0 - no filters, see
+	 * cfchunk_may_contain)*/
+	size_t      BloomSize()        const { return bloom_size_; }
+	/**@brief write the chunk index at the end instead of member headers*/
+	bool        TrailerIndex()     const { return trailer_index_; }
 
 private:
 	bool        force_;
 	bool        verbose_;
+	bool        stats_;
 	std::string ifname_;
 	std::string ofname_;
 	int         compression_level_;
 	int         compressors_count_;
+	int         batch_size_;
+	double      target_mbps_;
+	CompressionMethod format_;
+	CFBackend   backend_;
+	std::vector<int> cpus_;
+	std::vector<int> writer_cpus_;
+	bool        writer_cpus_auto_;
+	bool        line_index_;
+	size_t      bloom_size_;
+	bool        trailer_index_;
 };
 
 } // namespace
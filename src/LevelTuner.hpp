@@ -0,0 +1,105 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 19:35:47 */
+
+#ifndef __LEVEL_TUNER_HPP__
+#define __LEVEL_TUNER_HPP__
+
+#include <stdint.h>
+
+namespace csio {
+
+/**@brief Chooses compression level to keep the throughput target
+ *
+ * Compressors report compression time of every batch. The tuner keeps
+ * moving average of the speed (bytes per second of one compressor) for
+ * every level and expects compressors*speed throughput from the level.
+ * Speed of a level without measurements is estimated from the nearest
+ * measured one with typical zlib speed ratios, such estimate must meet
+ * the target with some headroom. The highest level meeting the target
+ * is used, so the tuner jumps to the right level after the first
+ * measurement and then refines.*/
+class LevelTuner
+{
+public:
+	LevelTuner(double target_bps, int workers, int max_level)
+		: target_(target_bps)
+		, workers_(workers > 0 ? workers : 1)
+		, max_(max_level < MIN_LEVEL ? MIN_LEVEL
+		     : (max_level >= LEVELS ? LEVELS - 1 : max_level))
+		, level_(max_)
+	{
+		for (int i = 0; i < LEVELS; ++i)
+			speed_[i] = 0;
+	}
+
+	/**@brief Account compression of bytes with the level in ns*/
+	void Account(int level, uint64_t bytes, uint64_t ns)
+	{
+		if (level < 0 || level >= LEVELS || bytes == 0)
+			return;
+		double speed = bytes*1e9/(ns ? ns : 1);
+		speed_[level] = speed_[level] > 0
+			? speed_[level]*(1 - ALPHA) + speed*ALPHA
+			: speed;
+		choose();
+	}
+
+	int    Level() const { return level_; }
+
+	/**@brief Expected throughput of the level in bytes per second
+	 * (0 - nothing is measured yet)*/
+	double Expected(int level) const
+	{
+		if (speed_[level] > 0)
+			return speed_[level]*workers_;
+		for (int d = 1; d < LEVELS; ++d)
+		{
+			int near[2] = {level - d, level + d};
+			for (int i = 0; i < 2; ++i)
+			{
+				if (near[i] >= 0 && near[i] < LEVELS && speed_[near[i]] > 0)
+					return speed_[near[i]]*workers_
+						*relSpeed(level)/relSpeed(near[i]);
+			}
+		}
+		return 0;
+	}
+
+private:
+	/**@brief deflate speed relative to level 9 (text data)*/
+	static double relSpeed(int level)
+	{
+		static const double REL_SPEED[LEVELS] =
+			{8.0, 4.0, 3.7, 3.2, 2.6, 2.0, 1.6, 1.4, 1.1, 1.0};
+		return REL_SPEED[level];
+	}
+
+	void choose()
+	{
+		for (int l = max_; l > MIN_LEVEL; --l)
+		{
+			double want = speed_[l] > 0 ? target_ : target_*HEADROOM;
+			if (Expected(l) >= want)
+			{
+				level_ = l;
+				return;
+			}
+		}
+		level_ = MIN_LEVEL;
+	}
+
+	static const int LEVELS    = 10;
+	static const int MIN_LEVEL = 1;
+	static constexpr double ALPHA    = 0.3;
+	static constexpr double HEADROOM = 1.2;
+
+	double target_;
+	int    workers_;
+	int    max_;
+	int    level_;
+	double speed_[LEVELS];
+};
+
+} // namespace
+
+#endif // __LEVEL_TUNER_HPP__
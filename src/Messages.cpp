@@ -38,6 +38,42 @@ Message::Message(const uint8_t* data, size_t sz, u16le num)
 	assert(pos == data_.get() + datasz_);
 }
 
+/**@fun Message::Message(const uint8_t*, const uint16_t*, u16le, u16le,
+ *                        uint8_t, u32le)
+ * @brief TYPE_FBATCH ctor
+ *
+ * Contiguous chunks of one member, starting with the chunk num.
+ *
+ * 	+---+---+---+---+---+---+---+---+---+---+=================+======+
+ * 	|TYP|  NUM  | COUNT |LVL|     USEC      | COUNT 2-byte    | DATA |
+ * 	|   |       |       |   |               | chunks lengths  |      |
+ * 	+---+---+---+---+---+---+---+---+---+---+=================+======+
+ *
+ * LVL  - compression level to use (request) or used (result)
+ * USEC - compression time (result only)
+ * */
+const size_t Message::FBATCH_HEADER_SIZE = 1 + 2 + 2 + 1 + 4;
+Message::Message(const uint8_t* data, const uint16_t* lens, u16le count,
+                 u16le num, uint8_t level, u32le usec)
+{
+	size_t sz = 0;
+	for (size_t i = 0; i < count; ++i)
+		sz += lens[i];
+	datasz_ = FBATCH_HEADER_SIZE + count*2 + sz;
+	data_.reset(new uint8_t[datasz_]);
+	uint8_t* pos = data_.get();
+
+	add_to_buf(pos, TYPE_FBATCH);
+	add_to_buf(pos, num);
+	add_to_buf(pos, count);
+	add_to_buf(pos, level);
+	add_to_buf(pos, usec);
+	for (size_t i = 0; i < count; ++i)
+		add_to_buf(pos, u16le(lens[i]));
+	add_to_buf(pos, data, sz);
+	assert(pos == data_.get() + datasz_);
+}
+
 /**@fun Message::Message(const std::string&)
  * @brief TYPE_INFO ctor*/
 Message::Message(const std::string& msg)
@@ -172,7 +208,7 @@ Message::Send(void* sock, SendMode blocking) const
 	int rs = zmq_msg_send(&msg, sock, blocking ? 0 : ZMQ_DONTWAIT);
 	if (rs == -1)
 	{
-		VLOG_IF(2, errno != EAGAIN && errno != EWOULDBLOCK)
+		VLOG_IF(errno != EAGAIN && errno != EWOULDBLOCK, 2)
 			<< _("Message: error message sending.")
 			<< _(" Message: ") << zmq_strerror(errno);
 		return false;
@@ -201,7 +237,7 @@ Message::Fetch(void* zmq_sock, SendMode blocking)
 	}
 	if (zmq_msg_recv(&msg, zmq_sock, blocking ? 0 : ZMQ_DONTWAIT) == -1)
 	{
-		VLOG_IF(2, errno != EAGAIN)
+		VLOG_IF(errno != EAGAIN, 2)
 			<< _("Message: error receiving data "
 			     "in message initialization.")
 			<< _(" Message: ") << zmq_strerror(errno);
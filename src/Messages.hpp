@@ -24,6 +24,7 @@ public:
 		TYPE_FCHUNK  = 2,
 		TYPE_MCLOSE  = 3,
 		TYPE_MHEADER = 4,
+		TYPE_FBATCH  = 5,
 		TYPE_UNKNOWN = 0
 	};
 
@@ -38,6 +39,8 @@ public:
 	Message() : datasz_(0) { }
 	Message(void* sock, SendMode mode = BLOCKING_MODE);
 	Message(const uint8_t* data, size_t datasz, u16le num);
+	Message(const uint8_t* data, const uint16_t* lens, u16le count,
+	        u16le num, uint8_t level = 0, u32le usec = 0);
 	Message(const std::string& msg);
 	Message(u32le fsize, u32le crc);
 	Message(u16le       chunks_count,
@@ -55,6 +58,10 @@ public:
 	uint8_t*    Data() const;
 	size_t      DataSize() const;
 	uint16_t    Num() const;
+	uint16_t    Count() const;
+	uint16_t    ChunkSize(uint16_t i) const;
+	uint8_t     Level() const;
+	uint32_t    Usec() const;
 	std::string What() const;
 
 	bool     operator==(const Message& rhv) const;
@@ -62,12 +69,14 @@ public:
 	Message& operator=(const Message& copy);
 
 protected:
+	size_t                     headerSize() const;
 	size_t                     datasz_;
 	std::unique_ptr<uint8_t[]> data_;
 
 	static uint8_t             FLG;
 	static uint8_t             XFL;
 	static const uint8_t       OS;
+	static const size_t        FBATCH_HEADER_SIZE;
 	static const size_t        GZIP_HEADER_SIZE;
 	static const u16le         RA_EXT_HEADER_SIZE;
 };
@@ -94,18 +103,76 @@ Message::Type() const
 	return data_ && datasz_ > 0 ? (Message::MessageType)data_[0] : TYPE_UNKNOWN;
 };
 
+inline size_t
+Message::headerSize() const
+{
+	if (Type() == TYPE_FBATCH)
+		return FBATCH_HEADER_SIZE + 2*Count();
+	return 1 + 2;
+}
+
 inline uint8_t*
 Message::Data() const
 {
-	return data_ && datasz_ > 3 ? data_.get() + 1 + 2: NULL;
+	return data_ && datasz_ > headerSize() ? data_.get() + headerSize()
+	                                       : NULL;
 }
 
 inline size_t
 Message::DataSize() const
 {
-	if (datasz_ < 1 + 2)
+	if (datasz_ < headerSize())
+		return 0;
+	return datasz_ - headerSize();
+}
+
+/**@brief Chunks count (1 for TYPE_FCHUNK)*/
+inline uint16_t
+Message::Count() const
+{
+	if (Type() == TYPE_FCHUNK)
+		return 1;
+	if (Type() != TYPE_FBATCH || datasz_ < FBATCH_HEADER_SIZE)
+		return 0;
+	u16le count = 0;
+	count.bytes[0] = data_[3];
+	count.bytes[1] = data_[4];
+	return std::min<size_t>(count, (datasz_ - FBATCH_HEADER_SIZE)/2);
+}
+
+/**@brief Compression level of TYPE_FBATCH (requested or used)*/
+inline uint8_t
+Message::Level() const
+{
+	if (Type() != TYPE_FBATCH || datasz_ < FBATCH_HEADER_SIZE)
+		return 0;
+	return data_[5];
+}
+
+/**@brief Compression time of TYPE_FBATCH in microseconds (0 in the
+ * requests)*/
+inline uint32_t
+Message::Usec() const
+{
+	if (Type() != TYPE_FBATCH || datasz_ < FBATCH_HEADER_SIZE)
+		return 0;
+	u32le usec = 0;
+	std::copy(data_.get() + 6, data_.get() + 10, usec.bytes);
+	return usec;
+}
+
+/**@brief Size of the i-th chunk of the data*/
+inline uint16_t
+Message::ChunkSize(uint16_t i) const
+{
+	if (Type() == TYPE_FCHUNK && i == 0)
+		return DataSize();
+	if (i >= Count())
 		return 0;
-	return datasz_ - 1 - 2;
+	u16le sz = 0;
+	sz.bytes[0] = data_[FBATCH_HEADER_SIZE + 2*i];
+	sz.bytes[1] = data_[FBATCH_HEADER_SIZE + 2*i + 1];
+	return sz;
 }
 
 inline uint16_t
@@ -157,6 +224,7 @@ Message::operator=(const Message& copy)
 	datasz_ = copy.datasz_;
 	data_.reset(new uint8_t[datasz_]);
 	memcpy(data_.get(), copy.data_.get(), datasz_);
+	return *this;
 }
 
 } // namespace
@@ -5,14 +5,25 @@
 #include <sstream>
 #include <iostream>
 #include <sys/signalfd.h>
-#include <sys/select.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include "logging.hpp"
 
 namespace csio {
 
 ProcessManagerBase::ProcessManagerBase()
 	: state_(STATE_NULL)
+	, wakefd_(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
 {
+	LOG_IF(wakefd_ == -1, ERROR)
+		<< _("ProcessManager: error creating eventfd.")
+		<< _(" Message: ") << strerror(errno);
+}
+
+ProcessManagerBase::~ProcessManagerBase()
+{
+	if (wakefd_ != -1)
+		close(wakefd_);
 }
 
 void
@@ -58,9 +69,11 @@ void ProcessManagerBase::loop()
 {
 	int sfd = 0;
 	struct signalfd_siginfo fdsi;
-	sfd = signalfd(-1, &sigset_, SFD_NONBLOCK);
-	if (sfd == -1)
+	sfd = signalfd(-1, &sigset_, SFD_NONBLOCK | SFD_CLOEXEC);
+	if (sfd == -1 || wakefd_ == -1)
 	{
+		if (sfd != -1)
+			close(sfd);
 		LOG(ERROR)<<_("ProcessManager: error registering process."
 		              " Can't get signalfd.");
 		return;
@@ -72,16 +85,14 @@ void ProcessManagerBase::loop()
 			if (state_ == STATE_NULL)
 				break;
 		}
-		struct timeval tv;
-		tv.tv_sec = 0;
-		tv.tv_usec = 10000;
-		
-		fd_set rfds;
-		FD_ZERO(&rfds);
-		FD_SET(sfd, &rfds);
-
-		int rs = select(sfd+1, &rfds, NULL, NULL, &tv);
-		
+		// sleep until a signal or Stop()
+		struct pollfd fds[2] = {
+			{sfd,     POLLIN, 0},
+			{wakefd_, POLLIN, 0}
+		};
+		int rs = poll(fds, 2, -1);
+		if (rs == -1 && errno == EINTR)
+			continue;
 		if (rs == -1)
 		{
 			LOG(ERROR) << _("ProcessManager: error signals wait.")
@@ -89,10 +100,14 @@ void ProcessManagerBase::loop()
 			Stop();
 			break;
 		}
-		else if(rs == 0)
+		if (fds[1].revents & POLLIN)
 		{
+			eventfd_t val;
+			eventfd_read(wakefd_, &val);
 			continue;
 		}
+		if (!(fds[0].revents & POLLIN))
+			continue;
 		ssize_t s = read(sfd, &fdsi, sizeof(struct signalfd_siginfo));
 		if (s != sizeof(struct signalfd_siginfo))
 		{
@@ -113,6 +128,7 @@ void ProcessManagerBase::loop()
 			break;
 		}
 	}
+	close(sfd);
 	VLOG(2) << _("ProcessManager: cleaning.");
 	if(!doStop())
 		LOG(ERROR) << _("ProcessManager: cleaning process failed.");
@@ -148,6 +164,8 @@ ProcessManagerBase::Stop()
 		return;
 	if(state_ == STATE_RUNNING)
 		state_ = STATE_NULL;
+	if (wakefd_ != -1)
+		eventfd_write(wakefd_, 1);
 	VLOG(2) << _("ProcessManager: stopping.");
 }
 
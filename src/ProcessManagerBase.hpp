@@ -28,7 +28,7 @@ public:
 		STATE_RUNNING   = 2,
 	};
 	ProcessManagerBase();
-	virtual ~ProcessManagerBase() {};
+	virtual ~ProcessManagerBase();
 	void            Dispatch();
 	void            Loop();
 	void            Stop();
@@ -43,6 +43,7 @@ private:
 	State           state_;
 	std::mutex      state_mtx_;
 	sigset_t        sigset_;
+	int             wakefd_; //!< eventfd, Stop() wakes up loop() with it
 	std::thread*    thread_;
 };
 
@@ -0,0 +1,56 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 16:20:04 */
+
+#ifndef __TELEMETRY_HPP__
+#define __TELEMETRY_HPP__
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace csio {
+
+typedef std::chrono::steady_clock Clock;
+
+inline uint64_t
+ns_since(const Clock::time_point& since)
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		Clock::now() - since).count();
+}
+
+/**@brief Counters of one pipeline stage (reader, compressor, writer)
+ *
+ * Written by the stage thread, read by the manager for the reports.*/
+struct StageStats
+{
+	StageStats() : busy_ns(0), wait_ns(0), items(0), bytes(0), stalls(0) {}
+	std::atomic<uint64_t> busy_ns; //!< time doing the work
+	std::atomic<uint64_t> wait_ns; //!< time waiting for the input
+	std::atomic<uint64_t> items;   //!< processed messages
+	std::atomic<uint64_t> bytes;   //!< produced bytes
+	std::atomic<uint64_t> stalls;  //!< times blocked by the next stage
+};
+
+/**@brief Plain copy of StageStats, used to calculate deltas*/
+struct StageSnapshot
+{
+	StageSnapshot() : busy_ns(0), wait_ns(0), items(0), bytes(0), stalls(0) {}
+	StageSnapshot(const StageStats& st)
+		: busy_ns(st.busy_ns.load())
+		, wait_ns(st.wait_ns.load())
+		, items(st.items.load())
+		, bytes(st.bytes.load())
+		, stalls(st.stalls.load())
+	{
+	}
+	uint64_t busy_ns;
+	uint64_t wait_ns;
+	uint64_t items;
+	uint64_t bytes;
+	uint64_t stalls;
+};
+
+} // namespace
+
+#endif // __TELEMETRY_HPP__
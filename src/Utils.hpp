@@ -12,7 +12,8 @@
 namespace csio {
 
 inline void*
-createSock(void* ctx, int type, int hwm = 50)
+createSock(void* ctx, int type, int hwm = 50,
+           int64_t msgsz = CHUNK_SIZE + 10)
 {
 	void* sock = zmq_socket(ctx, type);
 	if (!sock)
@@ -22,7 +23,6 @@ createSock(void* ctx, int type, int hwm = 50)
 		return NULL;
 	}
 	const int zero = 0;
-	const int64_t msgsz = CHUNK_SIZE + 10;
 	if (zmq_setsockopt(sock, ZMQ_MAXMSGSIZE, &msgsz, sizeof(msgsz)) == -1)
 	{
 		VLOG(2) << _("Error setting MAXMSGSIZE on socket.")
@@ -51,9 +51,10 @@ createSock(void* ctx, int type, int hwm = 50)
 }
 
 inline void*
-createBindSock(void* ctx, std::string path, int type, int hwm = 50)
+createBindSock(void* ctx, std::string path, int type, int hwm = 50,
+               int64_t msgsz = CHUNK_SIZE + 10)
 {
-	void* sock = createSock(ctx, type, hwm);
+	void* sock = createSock(ctx, type, hwm, msgsz);
 	if (!sock)
 		return NULL;
 	if (zmq_bind(sock, path.c_str()) == -1)
@@ -66,9 +67,10 @@ createBindSock(void* ctx, std::string path, int type, int hwm = 50)
 }
 
 inline void*
-createConnectSock(void* ctx, std::string path, int type, int hwm = 50)
+createConnectSock(void* ctx, std::string path, int type, int hwm = 50,
+                  int64_t msgsz = CHUNK_SIZE + 10)
 {
-	void* sock = createSock(ctx, type, hwm);
+	void* sock = createSock(ctx, type, hwm, msgsz);
 	if (!sock)
 		return NULL;
 	if (zmq_connect(sock, path.c_str()) == -1)
@@ -96,8 +98,6 @@ add_to_buf(uint8_t*& buf, const void* val, size_t valsz)
 	buf += valsz;
 }
 
-static const size_t TICK  = 10;
-
 } // namespace
 
 #endif // __UILS_HPP__
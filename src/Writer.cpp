@@ -9,12 +9,334 @@
 #include <gettext.h>
 #include "CompressManager.hpp"
 #include "endians.hpp"
+#include "Affinity.hpp"
 
 namespace csio {
 
+/**@brief Write chunks as zstd frames or LZ4 blocks, keep sizes for
+ * the seek table
+ *
+ * Member headers and trailers are dropped, all chunks are CHUNK_SIZE
+ * long except the last one, which size is restored from the member
+ * size on member close.*/
+bool
+Writer::processSeekable(const Message& msg)
+{
+	switch(msg.Type())
+	{
+		case Message::TYPE_MCLOSE: {
+			// Z_FIN | MEMBER_CRC32 | MEMBER_FSIZE
+			u32le fsize = 0;
+			std::copy(msg.Data() + 2 + 4, msg.Data() + 2 + 4 + 4,
+			          fsize.bytes);
+			if (member_frames_ > 0)
+				last_frame_size_ = fsize - (member_frames_ - 1)*CHUNK_SIZE;
+			member_frames_ = 0;
+			closed_ = true;
+			} return true;
+		case Message::TYPE_MHEADER:
+			closed_ = false;
+			return true;
+		case Message::TYPE_FCHUNK:
+		case Message::TYPE_FBATCH:
+			if (msg.DataSize() == 0 || msg.Count() == 0)
+			{
+				VLOG(2) << _("Writer: zero-length file chunk.");
+				MSG_ERROR.Send(sock_);
+				return false;
+			}
+			for (uint16_t i = 0; i < msg.Count(); ++i)
+				frames_.push_back(msg.ChunkSize(i));
+			member_frames_ += msg.Count();
+			closed_ = false;
+			break;
+		default:
+			VLOG(2) << _("Writer: received unexpected msg type.")
+			        << _(" Type: ") << msg.Type();
+			MSG_ERROR.Send(sock_);
+			return false;
+	}
+	if (fwrite_unlocked(msg.Data(), msg.DataSize(), 1, fstream_) != 1)
+	{
+		LOG(ERROR) << _("Writer: error data writing.")
+		           << _(" Message: ") << strerror(errno);
+		MSG_ERROR.Send(sock_);
+		return false;
+	}
+	return true;
+}
+
+/**@brief Append the seek table skippable frame (see csio.h)
+ *
+ * The LZ4 frame is finished with the end mark before the table.*/
+bool
+Writer::writeSeekTable()
+{
+	std::vector<uint8_t> tab;
+	tab.reserve(4 + 2*4 + frames_.size()*SEEKABLE_ENTRY_LEN
+	            + SEEKABLE_FOOTER_LEN);
+	auto add = [&tab](uint32_t val)
+	{
+		u32le tmp(val);
+		tab.insert(tab.end(), tmp.bytes, tmp.bytes + 4);
+	};
+	if (format_ == LZ4_SEEKABLE)
+		add(0);
+	add(SEEKABLE_SKIPPABLE_MAGIC);
+	add(frames_.size()*SEEKABLE_ENTRY_LEN + SEEKABLE_FOOTER_LEN);
+	for (size_t i = 0; i < frames_.size(); ++i)
+	{
+		add(frames_[i]);
+		add(i + 1 == frames_.size() ? last_frame_size_ : CHUNK_SIZE);
+	}
+	add(frames_.size());
+	tab.push_back(0); // no checksums
+	add(SEEKABLE_FOOTER_MAGIC);
+	if (fwrite_unlocked(&tab[0], tab.size(), 1, fstream_) != 1)
+	{
+		LOG(ERROR) << _("Writer: error seek table writing.")
+		           << _(" Message: ") << strerror(errno);
+		return false;
+	}
+	return true;
+}
+
+/**@brief Append LN members (see csio.h)*/
+bool
+Writer::writeLineIndex()
+{
+	std::vector<uint8_t> mbr;
+	for (size_t first = 0; first < lines_->size();
+	     first += LN_CHUNKS_PER_MEMBER)
+	{
+		size_t cnt = std::min(lines_->size() - first, LN_CHUNKS_PER_MEMBER);
+		auto add = [&mbr](const void* data, size_t sz)
+		{
+			mbr.insert(mbr.end(), (const uint8_t*)data,
+			           (const uint8_t*)data + sz);
+		};
+		mbr.clear();
+		add(GZIP_DEFLATE_ID, sizeof(GZIP_DEFLATE_ID));
+		add(&FEXTRA, 1);
+		add(u32le(0).bytes, 4);
+		mbr.push_back(0);
+		add(&OS_CODE_UNIX, 1);
+		add(u16le(2 + 2 + 2 + 4 + 2 + cnt*2).bytes, 2);
+		add("LN", 2);
+		add(u16le(2 + 4 + 2 + cnt*2).bytes, 2);
+		add(u16le(1).bytes, 2);
+		add(u32le(first).bytes, 4);
+		add(u16le(cnt).bytes, 2);
+		for (size_t i = first; i < first + cnt; ++i)
+			add(u16le((*lines_)[i]).bytes, 2);
+		add(EMPTY_DEFLATE_BODY, sizeof(EMPTY_DEFLATE_BODY));
+		add(u32le(0).bytes, 4);
+		add(u32le(0).bytes, 4);
+		if (!writeData(&mbr[0], mbr.size()))
+		{
+			LOG(ERROR) << _("Writer: error line index writing.")
+			           << _(" Message: ") << strerror(errno);
+			return false;
+		}
+	}
+	return true;
+}
+
+/**@brief Append BF members (see csio.h)*/
+bool
+Writer::writeBlooms()
+{
+	if (fflush(blooms_) != 0 || fseeko(blooms_, 0, SEEK_END) != 0)
+		return false;
+	size_t chunks = ftello(blooms_)/bloom_size_;
+	rewind(blooms_);
+	const size_t per = (0xffff - (2 + 2) - (2 + 4 + 2 + 2 + 1 + 1))
+	                 / bloom_size_;
+	std::vector<uint8_t> mbr;
+	for (size_t first = 0; first < chunks; first += per)
+	{
+		size_t cnt = std::min(chunks - first, per);
+		auto add = [&mbr](const void* data, size_t sz)
+		{
+			mbr.insert(mbr.end(), (const uint8_t*)data,
+			           (const uint8_t*)data + sz);
+		};
+		mbr.clear();
+		add(GZIP_DEFLATE_ID, sizeof(GZIP_DEFLATE_ID));
+		add(&FEXTRA, 1);
+		add(u32le(0).bytes, 4);
+		mbr.push_back(0);
+		add(&OS_CODE_UNIX, 1);
+		add(u16le(2 + 2 + 2 + 4 + 2 + 2 + 1 + 1 + cnt*bloom_size_).bytes,
+		    2);
+		add("BF", 2);
+		add(u16le(2 + 4 + 2 + 2 + 1 + 1 + cnt*bloom_size_).bytes, 2);
+		add(u16le(1).bytes, 2);
+		add(u32le(first).bytes, 4);
+		add(u16le(cnt).bytes, 2);
+		add(u16le(bloom_size_).bytes, 2);
+		mbr.push_back(CFBLOOM_GRAM);
+		mbr.push_back(CFBLOOM_HASHES);
+		size_t pos = mbr.size();
+		mbr.resize(pos + cnt*bloom_size_);
+		if (fread(&mbr[pos], bloom_size_, cnt, blooms_) != cnt)
+			return false;
+		add(EMPTY_DEFLATE_BODY, sizeof(EMPTY_DEFLATE_BODY));
+		add(u32le(0).bytes, 4);
+		add(u32le(0).bytes, 4);
+		if (!writeData(&mbr[0], mbr.size()))
+			return false;
+	}
+	return true;
+}
+
+/**@brief Append IX members (see csio.h)
+ *
+ * The index is split into slices, the last member has RE_EXTRA with
+ * the size of all IX members.*/
+bool
+Writer::writeIndex()
+{
+	std::vector<uint8_t> ix;
+	ix.reserve(IX_HEADER_LEN + members_.size()*IX_MEMBER_LEN
+	           + frames_.size()*2);
+	auto add = [](std::vector<uint8_t>& buf, const void* data, size_t sz)
+	{
+		buf.insert(buf.end(), (const uint8_t*)data,
+		           (const uint8_t*)data + sz);
+	};
+	add(ix, u16le(1).bytes, 2);
+	add(ix, u16le(CHUNK_SIZE).bytes, 2);
+	add(ix, u64le(size_).bytes, 8);
+	add(ix, u32le(members_.size()).bytes, 4);
+	add(ix, u32le(frames_.size()).bytes, 4);
+	for (size_t i = 0; i < members_.size(); ++i)
+	{
+		add(ix, u64le(written_ - members_[i].first).bytes, 8);
+		add(ix, u32le(members_[i].second).bytes, 4);
+	}
+	for (size_t i = 0; i < frames_.size(); ++i)
+		add(ix, u16le(frames_[i]).bytes, 2);
+	const size_t mcnt = (ix.size() + IX_SLICE_MAX - 1)/IX_SLICE_MAX;
+	// header, RI subfield header, empty body, CRC32, ISIZE
+	const uint64_t total = mcnt*(sizeof(GZIP_DEFLATE_ID) + 1 + 4 + 1 + 1 + 2
+	                             + 2 + 2 + sizeof(EMPTY_DEFLATE_BODY) + 4 + 4)
+	                     + IX_LOCATOR_LEN + ix.size();
+	std::vector<uint8_t> mbr;
+	for (size_t first = 0; first < ix.size(); first += IX_SLICE_MAX)
+	{
+		size_t cnt = std::min(ix.size() - first, IX_SLICE_MAX);
+		bool last = first + cnt == ix.size();
+		mbr.clear();
+		add(mbr, GZIP_DEFLATE_ID, sizeof(GZIP_DEFLATE_ID));
+		add(mbr, &FEXTRA, 1);
+		add(mbr, u32le(0).bytes, 4);
+		mbr.push_back(0);
+		add(mbr, &OS_CODE_UNIX, 1);
+		add(mbr, u16le(2 + 2 + cnt + (last ? IX_LOCATOR_LEN : 0)).bytes, 2);
+		add(mbr, "RI", 2);
+		add(mbr, u16le(cnt).bytes, 2);
+		add(mbr, &ix[first], cnt);
+		if (last)
+		{
+			add(mbr, "RE", 2);
+			add(mbr, u16le(8).bytes, 2);
+			add(mbr, u64le(total).bytes, 8);
+		}
+		add(mbr, EMPTY_DEFLATE_BODY, sizeof(EMPTY_DEFLATE_BODY));
+		add(mbr, u32le(0).bytes, 4);
+		add(mbr, u32le(0).bytes, 4);
+		if (!writeData(&mbr[0], mbr.size()))
+			return false;
+	}
+	return true;
+}
+
+/**@brief Write and count bytes*/
+bool
+Writer::writeData(const void* data, size_t size)
+{
+	if (fwrite_unlocked(data, size, 1, fstream_) != 1)
+		return false;
+	written_ += size;
+	return true;
+}
+
+/**@brief Write dictzip members without going back to RA_EXTRA
+ *
+ * FEXTRA is dropped from member headers, chunks sizes and members data
+ * offsets are collected for writeIndex.*/
+bool
+Writer::processSequential(const Message& msg)
+{
+	switch(msg.Type())
+	{
+		case Message::TYPE_MCLOSE: {
+			// Z_FIN | MEMBER_CRC32 | MEMBER_FSIZE
+			u32le fsize = 0;
+			std::copy(msg.Data() + 2 + 4, msg.Data() + 2 + 4 + 4,
+			          fsize.bytes);
+			size_ += fsize;
+			closed_ = true;
+			} break;
+		case Message::TYPE_MHEADER: {
+			VLOG(2) << _("Writer: member header received.");
+			closed_ = false;
+			// ID | FLG | MTIME | XFL | OS, then XLEN and RA_EXTRA are
+			// skipped
+			const uint8_t* hdr = msg.Data();
+			uint8_t plain[sizeof(GZIP_DEFLATE_ID) + 1 + 4 + 1 + 1];
+			size_t skip = sizeof(plain) + 2
+			            + (hdr[sizeof(plain)] | hdr[sizeof(plain) + 1] << 8);
+			memcpy(plain, hdr, sizeof(plain));
+			plain[sizeof(GZIP_DEFLATE_ID)] &= ~FEXTRA;
+			if (skip > msg.DataSize()
+			 || !writeData(plain, sizeof(plain))
+			 || !writeData(hdr + skip, msg.DataSize() - skip))
+			{
+				LOG(ERROR) << _("Writer: error data writing.")
+				           << _(" Message: ") << strerror(errno);
+				MSG_ERROR.Send(sock_);
+				return false;
+			}
+			members_.push_back(std::make_pair(written_, 0));
+			} return true;
+		case Message::TYPE_FCHUNK:
+		case Message::TYPE_FBATCH:
+			if (msg.DataSize() == 0 || msg.Count() == 0
+			 || members_.empty())
+			{
+				VLOG(2) << _("Writer: zero-length file chunk.");
+				MSG_ERROR.Send(sock_);
+				return false;
+			}
+			for (uint16_t i = 0; i < msg.Count(); ++i)
+				frames_.push_back(msg.ChunkSize(i));
+			members_.back().second += msg.Count();
+			break;
+		default:
+			VLOG(2) << _("Writer: received unexpected msg type.")
+			        << _(" Type: ") << msg.Type();
+			MSG_ERROR.Send(sock_);
+			return false;
+	}
+	if (!writeData(msg.Data(), msg.DataSize()))
+	{
+		LOG(ERROR) << _("Writer: error data writing.")
+		           << _(" Message: ") << strerror(errno);
+		MSG_ERROR.Send(sock_);
+		return false;
+	}
+	return true;
+}
+
 bool
 Writer::processMessage(const Message& msg)
 {
+	if (format_ != DICTZIP)
+		return processSeekable(msg);
+	if (trailer_)
+		return processSequential(msg);
 	switch(msg.Type())
 	{
 		case Message::TYPE_MCLOSE: {
@@ -30,31 +352,38 @@ Writer::processMessage(const Message& msg)
 			}
 			fseeko(fstream_, curpos, SEEK_SET);
 			lbufsz_ = 0;
+			closed_ = true;
 			} break;
 		case Message::TYPE_MHEADER: {
 			VLOG(2) << _("Writer: member header received.");
+			closed_ = false;
 			chunks_lengths_off_ = ftello(fstream_)
 				+ Message::CHUNKS_LENGTHS_HEADER_OFFSET;
 			} break;
-		case Message::TYPE_FCHUNK: {
-			if (msg.DataSize() == 0)
+		case Message::TYPE_FCHUNK:
+		case Message::TYPE_FBATCH: {
+			if (msg.DataSize() == 0 || msg.Count() == 0)
 			{
 				VLOG(2) << _("Writer: zero-length file chunk.");
 				MSG_ERROR.Send(sock_);
 				return false;
 			}
-			if (lbufsz_ > CHUNKS_PER_MEMBER*2 - 2)
+			if (lbufsz_ + msg.Count()*2 > CHUNKS_PER_MEMBER*2)
 			{
 				VLOG(2) << _("Writer: lbuf corruption.");
 				MSG_ERROR.Send(sock_);
 				return false;
 			}
-			u16le tmp(msg.DataSize());
-			memcpy(lbuf_ + lbufsz_, tmp.bytes, 2);
-			lbufsz_ += 2;
+			for (uint16_t i = 0; i < msg.Count(); ++i)
+			{
+				u16le tmp(msg.ChunkSize(i));
+				memcpy(lbuf_ + lbufsz_, tmp.bytes, 2);
+				lbufsz_ += 2;
+			}
 #			ifndef NDEBUG
 			VLOG(2) << "Writer: written " << msg.DataSize()
-			        << " bytes (seq " << msg.Num() << ")";
+			        << " bytes (seq " << msg.Num() << ", "
+			        << msg.Count() << " chunks)";
 #			endif // DEBUG
 			} break;
 		default:
@@ -79,6 +408,9 @@ Writer::Start(Writer* self, int ofd)
 	self->break_ = false;
 	if (!self->zmq_ctx_)
 		return NULL;
+	if (!pin_thread(self->cpus_))
+		LOG(WARNING) << _("Writer: error setting CPU affinity.")
+		             << _(" Message: ") << strerror(errno);
 	self->fstream_ = fdopen(ofd, "wb");
 	if (!self->fstream_)
 	{
@@ -92,35 +424,72 @@ Writer::Start(Writer* self, int ofd)
 		return NULL;
 	}
 	MSG_READY.Send(self->sock_);
-	zmq_pollitem_t event = {self->sock_, 0, ZMQ_POLLIN, 0};
 	memset(self->lbuf_, 0, sizeof(self->lbuf_));
 	self->lbufsz_ = 0;
-	bool first_member = true;
+	if (self->format_ == LZ4_SEEKABLE
+	 && fwrite_unlocked(LZ4_FRAME_HEADER, sizeof(LZ4_FRAME_HEADER), 1,
+	                    self->fstream_) != 1)
+	{
+		LOG(ERROR) << _("Writer: error LZ4 frame header writing.")
+		           << _(" Message: ") << strerror(errno);
+		MSG_ERROR.Send(self->sock_);
+		self->break_ = true;
+	}
+	Clock::time_point wait_start = Clock::now();
 	while(!self->break_)
 	{
-		int rs = zmq_poll(&event, 1, TICK);
-		if(rs == 0)
-		{
-			continue;
-		}
-		else if (rs == -1)
+		// blocking receive, MSG_STOP is sent by the manager after all
+		// the data
+		Message msg(self->sock_);
+		if (msg.Type() == Message::TYPE_UNKNOWN)
 		{
-			VLOG(2) << _("Witer: error polling. ")
+			if (errno == EINTR)
+				continue;
+			VLOG(2) << _("Writer: error receiving. ")
 			        << _(" Message: ") << zmq_strerror(errno);
 			MSG_ERROR.Send(self->sock_);
 			break;
 		}
-		Message msg(self->sock_);
+		Clock::time_point busy_start = Clock::now();
+		self->stats_.wait_ns += ns_since(wait_start);
 		if (msg == MSG_STOP)
 		{
 			VLOG(2) << "Writer:"
 			        << _(" received MSG_STOP. Stopping.");
+			// the table only if all the data was written
+			if (self->format_ != DICTZIP && self->closed_
+			 && !self->frames_.empty() && !self->writeSeekTable())
+				MSG_ERROR.Send(self->sock_);
+			if (self->format_ == DICTZIP && self->closed_ && self->lines_
+			 && !self->lines_->empty() && !self->writeLineIndex())
+				MSG_ERROR.Send(self->sock_);
+			if (self->format_ == DICTZIP && self->closed_ && self->blooms_
+			 && !self->writeBlooms())
+			{
+				LOG(ERROR) << _("Writer: error bloom filters writing.")
+				           << _(" Message: ") << strerror(errno);
+				MSG_ERROR.Send(self->sock_);
+			}
+			if (self->format_ == DICTZIP && self->closed_ && self->trailer_
+			 && !self->frames_.empty() && !self->writeIndex())
+			{
+				LOG(ERROR) << _("Writer: error index writing.")
+				           << _(" Message: ") << strerror(errno);
+				MSG_ERROR.Send(self->sock_);
+			}
 			break;
 		}
 		if (!self->processMessage(msg))
 			break;
+		++self->stats_.items;
+		self->stats_.bytes += msg.DataSize();
+		wait_start = Clock::now();
+		self->stats_.busy_ns += std::chrono::duration_cast<
+			std::chrono::nanoseconds>(wait_start - busy_start).count();
 	}
+	Clock::time_point close_start = Clock::now();
 	fclose(self->fstream_);
+	self->stats_.busy_ns += ns_since(close_start);
 	if (self->break_)
 		VLOG(2) << "Writer breaked.";
 	zmq_close(self->sock_);
@@ -7,25 +7,63 @@
 #include <cstdio>
 #include "Utils.hpp"
 #include "Messages.hpp"
+#include "Telemetry.hpp"
+#include <vector>
+#include <utility>
 
 namespace csio {
 
 class Writer
 {
 public:
-	Writer(void* zmq_ctx, int hwm)
+	Writer(void* zmq_ctx, int hwm, int64_t msgsz = CHUNK_SIZE + 10,
+	       const std::vector<int>& cpus = std::vector<int>(),
+	       CompressionMethod format = DICTZIP)
 		: zmq_ctx_(zmq_ctx)
 		, fstream_(NULL)
 		, chunks_lengths_off_(0)
 		, break_(false)
+		, cpus_(cpus)
+		, format_(format)
+		, member_frames_(0)
+		, last_frame_size_(0)
+		, closed_(false)
+		, lines_(NULL)
+		, blooms_(NULL)
+		, bloom_size_(0)
+		, trailer_(false)
+		, written_(0)
+		, size_(0)
 	{
 		sock_ = createConnectSock(
-			zmq_ctx_, "inproc://writer", ZMQ_PAIR, hwm);
+			zmq_ctx_, "inproc://writer", ZMQ_PAIR, hwm, msgsz);
 	}
 
 	static void* Start(Writer* self, int out_file_descriptor);
+	const StageStats& Stats() const { return stats_; }
+	/**@brief Append LN members with the newline counts of chunks after
+	 * the data (see csio.h). The vector is filled by the reader before
+	 * MSG_STOP.*/
+	void SetLineIndex(const std::vector<uint16_t>* lines) { lines_ = lines; }
+	/**@brief Append BF members with the chunk filters (bloom_size bytes
+	 * each, in the file) after the data and LN members*/
+	void SetBlooms(FILE* blooms, size_t bloom_size)
+	{
+		blooms_ = blooms;
+		bloom_size_ = bloom_size;
+	}
+	/**@brief Write members without RA_EXTRA strictly sequentially and
+	 * append IX members with the index after all other (see csio.h)*/
+	void SetTrailerIndex(bool trailer) { trailer_ = trailer; }
 private:
 	bool processMessage(const Message& msg);
+	bool processSeekable(const Message& msg);
+	bool processSequential(const Message& msg);
+	bool writeData(const void* data, size_t size);
+	bool writeSeekTable();
+	bool writeLineIndex();
+	bool writeBlooms();
+	bool writeIndex();
 	Writer() = delete;
 	Writer(const Writer&) = delete;
 	Writer& operator=(const Writer&) = delete;
@@ -36,6 +74,24 @@ private:
 	bool    break_;
 	uint8_t lbuf_[CHUNKS_PER_MEMBER*2];
 	size_t  lbufsz_;
+	StageStats stats_;
+	std::vector<int> cpus_; //!< affinity (empty - any)
+	// ZSTD_SEEKABLE, LZ4_SEEKABLE: gzip members are not written, frames
+	// sizes are collected for the seek table
+	CompressionMethod     format_;
+	std::vector<uint16_t> frames_;          //!< compressed sizes
+	size_t                member_frames_;   //!< frames of the current member
+	uint32_t              last_frame_size_; //!< decompressed
+	bool                  closed_;          //!< the last member is closed
+	const std::vector<uint16_t>* lines_;    //!< see SetLineIndex
+	FILE*                 blooms_;          //!< see SetBlooms
+	size_t                bloom_size_;
+	// trailer index: chunks sizes are collected in frames_
+	bool                  trailer_;         //!< see SetTrailerIndex
+	uint64_t              written_;         //!< bytes written
+	uint64_t              size_;            //!< decompressed
+	//! data offsets and chunks counts of members
+	std::vector<std::pair<uint64_t, uint32_t> > members_;
 };
 
 } // namespace
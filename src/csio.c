@@ -3,7 +3,42 @@
 #include <string.h>
 #include <stdint.h>
 #include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/eventfd.h>
+#include <poll.h>
 #include <zlib.h>
+#ifdef CSIO_WITH_LIBDEFLATE
+#	include <libdeflate.h>
+#endif
+#ifdef CSIO_WITH_ISAL
+#	include <isa-l/igzip_lib.h>
+#endif
+#ifdef CSIO_WITH_ZSTD
+#	include <zstd.h>
+#endif
+#ifdef CSIO_WITH_LZ4
+#	include <lz4.h>
+#endif
+#ifdef CSIO_WITH_IO_URING
+#	include <linux/io_uring.h>
+#	include <sys/mman.h>
+#	include <sys/syscall.h>
+#endif
+
+/**@brief Window length used to buffer uncompressed (NONE) streams*/
+static const uint16_t NONE_WINDOW_LEN = 0x8000;
+
+/**@brief Monotonic clock in nanoseconds (for the statistics)*/
+static uint64_t
+now_ns()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+}
 
 /**@brief stdio fopen analogue
  *
@@ -27,19 +62,41 @@ size_t skip_cstr(FILE* strm)
 	return result;
 }
 
-/**@brief Determine compression method*/
+/**@brief Compression methods, that are read chunk by chunk with CFINDEX*/
+static int
+is_chunked(CompressionMethod method)
+{
+	return method == DICTZIP || method == ZSTD_SEEKABLE
+	    || method == LZ4_SEEKABLE;
+}
+
+/**@brief Little endian 32-bit integer*/
+static uint32_t
+get_le32(const unsigned char* p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8
+	     | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+/**@brief Determine compression method
+ *
+ * ZSTD_SEEKABLE and LZ4_SEEKABLE are returned for any zstd or LZ4 frame
+ * stream, the seek table is checked in cfinit.*/
 CompressionMethod
 get_compression(FILE* stream)
 {
-	char buf[3];
+	char buf[4];
 	off_t currpos = ftello(stream);
 	CompressionMethod result = NONE;
 	if (currpos == -1)
 		return result;
-	if (fread((void*)buf, 1, 3, stream) != 3)
-		result = NONE;
-	else if (memcmp(buf, GZIP_DEFLATE_ID, 3) == 0)
+	size_t rs = fread((void*)buf, 1, 4, stream);
+	if (rs >= 3 && memcmp(buf, GZIP_DEFLATE_ID, 3) == 0)
 		result = GZIP;
+	else if (rs == 4 && memcmp(buf, ZSTD_FRAME_ID, 4) == 0)
+		result = ZSTD_SEEKABLE;
+	else if (rs == 4 && memcmp(buf, LZ4_FRAME_ID, 4) == 0)
+		result = LZ4_SEEKABLE;
 	fseeko(stream, currpos, SEEK_SET);
 	return result;
 }
@@ -76,6 +133,7 @@ int
 get_gzip_header(FILE* stream, GZIPHeader* hdr)
 {
 	const char HDRSZ = 10;
+	hdr->chcnt = 0;
 	int rs = fread((void *)hdr, 1, HDRSZ, stream);
 	if (rs != HDRSZ)
 		return -1;
@@ -200,21 +258,176 @@ clear(CFILE* cstream)
 	cstream->bufsz = 0;
 	cstream->need_close = 0;
 	cstream->compression = NONE;
-	memset(cstream->buf, 0, 0x10000);
+	cstream->buf = NULL;
 	cstream->idxsz = 0;
 	cstream->idx = NULL;
 	cstream->init_magic = 0;
 	cstream->eof = 0;
+	cstream->stats = NULL;
+	cstream->backend = CFBACKEND_ZLIB;
+	cstream->backend_state = NULL;
+	cstream->codec_state = NULL;
+	cstream->cache = NULL;
 	return 0;
 }
 
+/**@brief Newline counts of chunks (see cfseekline)
+ *
+ * Compact as CFINDEX: 2-byte count of every chunk and the count before
+ * every block of 64 chunks (the last item is the total).*/
+typedef struct
+{
+	size_t    memsz;
+	size_t    chcnt;
+	uint64_t* block;
+	uint16_t* counts;
+} CFLINES;
+
+/**@brief Location of the chunk filters in BF members*/
+typedef struct
+{
+	off_t  base;  //!< the first BF member
+	size_t msize; //!< size of a member (except the last)
+	size_t per;   //!< filters per member (except the last)
+	size_t fsize; //!< filter size, 0 - there are no filters
+} CFBLOOMS;
+
+/**@brief Compact dictzip chunk index
+ *
+ * Chunk offsets are not stored one by one. The index keeps:
+ *
+ * - mbase  - offset of the first chunk data for every member;
+ * - mfirst - global number of the first chunk for every member;
+ * - block  - for every 64 chunks offset of the first chunk of the block
+ *            relative to the mbase of its member;
+ * - lens   - 2-byte compressed lengths of all chunks (as they are in
+ *            RA_EXTRA).
+ *
+ * Offset of the chunk is restored from the block (or member) base plus
+ * less then 64 lengths (two cache lines), so the lookup is constant
+ * time and doesn't allocate. It takes about 2 bytes per chunk instead
+ * of 8. Index is allocated with a single malloc and reference counted,
+ * so it can be shared between handles (see cfdup).*/
+struct CFINDEX
+{
+	int       refs;
+	size_t    chcnt;  //!< total chunks count
+	size_t    mcnt;   //!< members count
+	size_t    mchcnt; //!< chunks per member, if all members (except
+	                  //!< the last) are equal, 0 otherwise
+	uint64_t* mbase;
+	uint64_t* mfirst;
+	uint32_t* block;
+	uint16_t* lens;
+	CFLINES*  lines;  //!< built on demand (see cfseekline)
+	CFBLOOMS* blooms; //!< located on demand (see cfchunk_may_contain)
+};
+
+static const size_t CFINDEX_BLOCK = 64;
+
+/**@brief Allocate index for mcnt members and chcnt chunks
+ * @return NULL on error, allocated size is returned in memsz*/
+CFINDEX*
+cfindex_alloc(size_t mcnt, size_t chcnt, size_t* memsz)
+{
+	size_t blocks = (chcnt + CFINDEX_BLOCK - 1)/CFINDEX_BLOCK;
+	size_t sz = sizeof(CFINDEX)
+	          + mcnt*sizeof(uint64_t)*2
+	          + blocks*sizeof(uint32_t)
+	          + chcnt*sizeof(uint16_t);
+	CFINDEX* idx = (CFINDEX*)malloc(sz);
+	if (!idx)
+		return NULL;
+	idx->refs = 1;
+	idx->chcnt = chcnt;
+	idx->mcnt = mcnt;
+	idx->mchcnt = 0;
+	idx->mbase = (uint64_t*)(idx + 1);
+	idx->mfirst = idx->mbase + mcnt;
+	idx->block = (uint32_t*)(idx->mfirst + mcnt);
+	idx->lens = (uint16_t*)(idx->block + blocks);
+	idx->lines = NULL;
+	idx->blooms = NULL;
+	*memsz = sz;
+	return idx;
+}
+
+/**@brief Add reference to the index*/
+CFINDEX*
+cfindex_ref(CFINDEX* idx)
+{
+	if (idx)
+		__sync_add_and_fetch(&idx->refs, 1);
+	return idx;
+}
+
+/**@brief Release reference to the index, free it on the last one*/
+void
+cfindex_release(CFINDEX* idx)
+{
+	if (idx && __sync_sub_and_fetch(&idx->refs, 1) == 0)
+	{
+		free(idx->lines);
+		free(idx->blooms);
+		free(idx);
+	}
+}
+
+/**@brief Count of chunks in the index*/
+size_t
+cfindex_chunks(const CFINDEX* idx)
+{
+	return idx ? idx->chcnt : 0;
+}
+
+/**@brief Get offset and compressed length of the chunk
+ * @return 1 on success, -1 if there is no such chunk*/
+int
+cfindex_chunk(const CFINDEX* idx, size_t chunk_no, off_t* off, size_t* len)
+{
+	if (!idx || chunk_no >= idx->chcnt)
+		return -1;
+	size_t m;
+	if (idx->mchcnt)
+	{
+		m = chunk_no/idx->mchcnt;
+		if (m >= idx->mcnt)
+			m = idx->mcnt - 1;
+	}
+	else
+	{
+		size_t lo = 0, hi = idx->mcnt;
+		while (hi - lo > 1)
+		{
+			size_t mid = lo + (hi - lo)/2;
+			if (idx->mfirst[mid] <= chunk_no)
+				lo = mid;
+			else
+				hi = mid;
+		}
+		m = lo;
+	}
+	size_t b = chunk_no/CFINDEX_BLOCK;
+	size_t from = b*CFINDEX_BLOCK;
+	uint64_t rs = idx->mbase[m];
+	if (from >= idx->mfirst[m])
+		rs += idx->block[b];
+	else
+		from = idx->mfirst[m];
+	for (; from < chunk_no; ++from)
+		rs += idx->lens[from];
+	*off = (off_t)rs;
+	*len = idx->lens[chunk_no];
+	return 1;
+}
+
 /**@brief Creates dictzip index
 *
-* DICTZIP index is the array of chunks offsets
+* DICTZIP index is the compact array of chunks offsets (see CFINDEX)
 * TODO: In theory, chlen must not be identical in all gzip members.
 * This situation is not supported for now.
-* @return On success returns 1. In that case memory for idx was
-* allocated and must be freed*/
+* @return On success returns 1. In that case idx was allocated and must
+* be released with cfindex_release*/
 int
 init_dictzip(FILE* stream, CFILE* cstream)
 {
@@ -226,9 +439,9 @@ init_dictzip(FILE* stream, CFILE* cstream)
 	if (chcnt == 0 || mcnt == 0 || streamsz == 0)
 		return 0;
 	GZIPHeader hdr;
-	uint64_t* idx = NULL;
+	CFINDEX* idx = NULL;
 	fseeko(stream, 0, SEEK_SET);
-	size_t i = 0;
+	size_t i = 0, m = 0, mchcnt = 0, uniform = 1;
 	while(get_gzip_header(stream, &hdr) == 1)
 	{
 		if (hdr.chcnt == 0)
@@ -251,252 +464,1749 @@ init_dictzip(FILE* stream, CFILE* cstream)
 			cstream->bufsz = 0;
 			cstream->bufoff = 0;
 			cstream->chlen = hdr.chlen;
-			cstream->idx = (char*)malloc(chcnt*8 + 8);
-			memset(cstream->idx, 0, chcnt*8 + 8);
 			cstream->size = streamsz;
-			if (!cstream->idx)
+			idx = cfindex_alloc(mcnt, chcnt, &cstream->idxsz);
+			if (!idx)
 			{
 				errno = EFAULT;
-				return -1;
-			}
-			cstream->idxsz = chcnt*8;
-			idx = (uint64_t*)cstream->idx;
-		}
-		idx[i] = hdr.dataoff;
-		++i;
-		size_t j;
-		for(j = 0; j < hdr.chcnt - 1; ++j)
-		{
-			if(i >= chcnt)
-			{
-				errno = EFAULT;
-				free(cstream->idx);
 				clear(cstream);
 				return -1;
 			}
-			idx[i] = idx[i - 1] + hdr.chunks[j];
-			++i;
+			cstream->idx = idx;
+			mchcnt = hdr.chcnt;
 		}
-	}
-	if (idx != NULL)
-	{
-		fseeko(stream, 0, SEEK_END);
-		idx[i] = (uint64_t)ftello(stream);
-		if (idx[i] == -1)
+		if (m >= mcnt || i + hdr.chcnt > chcnt)
 		{
 			errno = EFAULT;
-			free(cstream->idx);
+			cfindex_release(cstream->idx);
 			clear(cstream);
 			return -1;
 		}
+		/* only the last member may differ*/
+		if (m > 0 && idx->mfirst[m - 1] + mchcnt != i)
+			uniform = 0;
+		idx->mbase[m] = hdr.dataoff;
+		idx->mfirst[m] = i;
+		++m;
+		uint32_t rel = 0;
+		size_t j;
+		for(j = 0; j < hdr.chcnt; ++j, ++i)
+		{
+			if (i % CFINDEX_BLOCK == 0)
+				idx->block[i/CFINDEX_BLOCK] = rel;
+			idx->lens[i] = hdr.chunks[j];
+			rel += hdr.chunks[j];
+		}
+	}
+	if (idx != NULL)
+	{
+		idx->mcnt = m;
+		idx->chcnt = i;
+		idx->mchcnt = uniform ? mchcnt : 0;
 	}
 	if (cstream->stream == stream)
 		return 1;
 	return -1;
 }
 
-/**@brief check stream integrity
- * @return Non zero on error
- * @note This function doesn't check error flag, it checks stream
- * integrity.*/
-int cferror(CFILE* stream)
+size_t pread_full(int fd, void* buf, size_t count, off_t offset);
+size_t getsz(FILE* file);
+
+/**@brief Sizes of the trailer members (LN, BF, IX) without the extra
+ * field*/
+static const size_t TRAILER_HEADER_LEN = 12;
+static const size_t TRAILER_TAIL_LEN = sizeof(EMPTY_DEFLATE_BODY)
+                                     + GZIP_CRC32_LEN + 4;
+
+/**@brief Little endian 64-bit integer*/
+static uint64_t
+get_le64(const unsigned char* p)
 {
-	if (stream == NULL)
-		return -1;
-	if (stream->init_magic != INITIALIZED)
+	return get_le32(p) | (uint64_t)get_le32(p + 4) << 32;
+}
+
+/**@brief Build the index from IX members
+ *
+ * RI slices are joined in place (they only move to the beginning).
+ * @param tr - IX members (total bytes) at dataend offset
+ * @return NULL if members or the index are broken*/
+static CFINDEX*
+trailer_index(unsigned char* tr, size_t total, uint64_t dataend,
+              uint16_t* chlen, uint64_t* size, size_t* idxsz)
+{
+	size_t ixsz = 0, pos = 0;
+	while (pos < total)
+	{
+		if (total - pos < TRAILER_HEADER_LEN + TRAILER_TAIL_LEN
+		 || memcmp(tr + pos, GZIP_DEFLATE_ID, 3) != 0
+		 || tr[pos + 3] != FEXTRA)
+			return NULL;
+		size_t xlen = tr[pos + 10] | tr[pos + 11] << 8;
+		size_t msize = TRAILER_HEADER_LEN + xlen + TRAILER_TAIL_LEN;
+		if (msize > total - pos)
+			return NULL;
+		size_t x = pos + TRAILER_HEADER_LEN, xend = x + xlen;
+		while (x + 2*2 <= xend)
+		{
+			size_t sublen = tr[x + 2] | tr[x + 3] << 8;
+			if (x + 2*2 + sublen > xend)
+				return NULL;
+			if (tr[x] == 'R' && tr[x + 1] == 'I')
+			{
+				memmove(tr + ixsz, tr + x + 2*2, sublen);
+				ixsz += sublen;
+			}
+			x += 2*2 + sublen;
+		}
+		pos += msize;
+	}
+	if (ixsz < IX_HEADER_LEN || tr[0] != 1 || tr[1] != 0)
+		return NULL;
+	*chlen = tr[2] | tr[3] << 8;
+	*size = get_le64(tr + 4);
+	size_t mcnt = get_le32(tr + 12);
+	size_t chcnt = get_le32(tr + 16);
+	if (*chlen == 0 || mcnt == 0 || chcnt == 0
+	 || ixsz != IX_HEADER_LEN + mcnt*IX_MEMBER_LEN + chcnt*2
+	 || *size > (uint64_t)chcnt**chlen
+	 || *size <= (uint64_t)(chcnt - 1)**chlen)
+		return NULL;
+	CFINDEX* idx = cfindex_alloc(mcnt, chcnt, idxsz);
+	if (!idx)
+		return NULL;
+	const unsigned char* mbr = tr + IX_HEADER_LEN;
+	const unsigned char* lens = mbr + mcnt*IX_MEMBER_LEN;
+	size_t mchcnt = get_le32(mbr + 8), uniform = 1;
+	size_t i = 0, m;
+	for (m = 0; m < mcnt; ++m, mbr += IX_MEMBER_LEN)
+	{
+		uint64_t dist = get_le64(mbr);
+		size_t cnt = get_le32(mbr + 8);
+		if (cnt == 0 || cnt > chcnt - i || dist > dataend)
+			break;
+		uint64_t base = dataend - dist;
+		/* only the last member may differ*/
+		if (m + 1 < mcnt && cnt != mchcnt)
+			uniform = 0;
+		idx->mbase[m] = base;
+		idx->mfirst[m] = i;
+		uint64_t rel = 0;
+		for (; cnt > 0; --cnt, ++i)
+		{
+			if (i % CFINDEX_BLOCK == 0)
+				idx->block[i/CFINDEX_BLOCK] = rel;
+			idx->lens[i] = lens[2*i] | lens[2*i + 1] << 8;
+			rel += idx->lens[i];
+		}
+		if (rel > UINT32_MAX || base + rel + EMPTY_FINISH_BLOCK_LEN
+		                        + GZIP_CRC32_LEN + 4 > dataend)
+			break;
+	}
+	if (m != mcnt || i != chcnt)
+	{
+		cfindex_release(idx);
+		return NULL;
+	}
+	idx->mchcnt = uniform ? mchcnt : 0;
+	return idx;
+}
+
+/**@brief Creates dictzip index from IX members at the end of the stream
+ * (dzip --trailer-index)
+ *
+ * The tail of the stream is read with one pread, that has the whole
+ * index of streams up to about 2GB, bigger indexes take one more.
+ * @return 1 on success, 0 if there are no IX members, -1 on error*/
+int
+init_trailer(FILE* stream, CFILE* cstream)
+{
+	if (stream == NULL || cstream == NULL)
 		return -1;
-	if (stream->stream == NULL)
+	clear(cstream);
+	int fd = fileno(stream);
+	uint64_t filesz = getsz(stream);
+	const size_t ENDLEN = IX_LOCATOR_LEN + TRAILER_TAIL_LEN;
+	size_t tailsz = filesz < 0x10000 ? filesz : 0x10000;
+	if (tailsz < TRAILER_HEADER_LEN + ENDLEN)
+		return 0;
+	unsigned char* buf = (unsigned char*)malloc(tailsz);
+	if (!buf)
+	{
+		errno = ENOMEM;
 		return -1;
-	if (ferror(stream->stream))
+	}
+	if (pread_full(fd, buf, tailsz, filesz - tailsz) != tailsz)
+	{
+		free(buf);
+		errno = EFAULT;
 		return -1;
-	if (stream->compression == NONE)
+	}
+	const unsigned char* loc = buf + tailsz - ENDLEN;
+	uint64_t total = get_le64(loc + 2*2);
+	if (loc[0] != 'R' || loc[1] != 'E' || loc[2] != 8 || loc[3] != 0
+	 || memcmp(loc + IX_LOCATOR_LEN, EMPTY_DEFLATE_BODY,
+	           sizeof(EMPTY_DEFLATE_BODY)) != 0
+	 || total < TRAILER_HEADER_LEN + ENDLEN || total > filesz)
 	{
+		free(buf);
 		return 0;
 	}
-	else if (stream->compression == DICTZIP)
+	unsigned char* tr = buf + tailsz - total;
+	if (total > tailsz)
 	{
-		if (stream->idx == NULL)
-			return -1;
-		if (stream->idxsz == 0)
-			return -1;
-		if (stream->chlen == 0)
+		free(buf);
+		tr = buf = (unsigned char*)malloc(total);
+		if (!buf)
+		{
+			errno = ENOMEM;
 			return -1;
-		if (stream->size == 0)
+		}
+		if (pread_full(fd, buf, total, filesz - total) != total)
+		{
+			free(buf);
+			errno = EFAULT;
 			return -1;
+		}
 	}
-	else
+	uint16_t chlen;
+	uint64_t size;
+	CFINDEX* idx = trailer_index(tr, total, filesz - total, &chlen, &size,
+	                             &cstream->idxsz);
+	free(buf);
+	if (!idx)
 	{
+		cstream->idxsz = 0;
+		errno = EFAULT;
 		return -1;
 	}
-	return 0;
+	memset(&cstream->zst, 0, sizeof(cstream->zst));
+	cstream->stream = stream;
+	cstream->compression = DICTZIP;
+	cstream->chlen = chlen;
+	cstream->size = size;
+	cstream->idx = idx;
+	return 1;
 }
 
-/**@brief Renew buffer, so pos will be in it
- * @return 1 on success, -1 on error*/
+/**@brief Frames per CFINDEX member of seekable streams (block offsets
+ * are 4-byte and relative to the member)*/
+static const size_t SEEKABLE_MEMBER_FRAMES = 0x10000;
+
+/**@brief Creates index from the seek table at the end of the stream
+ *
+ * Frames starting at dataoff are indexed as chunks of members with
+ * SEEKABLE_MEMBER_FRAMES chunks. The index is the same compact CFINDEX
+ * as for dictzip, so compressed and decompressed frame sizes must fit
+ * 2 bytes.
+ * @return 1 on success, 0 if there is no supported seek table, -1 on
+ * error. On success idx was allocated and must be released with
+ * cfindex_release*/
 int
-fill_buf(CFILE* cstream, off_t pos)
+init_seekable(FILE* stream, CFILE* cstream, CompressionMethod method,
+		off_t dataoff)
 {
-	if (cferror(cstream))
-		return -1;
-	if (pos >= cstream->size)
-	{
-		errno = EINVAL;
-		cstream->eof = 1;
+	if (stream == NULL || cstream == NULL)
 		return -1;
-	}
-	if (cstream->compression != DICTZIP)
+	clear(cstream);
+	int fd = fileno(stream);
+	off_t filesz = (off_t)getsz(stream);
+	unsigned char footer[SEEKABLE_FOOTER_LEN];
+	if (filesz < dataoff + (off_t)(2*4 + SEEKABLE_FOOTER_LEN)
+	 || pread_full(fd, footer, SEEKABLE_FOOTER_LEN,
+	               filesz - SEEKABLE_FOOTER_LEN) != SEEKABLE_FOOTER_LEN
+	 || get_le32(footer + 5) != SEEKABLE_FOOTER_MAGIC
+	 || (footer[4] & 0x7c) != 0)
 	{
-		errno = ENOSYS;
-		return -1;
+		return 0;
 	}
-	if (pos >= cstream->bufoff)
-		if(pos - cstream->bufoff < cstream->bufsz)
-			return 1;
-	size_t chunk_no = pos/cstream->chlen;
-	if (chunk_no > (cstream->idxsz/8 - 1))
+	size_t nframes = get_le32(footer);
+	size_t esz = SEEKABLE_ENTRY_LEN + (footer[4] & SEEKABLE_CHECKSUM_FLAG ? 4 : 0);
+	off_t tabsz = (off_t)nframes*esz;
+	off_t taboff = filesz - SEEKABLE_FOOTER_LEN - tabsz;
+	unsigned char skiphdr[2*4];
+	if (nframes == 0 || taboff - 2*4 < dataoff
+	 || pread_full(fd, skiphdr, 2*4, taboff - 2*4) != 2*4
+	 || get_le32(skiphdr) != SEEKABLE_SKIPPABLE_MAGIC
+	 || get_le32(skiphdr + 4) != tabsz + SEEKABLE_FOOTER_LEN)
 	{
-		errno = EINVAL;
-		return -1;
+		return 0;
 	}
-	char compressed_chunk_buf[0x10000];
-	memset(compressed_chunk_buf, 0, sizeof(compressed_chunk_buf));
-	off_t off_begin = ((uint64_t*)cstream->idx)[chunk_no];
-	off_t off_end = ((uint64_t*)cstream->idx)[chunk_no + 1];
-	if (off_end <= off_begin)
+	unsigned char* tab = (unsigned char*)malloc(tabsz);
+	if (!tab)
 	{
-		errno = EFAULT;
+		errno = ENOMEM;
 		return -1;
 	}
-	size_t compressed_chunk_len = off_end - off_begin;
-	if (compressed_chunk_len > 0x10000)
+	if (pread_full(fd, tab, tabsz, taboff) != (size_t)tabsz)
 	{
+		free(tab);
 		errno = EFAULT;
 		return -1;
 	}
-	fseeko(cstream->stream, off_begin , SEEK_SET);
-	cstream->bufoff = chunk_no*cstream->chlen;
-	int rs = fread((void *)compressed_chunk_buf, 1, compressed_chunk_len,
-			cstream->stream);
-	if (rs != compressed_chunk_len)
+	uint32_t chlen = get_le32(tab + 4);
+	size_t mcnt = (nframes + SEEKABLE_MEMBER_FRAMES - 1)/SEEKABLE_MEMBER_FRAMES;
+	CFINDEX* idx = NULL;
+	if (chlen == 0 || chlen > 0xffff
+	 || !(idx = cfindex_alloc(mcnt, nframes, &cstream->idxsz)))
 	{
-		errno = EFAULT;
+		free(tab);
+		errno = chlen == 0 || chlen > 0xffff ? ENOSYS : ENOMEM;
 		return -1;
 	}
-	if( inflateInit2(&cstream->zst, -MAX_WBITS) != Z_OK)
+	idx->mchcnt = SEEKABLE_MEMBER_FRAMES;
+	uint64_t off = dataoff, size = 0;
+	uint32_t rel = 0;
+	size_t i;
+	for (i = 0; i < nframes; ++i)
 	{
-		errno = EFAULT;
-		return -1;
+		uint32_t clen = get_le32(tab + i*esz);
+		uint32_t dlen = get_le32(tab + i*esz + 4);
+		if (clen == 0 || clen > 0xffff || dlen == 0 || dlen > chlen
+		 || (dlen != chlen && i != nframes - 1))
+		{
+			free(tab);
+			cfindex_release(idx);
+			cstream->idxsz = 0;
+			errno = ENOSYS;
+			return -1;
+		}
+		if (i % SEEKABLE_MEMBER_FRAMES == 0)
+		{
+			idx->mbase[i/SEEKABLE_MEMBER_FRAMES] = off;
+			idx->mfirst[i/SEEKABLE_MEMBER_FRAMES] = i;
+			rel = 0;
+		}
+		if (i % CFINDEX_BLOCK == 0)
+			idx->block[i/CFINDEX_BLOCK] = rel;
+		idx->lens[i] = clen;
+		rel += clen;
+		off += clen;
+		size += dlen;
 	}
-	cstream->zst.avail_in = rs;
-	cstream->zst.avail_out = cstream->chlen;
-	cstream->zst.next_in = (Bytef *)compressed_chunk_buf;
-	cstream->zst.next_out = (Bytef *)cstream->buf;
-	size_t old_total_out = cstream->zst.total_out;
-	rs = inflate(&cstream->zst, Z_FULL_FLUSH);
-	if (rs != Z_OK && rs != Z_STREAM_END)
+	free(tab);
+	if (off > (uint64_t)(taboff - 2*4))
 	{
+		cfindex_release(idx);
+		cstream->idxsz = 0;
 		errno = EFAULT;
 		return -1;
 	}
-	cstream->bufsz = cstream->zst.total_out - old_total_out;
-	inflateEnd(&cstream->zst);
-	if (rs == Z_STREAM_END)
-	{
-		cstream->zst.zalloc    = NULL;
-		cstream->zst.zfree     = Z_NULL;
-		cstream->zst.opaque    = Z_NULL;
-		cstream->zst.avail_in  = 0;
-		cstream->zst.avail_out = 0;
-		cstream->zst.total_in  = 0;
-		cstream->zst.total_out = 0;
-		cstream->zst.next_in   = 0;
-		cstream->zst.next_out  = 0;
-	}
+	cstream->stream = stream;
+	cstream->compression = method;
+	cstream->chlen = chlen;
+	cstream->size = size;
+	cstream->idx = idx;
 	return 1;
 }
 
-size_t  getsz(FILE* file)
+/**@brief Length of the LZ4 frame header at the beginning of the stream
+ * @return 0 if blocks are dependent or the frame is not supported, -1
+ * on error*/
+off_t
+get_lz4_header_len(FILE* stream)
 {
-	off_t curr = ftello(file);
-	if (fseeko(file, 0, SEEK_END) != 0)
-		return 0;
-	size_t sz = (size_t)ftello(file);
-	if (fseeko(file, curr, SEEK_SET) != 0)
+	unsigned char hdr[6];
+	if (pread_full(fileno(stream), hdr, sizeof(hdr), 0) != sizeof(hdr))
+		return -1;
+	const unsigned char flg = hdr[4];
+	const unsigned char bd = hdr[5];
+	/* version 01, independent blocks, blocks up to 64K*/
+	if ((flg & 0xc0) != 0x40 || !(flg & 0x20) || ((bd >> 4) & 0x07) != 4)
 		return 0;
-	return sz;
+	return 4 + 2 + (flg & 0x08 ? 8 : 0) + (flg & 0x01 ? 4 : 0) + 1;
 }
 
-/**@brief Init CFILE* from stdio FILE*
+/**@brief Size of the cache slot (max chunk length)*/
+#define CFCACHE_SLOT_LEN 0x10000
+
+typedef struct
+{
+	uint64_t file[3]; //!< device, inode, mtime (ns)
+	uint64_t chunk;
+} CFCACHE_KEY;
+
+typedef struct
+{
+	CFCACHE_KEY key;
+	int32_t     next;  //!< next slot in the bucket chain, -1 - last
+	uint32_t    len;   //!< chunk length, 0 - the slot is free
+	int         ref;   //!< CLOCK reference bit
+} CFCACHE_SLOT;
+
+/**@brief Independently locked part of the cache*/
+typedef struct
+{
+	pthread_mutex_t lock;
+	size_t          nslots;
+	size_t          hand;     //!< CLOCK hand
+	size_t          bmask;    //!< buckets count - 1
+	int32_t*        buckets;  //!< heads of the chains, -1 - empty
+	CFCACHE_SLOT*   slots;
+	char*           data;     //!< nslots*CFCACHE_SLOT_LEN
+	size_t          used;
+	uint64_t        hits;
+	uint64_t        misses;
+	uint64_t        evictions;
+} __attribute__((aligned(64))) CFCACHE_SHARD;
+
+/**@brief Decompressed chunks cache
  *
- * Scan file and make index*/
-CFILE*
-cfinit(FILE* stream)
+ * Chunks are keyed by the compressed file identity (device, inode and
+ * modification time) and the chunk number, so handles of the same file
+ * share chunks, even if they were opened independently. The cache is
+ * split into a power of two shards by the key hash. Every shard has its
+ * own mutex, hash table and fixed CFCACHE_SLOT_LEN slots replaced with
+ * CLOCK (second chance), so threads reading different chunks rarely
+ * contend and a hit costs a lock and a chunk copy into the handle
+ * buffer. Slots memory is allocated once, pages are touched on the
+ * first use.*/
+struct CFCACHE
 {
-	if (stream == NULL)
+	size_t         shmask;
+	CFCACHE_SHARD* shards;
+};
+
+static uint64_t
+cfcache_hash(const CFCACHE_KEY* key)
+{
+	uint64_t h = key->chunk;
+	size_t i;
+	for (i = 0; i < 3; ++i)
+	{
+		h ^= key->file[i] + 0x9e3779b97f4a7c15ULL + (h << 6) + (h >> 2);
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+		h ^= h >> 31;
+	}
+	return h;
+}
+
+/**@brief Create the cache
+ * @param budget memory for the chunks in bytes (one 64K slot per chunk)
+ * @param shards count of independently locked parts (rounded up to a
+ *        power of two), 0 - default (16)
+ * @return NULL on error*/
+CFCACHE*
+cfcache_create(size_t budget, size_t shards)
+{
+	size_t nshards = 1, i, j;
+	if (shards == 0)
+		shards = 16;
+	while (nshards < shards)
+		nshards <<= 1;
+	size_t nslots = budget/CFCACHE_SLOT_LEN/nshards;
+	if (nslots == 0)
+	{
+		errno = EINVAL;
 		return NULL;
-	off_t initial_pos = ftello(stream);
-	if (initial_pos == -1)
+	}
+	CFCACHE* cache = (CFCACHE*)calloc(1, sizeof(CFCACHE));
+	void* mem = NULL;
+	if (!cache || posix_memalign(&mem, 64, nshards*sizeof(CFCACHE_SHARD)))
+	{
+		free(cache);
+		errno = ENOMEM;
 		return NULL;
-	CFILE* cstream = (CFILE*)malloc(sizeof(CFILE));
-	memset(cstream, 0, sizeof(CFILE));
-	cstream->compression = get_compression(stream);
-	cstream->need_close = 0;
-	switch(cstream->compression)
+	}
+	memset(mem, 0, nshards*sizeof(CFCACHE_SHARD));
+	cache->shards = (CFCACHE_SHARD*)mem;
+	cache->shmask = nshards - 1;
+	size_t nbuckets = 1;
+	while (nbuckets < nslots)
+		nbuckets <<= 1;
+	for (i = 0; i < nshards; ++i)
 	{
-		case GZIP:
-			/* first try to build dictzip index, on failure
-			   fall down to gzip*/
-			if (init_dictzip(stream, cstream) != 1)
-			{
-				/* standard GZIP is not implemented yet*/
-				free(cstream);
-				cstream = NULL;
-				errno = ENOSYS;
-			}
-			break;
-		case NONE:
-			cstream->stream = stream;
-			cstream->size = getsz(stream);
-			if (cstream->size == 0 && errno != 0)
-				return NULL;
-			break;
-		default:
-			break;
+		CFCACHE_SHARD* sh = &cache->shards[i];
+		pthread_mutex_init(&sh->lock, NULL);
+		sh->nslots = nslots;
+		sh->bmask = nbuckets - 1;
+		sh->buckets = (int32_t*)malloc(nbuckets*sizeof(int32_t));
+		sh->slots = (CFCACHE_SLOT*)calloc(nslots, sizeof(CFCACHE_SLOT));
+		sh->data = (char*)malloc(nslots*CFCACHE_SLOT_LEN);
+		if (!sh->buckets || !sh->slots || !sh->data)
+		{
+			cache->shmask = i;
+			cfcache_destroy(cache);
+			errno = ENOMEM;
+			return NULL;
+		}
+		for (j = 0; j < nbuckets; ++j)
+			sh->buckets[j] = -1;
 	}
-	if (cstream != NULL)
-		cstream->init_magic = INITIALIZED;
-	fseeko(stream, initial_pos, SEEK_SET);
-	return cstream;
+	return cache;
 }
 
-/**@brief Close cfile and clear resources*/
+/**@brief Free the cache
+ * @note handles must not use the cache after that (see cfsetcache)*/
 void
-cfclose(CFILE** cstream)
+cfcache_destroy(CFCACHE* cache)
 {
-	if ((*cstream))
+	if (!cache)
+		return;
+	size_t i;
+	for (i = 0; i <= cache->shmask; ++i)
 	{
-		if ((*cstream)->idx)
-			free((*cstream)->idx);
+		CFCACHE_SHARD* sh = &cache->shards[i];
+		pthread_mutex_destroy(&sh->lock);
+		free(sh->buckets);
+		free(sh->slots);
+		free(sh->data);
+	}
+	free(cache->shards);
+	free(cache);
+}
+
+/**@brief Get cache counters
+ * @return 0 on success, -1 on error*/
+int
+cfcache_getstats(CFCACHE* cache, struct cfcache_stats* stats)
+{
+	if (!cache || !stats)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	memset(stats, 0, sizeof(struct cfcache_stats));
+	size_t i;
+	for (i = 0; i <= cache->shmask; ++i)
+	{
+		CFCACHE_SHARD* sh = &cache->shards[i];
+		pthread_mutex_lock(&sh->lock);
+		stats->hits += sh->hits;
+		stats->misses += sh->misses;
+		stats->evictions += sh->evictions;
+		stats->slots += sh->nslots;
+		stats->used += sh->used;
+		pthread_mutex_unlock(&sh->lock);
+	}
+	return 0;
+}
+
+/**@brief Find the slot of the key in the locked shard
+ * @return slot number, -1 if there is no such key*/
+static int32_t
+cfcache_find(CFCACHE_SHARD* sh, const CFCACHE_KEY* key, uint64_t hash)
+{
+	int32_t i = sh->buckets[(hash >> 16) & sh->bmask];
+	while (i != -1 && memcmp(&sh->slots[i].key, key, sizeof(*key)) != 0)
+		i = sh->slots[i].next;
+	return i;
+}
+
+static void
+cfcache_key(const CFILE* cstream, size_t chunk_no, CFCACHE_KEY* key)
+{
+	memcpy(key->file, cstream->cache_file, sizeof(key->file));
+	key->chunk = chunk_no;
+}
+
+/**@brief Copy the chunk from the cache into the handle buffer
+ * @return 1 if the chunk was found, 0 otherwise*/
+static int
+cfcache_get(CFILE* cstream, size_t chunk_no)
+{
+	CFCACHE_KEY key;
+	cfcache_key(cstream, chunk_no, &key);
+	uint64_t hash = cfcache_hash(&key);
+	CFCACHE_SHARD* sh = &cstream->cache->shards[hash & cstream->cache->shmask];
+	pthread_mutex_lock(&sh->lock);
+	int32_t i = cfcache_find(sh, &key, hash);
+	if (i == -1)
+	{
+		++sh->misses;
+		pthread_mutex_unlock(&sh->lock);
+		return 0;
+	}
+	CFCACHE_SLOT* slot = &sh->slots[i];
+	slot->ref = 1;
+	memcpy(cstream->buf, sh->data + (size_t)i*CFCACHE_SLOT_LEN, slot->len);
+	cstream->bufoff = chunk_no*cstream->chlen;
+	cstream->bufsz = slot->len;
+	++sh->hits;
+	pthread_mutex_unlock(&sh->lock);
+	return 1;
+}
+
+/**@brief Put the handle buffer (chunk_no) into the cache*/
+static void
+cfcache_put(CFILE* cstream, size_t chunk_no)
+{
+	CFCACHE_KEY key;
+	cfcache_key(cstream, chunk_no, &key);
+	uint64_t hash = cfcache_hash(&key);
+	CFCACHE_SHARD* sh = &cstream->cache->shards[hash & cstream->cache->shmask];
+	pthread_mutex_lock(&sh->lock);
+	/* another handle could put it while we were inflating*/
+	if (cfcache_find(sh, &key, hash) != -1)
+	{
+		pthread_mutex_unlock(&sh->lock);
+		return;
+	}
+	CFCACHE_SLOT* slot;
+	for (;; sh->hand = (sh->hand + 1) % sh->nslots)
+	{
+		slot = &sh->slots[sh->hand];
+		if (!slot->len || !slot->ref)
+			break;
+		slot->ref = 0;
+	}
+	int32_t victim = sh->hand;
+	sh->hand = (sh->hand + 1) % sh->nslots;
+	if (slot->len)
+	{
+		int32_t* link = &sh->buckets[(cfcache_hash(&slot->key) >> 16)
+		                             & sh->bmask];
+		while (*link != victim)
+			link = &sh->slots[*link].next;
+		*link = slot->next;
+		++sh->evictions;
+	}
+	else
+	{
+		++sh->used;
+	}
+	int32_t* head = &sh->buckets[(hash >> 16) & sh->bmask];
+	slot->key = key;
+	slot->len = cstream->bufsz;
+	slot->ref = 0;
+	slot->next = *head;
+	*head = victim;
+	memcpy(sh->data + (size_t)victim*CFCACHE_SLOT_LEN, cstream->buf,
+	       cstream->bufsz);
+	pthread_mutex_unlock(&sh->lock);
+}
+
+/**@brief Attach the handle to the cache (NULL - detach)
+ *
+ * Chunks are looked up in the cache before reading and inflating, and
+ * put there after. The cache is not owned by the handle: it must
+ * outlive all attached handles. Set CSIO_CACHE_MB=<megabytes> in the
+ * environment to attach all handles on cfinit to the process-wide
+ * cache of this size. Uncompressed (NONE) streams are not cached, the
+ * page cache does it.
+ * @return 0 on success, -1 on error (ENOTSUP for NONE streams)*/
+int
+cfsetcache(CFILE* stream, CFCACHE* cache)
+{
+	if (cferror(stream))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (!cache)
+	{
+		stream->cache = NULL;
+		return 0;
+	}
+	if (!is_chunked(stream->compression))
+	{
+		errno = ENOTSUP;
+		return -1;
+	}
+	struct stat st;
+	if (fstat(fileno(stream->stream), &st) != 0)
+		return -1;
+	stream->cache_file[0] = st.st_dev;
+	stream->cache_file[1] = st.st_ino;
+	stream->cache_file[2] = (uint64_t)st.st_mtim.tv_sec*1000000000
+	                      + st.st_mtim.tv_nsec;
+	stream->cache = cache;
+	return 0;
+}
+
+static CFCACHE* global_cache = NULL;
+static pthread_once_t global_cache_once = PTHREAD_ONCE_INIT;
+
+static void
+global_cache_init()
+{
+	const char* env = getenv("CSIO_CACHE_MB");
+	long mb = env ? atol(env) : 0;
+	if (mb > 0)
+		global_cache = cfcache_create((size_t)mb << 20, 0);
+}
+
+/**@brief check stream integrity
+ * @return Non zero on error
+ * @note This function doesn't check error flag, it checks stream
+ * integrity.*/
+int cferror(CFILE* stream)
+{
+	if (stream == NULL)
+		return -1;
+	if (stream->init_magic != INITIALIZED)
+		return -1;
+	if (stream->stream == NULL)
+		return -1;
+	if (ferror(stream->stream))
+		return -1;
+	if (stream->compression == NONE)
+	{
+		return 0;
+	}
+	else if (is_chunked(stream->compression))
+	{
+		if (stream->idx == NULL)
+			return -1;
+		if (stream->idxsz == 0)
+			return -1;
+		if (stream->chlen == 0)
+			return -1;
+		if (stream->size == 0)
+			return -1;
+	}
+	else
+	{
+		return -1;
+	}
+	return 0;
+}
+
+/**@brief pread(2) analogue, that retries on EINTR and short reads
+ * @return count of bytes read (less then count on eof or error)*/
+size_t
+pread_full(int fd, void* buf, size_t count, off_t offset)
+{
+	size_t done = 0;
+	while (done < count)
+	{
+		ssize_t rs = pread(fd, (char*)buf + done, count - done,
+				offset + done);
+		if (rs == -1 && errno == EINTR)
+			continue;
+		if (rs <= 0)
+			break;
+		done += rs;
+	}
+	return done;
+}
+
+/**@brief pread_full, that accounts disk statistics of the handle*/
+size_t
+stream_pread(CFILE* cstream, void* buf, size_t count, off_t offset)
+{
+	if (!cstream->stats)
+		return pread_full(fileno(cstream->stream), buf, count, offset);
+	uint64_t start = now_ns();
+	size_t rs = pread_full(fileno(cstream->stream), buf, count, offset);
+	cstream->stats->disk_ns += now_ns() - start;
+	cstream->stats->disk_bytes += rs;
+	++cstream->stats->disk_reads;
+	return rs;
+}
+
+/**@brief Check pos against the end of the stream
+ *
+ * Uncompressed files may grow after cfopen (a log being written), so
+ * their size is renewed with fstat before the end is reported.
+ * @return 1 if pos is at or after the end*/
+static int
+past_end(CFILE* cstream, off_t pos)
+{
+	if ((uint64_t)pos < cstream->size)
+		return 0;
+	struct stat st;
+	if (cstream->compression != NONE || !cstream->stream
+	 || fstat(fileno(cstream->stream), &st) != 0
+	 || (uint64_t)st.st_size <= cstream->size)
+		return 1;
+	cstream->size = st.st_size;
+	return (uint64_t)pos >= cstream->size;
+}
+
+/**@brief Renew buffer of the uncompressed stream, so pos will be in it
+ *
+ * The window is chlen bytes long and aligned to chlen.
+ * @return 1 on success, -1 on error*/
+int
+fill_buf_none(CFILE* cstream, off_t pos)
+{
+	off_t off = pos - pos % cstream->chlen;
+	size_t len = cstream->size - off < cstream->chlen ?
+	             cstream->size - off : cstream->chlen;
+	cstream->bufsz = 0;
+	if (stream_pread(cstream, cstream->buf, len, off) != len)
+	{
+		errno = EFAULT;
+		return -1;
+	}
+	cstream->bufoff = off;
+	cstream->bufsz = len;
+	return 1;
+}
+
+int fill_buf_chunk(CFILE* cstream, off_t pos);
+
+/**@brief Renew buffer, so pos will be in it
+ * @return 1 on success, -1 on error*/
+int
+fill_buf(CFILE* cstream, off_t pos)
+{
+	if (cferror(cstream))
+		return -1;
+	if (past_end(cstream, pos))
+	{
+		errno = EINVAL;
+		cstream->eof = 1;
+		return -1;
+	}
+	if (pos >= cstream->bufoff)
+	{
+		if(pos - cstream->bufoff < cstream->bufsz)
+		{
+			if (cstream->stats)
+				++cstream->stats->buf_hits;
+			return 1;
+		}
+	}
+	if (cstream->compression != NONE && !is_chunked(cstream->compression))
+	{
+		errno = ENOSYS;
+		return -1;
+	}
+	if (!cstream->buf)
+	{
+		/* most handles of the many opened are never read or are read
+		   with cfread directly (NONE), so the window is lazy*/
+		cstream->buf = (char*)malloc(cstream->chlen);
+		if (!cstream->buf)
+		{
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+	if (!cstream->stats)
+	{
+		if (cstream->compression == NONE)
+			return fill_buf_none(cstream, pos);
+		return fill_buf_chunk(cstream, pos);
+	}
+	++cstream->stats->buf_misses;
+	uint64_t start = now_ns();
+	int rs = cstream->compression == NONE ? fill_buf_none(cstream, pos)
+	                                      : fill_buf_chunk(cstream, pos);
+	cstream->stats->fetch_ns += now_ns() - start;
+	++cstream->stats->fetches;
+	return rs;
+}
+
+static const char* BACKEND_NAMES[] = {"zlib", "libdeflate", "isal"};
+
+/**@brief Check if the backend is compiled in
+ * @return 1 if available, 0 otherwise*/
+int
+cfbackend_available(CFBackend backend)
+{
+	switch (backend)
+	{
+		case CFBACKEND_ZLIB:
+			return 1;
+#ifdef CSIO_WITH_LIBDEFLATE
+		case CFBACKEND_LIBDEFLATE:
+			return 1;
+#endif
+#ifdef CSIO_WITH_ISAL
+		case CFBACKEND_ISAL:
+			return 1;
+#endif
+		default:
+			return 0;
+	}
+}
+
+/**@brief Backend name ("zlib", "libdeflate", "isal"), NULL if unknown*/
+const char*
+cfbackend_name(CFBackend backend)
+{
+	if ((unsigned)backend >= sizeof(BACKEND_NAMES)/sizeof(BACKEND_NAMES[0]))
+		return NULL;
+	return BACKEND_NAMES[backend];
+}
+
+/**@brief Backend by name
+ * @return 0 on success, -1 on unknown name (EINVAL)*/
+int
+cfbackend_parse(const char* name, CFBackend* backend)
+{
+	size_t i;
+	for (i = 0; name && i < sizeof(BACKEND_NAMES)/sizeof(BACKEND_NAMES[0]); ++i)
+	{
+		if (strcmp(name, BACKEND_NAMES[i]) == 0)
+		{
+			*backend = (CFBackend)i;
+			return 0;
+		}
+	}
+	errno = EINVAL;
+	return -1;
+}
+
+/**@brief Free decompressor of the handle backend*/
+static void
+backend_free(CFILE* cstream)
+{
+	if (!cstream->backend_state)
+		return;
+	switch (cstream->backend)
+	{
+#ifdef CSIO_WITH_LIBDEFLATE
+		case CFBACKEND_LIBDEFLATE:
+			libdeflate_free_decompressor(
+				(struct libdeflate_decompressor*)cstream->backend_state);
+			break;
+#endif
+		default:
+			free(cstream->backend_state);
+			break;
+	}
+	cstream->backend_state = NULL;
+}
+
+/**@brief Set inflate implementation of the handle
+ *
+ * Default is zlib or CSIO_BACKEND environment variable (backend name),
+ * if it is set on cfinit. Decompressor state is allocated on the first
+ * chunk read.
+ * @return 0 on success, -1 on error (ENOTSUP if the backend is not
+ * compiled in)*/
+int
+cfsetbackend(CFILE* stream, CFBackend backend)
+{
+	if (cferror(stream))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (!cfbackend_available(backend))
+	{
+		errno = ENOTSUP;
+		return -1;
+	}
+	if (stream->backend != backend)
+		backend_free(stream);
+	stream->backend = backend;
+	return 0;
+}
+
+/**@brief Inflate the chunk with zlib
+ * @return inflated size, -1 on error*/
+static int
+inflate_zlib(CFILE* cstream, char* in, size_t insz)
+{
+	if( inflateInit2(&cstream->zst, -MAX_WBITS) != Z_OK)
+		return -1;
+	cstream->zst.avail_in = insz;
+	cstream->zst.avail_out = cstream->chlen;
+	cstream->zst.next_in = (Bytef *)in;
+	cstream->zst.next_out = (Bytef *)cstream->buf;
+	size_t old_total_out = cstream->zst.total_out;
+	int rs = inflate(&cstream->zst, Z_FULL_FLUSH);
+	if (rs != Z_OK && rs != Z_STREAM_END)
+	{
+		inflateEnd(&cstream->zst);
+		return -1;
+	}
+	size_t outsz = cstream->zst.total_out - old_total_out;
+	inflateEnd(&cstream->zst);
+	if (rs == Z_STREAM_END)
+	{
+		cstream->zst.zalloc    = NULL;
+		cstream->zst.zfree     = Z_NULL;
+		cstream->zst.opaque    = Z_NULL;
+		cstream->zst.avail_in  = 0;
+		cstream->zst.avail_out = 0;
+		cstream->zst.total_in  = 0;
+		cstream->zst.total_out = 0;
+		cstream->zst.next_in   = 0;
+		cstream->zst.next_out  = 0;
+	}
+	return outsz;
+}
+
+#ifdef CSIO_WITH_LIBDEFLATE
+/**@brief Inflate the chunk with libdeflate
+ *
+ * libdeflate needs the complete deflate stream, but chunks end with the
+ * full flush, not with the final block. So the empty final block is
+ * appended (in must have EMPTY_FINISH_BLOCK_LEN spare bytes).
+ * @return inflated size, -1 on error*/
+static int
+inflate_libdeflate(CFILE* cstream, char* in, size_t insz)
+{
+	if (!cstream->backend_state)
+		cstream->backend_state = libdeflate_alloc_decompressor();
+	if (!cstream->backend_state)
+		return -1;
+	in[insz++] = 0x03;
+	in[insz++] = 0x00;
+	size_t outsz;
+	if (libdeflate_deflate_decompress_ex(
+	        (struct libdeflate_decompressor*)cstream->backend_state,
+	        in, insz, cstream->buf, cstream->chlen, NULL, &outsz)
+	    != LIBDEFLATE_SUCCESS)
+	{
+		return -1;
+	}
+	return outsz;
+}
+#endif
+
+#ifdef CSIO_WITH_ISAL
+/**@brief Inflate the chunk with ISA-L
+ * @return inflated size, -1 on error*/
+static int
+inflate_isal(CFILE* cstream, char* in, size_t insz)
+{
+	struct inflate_state* st = (struct inflate_state*)cstream->backend_state;
+	if (!st)
+	{
+		st = (struct inflate_state*)malloc(sizeof(struct inflate_state));
+		if (!st)
+			return -1;
+		isal_inflate_init(st);
+		cstream->backend_state = st;
+	}
+	else
+	{
+		isal_inflate_reset(st);
+	}
+	st->crc_flag = ISAL_DEFLATE;
+	st->next_in = (uint8_t*)in;
+	st->avail_in = insz;
+	st->next_out = (uint8_t*)cstream->buf;
+	st->avail_out = cstream->chlen;
+	if (isal_inflate(st) != ISAL_DECOMP_OK)
+		return -1;
+	return st->total_out;
+}
+#endif
+
+#ifdef CSIO_WITH_ZSTD
+/**@brief Decompress zstd frame
+ * @return decompressed size, -1 on error*/
+static int
+decompress_zstd(CFILE* cstream, const char* in, size_t insz)
+{
+	if (!cstream->codec_state)
+		cstream->codec_state = ZSTD_createDCtx();
+	if (!cstream->codec_state)
+		return -1;
+	size_t rs = ZSTD_decompressDCtx((ZSTD_DCtx*)cstream->codec_state,
+			cstream->buf, cstream->chlen, in, insz);
+	if (ZSTD_isError(rs))
+		return -1;
+	return rs;
+}
+#endif
+
+#ifdef CSIO_WITH_LZ4
+/**@brief Decompress LZ4 block (with the block size)
+ * @return decompressed size, -1 on error*/
+static int
+decompress_lz4(CFILE* cstream, const char* in, size_t insz)
+{
+	if (insz < 4)
+		return -1;
+	uint32_t bsize = get_le32((const unsigned char*)in);
+	uint32_t datasz = bsize & ~LZ4_BLOCK_UNCOMPRESSED;
+	if (datasz > insz - 4)
+		return -1;
+	if (bsize & LZ4_BLOCK_UNCOMPRESSED)
+	{
+		if (datasz > cstream->chlen)
+			return -1;
+		memcpy(cstream->buf, in + 4, datasz);
+		return datasz;
+	}
+	int rs = LZ4_decompress_safe(in + 4, cstream->buf, datasz,
+			cstream->chlen);
+	return rs < 0 ? -1 : rs;
+}
+#endif
+
+/**@brief Inflate dictzip chunk with the handle backend
+ * @return inflated size, -1 on error*/
+static int
+inflate_chunk(CFILE* cstream, char* in, size_t insz)
+{
+	switch (cstream->backend)
+	{
+#ifdef CSIO_WITH_LIBDEFLATE
+		case CFBACKEND_LIBDEFLATE:
+			return inflate_libdeflate(cstream, in, insz);
+#endif
+#ifdef CSIO_WITH_ISAL
+		case CFBACKEND_ISAL:
+			return inflate_isal(cstream, in, insz);
+#endif
+		default:
+			return inflate_zlib(cstream, in, insz);
+	}
+}
+
+/**@brief Free decompression context of the compression method*/
+static void
+codec_free(CFILE* cstream)
+{
+	if (!cstream->codec_state)
+		return;
+#ifdef CSIO_WITH_ZSTD
+	if (cstream->compression == ZSTD_SEEKABLE)
+		ZSTD_freeDCtx((ZSTD_DCtx*)cstream->codec_state);
+#endif
+	cstream->codec_state = NULL;
+}
+
+/**@brief Decompress the chunk with the method of the handle into its
+ * buffer
+ * @return decompressed size, -1 on error*/
+static int
+decompress_chunk(CFILE* cstream, char* in, size_t insz)
+{
+	switch (cstream->compression)
+	{
+#ifdef CSIO_WITH_ZSTD
+		case ZSTD_SEEKABLE:
+			return decompress_zstd(cstream, in, insz);
+#endif
+#ifdef CSIO_WITH_LZ4
+		case LZ4_SEEKABLE:
+			return decompress_lz4(cstream, in, insz);
+#endif
+		case DICTZIP:
+			return inflate_chunk(cstream, in, insz);
+		default:
+			return -1;
+	}
+}
+
+/**@brief Read and decompress chunk (dictzip chunk, zstd frame or LZ4
+ * block) with pos
+ * @return 1 on success, -1 on error*/
+int
+fill_buf_chunk(CFILE* cstream, off_t pos)
+{
+	size_t chunk_no = pos/cstream->chlen;
+	if (cstream->cache && cfcache_get(cstream, chunk_no))
+	{
+		if (cstream->stats)
+			++cstream->stats->cache_hits;
+		return 1;
+	}
+	off_t off_begin;
+	size_t compressed_chunk_len;
+	if (cfindex_chunk(cstream->idx, chunk_no,
+	                  &off_begin, &compressed_chunk_len) != 1)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	char compressed_chunk_buf[0x10000 + EMPTY_FINISH_BLOCK_LEN];
+	if (compressed_chunk_len == 0)
+	{
+		errno = EFAULT;
+		return -1;
+	}
+	cstream->bufsz = 0;
+	cstream->bufoff = chunk_no*cstream->chlen;
+	int rs = stream_pread(cstream, compressed_chunk_buf,
+			compressed_chunk_len, off_begin);
+	if (rs != compressed_chunk_len)
+	{
+		errno = EFAULT;
+		return -1;
+	}
+	uint64_t start = cstream->stats ? now_ns() : 0;
+	rs = decompress_chunk(cstream, compressed_chunk_buf, rs);
+	if (rs < 0)
+	{
+		errno = EFAULT;
+		return -1;
+	}
+	cstream->bufsz = rs;
+	if (cstream->stats)
+	{
+		cstream->stats->inflate_ns += now_ns() - start;
+		++cstream->stats->inflates;
+	}
+	if (cstream->cache)
+		cfcache_put(cstream, chunk_no);
+	return 1;
+}
+
+size_t  getsz(FILE* file)
+{
+	off_t curr = ftello(file);
+	if (fseeko(file, 0, SEEK_END) != 0)
+		return 0;
+	size_t sz = (size_t)ftello(file);
+	if (fseeko(file, curr, SEEK_SET) != 0)
+		return 0;
+	return sz;
+}
+
+/**@brief Apply environment defaults (CSIO_STATS, CSIO_BACKEND,
+ * CSIO_CACHE_MB) to the initialized handle
+ * @param start - time of the init start for the statistics (0 - stats
+ * are not wanted)*/
+static void
+init_defaults(CFILE* cstream, uint64_t start)
+{
+	cstream->init_magic = INITIALIZED;
+	if (start && cfsetstats(cstream, 1) == 0)
+		cstream->stats->index_ns = now_ns() - start;
+	const char* env_backend = getenv("CSIO_BACKEND");
+	CFBackend backend;
+	if (env_backend && cfbackend_parse(env_backend, &backend) == 0)
+		cfsetbackend(cstream, backend);
+	pthread_once(&global_cache_once, global_cache_init);
+	if (global_cache && is_chunked(cstream->compression))
+		cfsetcache(cstream, global_cache);
+}
+
+/**@brief Scan the stream and init zeroed handle memory (see cfinit)
+ * @return 0 on success, -1 on error*/
+static int
+init_stream(FILE* stream, CFILE* cstream)
+{
+	off_t initial_pos = ftello(stream);
+	if (initial_pos == -1)
+		return -1;
+	const char* env_stats = getenv("CSIO_STATS");
+	int want_stats = env_stats && *env_stats && strcmp(env_stats, "0") != 0;
+	uint64_t start = want_stats ? now_ns() : 0;
+	int rs = 0;
+	cstream->compression = get_compression(stream);
+	cstream->need_close = 0;
+	switch(cstream->compression)
+	{
+		case GZIP:
+			/* first try to build dictzip index, on failure
+			   fall down to gzip*/
+			if (init_dictzip(stream, cstream) != 1
+			 && init_trailer(stream, cstream) != 1)
+			{
+				/* standard GZIP is not implemented yet*/
+				rs = -1;
+				errno = ENOSYS;
+			}
+			break;
+		case ZSTD_SEEKABLE:
+#ifdef CSIO_WITH_ZSTD
+			if (init_seekable(stream, cstream, ZSTD_SEEKABLE, 0) == 1)
+				break;
+#endif
+			/* zstd streams without the seek table are not
+			   supported*/
+			rs = -1;
+			errno = ENOSYS;
+			break;
+		case LZ4_SEEKABLE: {
+#ifdef CSIO_WITH_LZ4
+			off_t dataoff = get_lz4_header_len(stream);
+			if (dataoff > 0 && init_seekable(stream, cstream,
+			                                 LZ4_SEEKABLE, dataoff) == 1)
+				break;
+#endif
+			rs = -1;
+			errno = ENOSYS;
+			} break;
+		case NONE:
+			/* stdio is used only to get the descriptor, all reads
+			   are done with pread(2) into the window buffer or
+			   directly into the user memory*/
+			cstream->stream = stream;
+			cstream->size = getsz(stream);
+			if (cstream->size == 0 && errno != 0)
+				rs = -1;
+			cstream->chlen = NONE_WINDOW_LEN;
+			cstream->currpos = initial_pos;
+			break;
+		default:
+			break;
+	}
+	if (rs == 0)
+		init_defaults(cstream, start);
+	fseeko(stream, initial_pos, SEEK_SET);
+	return rs;
+}
+
+/**@brief Init CFILE* from stdio FILE*
+ *
+ * Scan file and make index*/
+CFILE*
+cfinit(FILE* stream)
+{
+	if (stream == NULL)
+		return NULL;
+	CFILE* cstream = (CFILE*)malloc(sizeof(CFILE));
+	if (!cstream)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(cstream, 0, sizeof(CFILE));
+	if (init_stream(stream, cstream) != 0)
+	{
+		free(cstream);
+		return NULL;
+	}
+	return cstream;
+}
+
+/**@brief Open one more handle to the same stream
+ *
+ * The new handle has its own position, buffer and inflate state, but
+ * shares the chunk index with the source. The descriptor is duplicated,
+ * so both handles may be used from different threads.*/
+CFILE*
+cfdup(CFILE* stream)
+{
+	if (cferror(stream))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	int fd = dup(fileno(stream->stream));
+	if (fd == -1)
+		return NULL;
+	FILE* dupstream = fdopen(fd, "rb");
+	if (!dupstream)
+	{
+		close(fd);
+		return NULL;
+	}
+	CFILE* rs = (CFILE*)malloc(sizeof(CFILE));
+	if (!rs)
+	{
+		fclose(dupstream);
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(rs, 0, sizeof(CFILE));
+	rs->stream = dupstream;
+	rs->need_close = 1;
+	rs->compression = stream->compression;
+	rs->chlen = stream->chlen;
+	rs->size = stream->size;
+	rs->idx = cfindex_ref(stream->idx);
+	rs->idxsz = stream->idxsz;
+	rs->init_magic = INITIALIZED;
+	rs->backend = stream->backend;
+	rs->cache = stream->cache;
+	memcpy(rs->cache_file, stream->cache_file, sizeof(rs->cache_file));
+	return rs;
+}
+
+/**@brief Enable (reset) or disable statistics of the handle
+ *
+ * Statistics are disabled by default, set CSIO_STATS=1 in the
+ * environment to enable it for all handles on cfinit (then index build
+ * time is accounted too). When disabled the only overhead is a pointer
+ * check in fill_buf and read paths.
+ * @note bytes served by the inline cfgetc() from the current window
+ * bypass the library, so they are not in delivered_bytes and buf_hits.
+ * @return 0 on success, -1 on error*/
+int
+cfsetstats(CFILE* stream, int enable)
+{
+	if (cferror(stream))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (!enable)
+	{
+		free(stream->stats);
+		stream->stats = NULL;
+		return 0;
+	}
+	if (!stream->stats)
+	{
+		stream->stats = (struct cfstats*)malloc(sizeof(struct cfstats));
+		if (!stream->stats)
+		{
+			errno = ENOMEM;
+			return -1;
+		}
+	}
+	memset(stream->stats, 0, sizeof(struct cfstats));
+	return 0;
+}
+
+/**@brief Get statistics of the handle
+ * @return 0 on success, -1 on error (ENOENT if statistics are disabled)*/
+int
+cfgetstats(CFILE* stream, struct cfstats* stats)
+{
+	if (cferror(stream) || !stats)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (!stream->stats)
+	{
+		memset(stats, 0, sizeof(struct cfstats));
+		errno = ENOENT;
+		return -1;
+	}
+	*stats = *stream->stats;
+	return 0;
+}
+
+/**@brief Get memory used by the handle
+ *
+ * The index is shared by cfdup handles, so it is accounted in all of
+ * them. zlib inflate state exists only while a chunk is inflated.
+ * @return 0 on success, -1 on error*/
+int
+cfgetmem(CFILE* stream, struct cfmemstats* mem)
+{
+	if (cferror(stream) || !mem)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	memset(mem, 0, sizeof(struct cfmemstats));
+	mem->handle = sizeof(CFILE);
+	mem->buffer = stream->buf ? stream->chlen : 0;
+	mem->index = stream->idxsz;
+	if (stream->idx && stream->idx->lines)
+		mem->index += stream->idx->lines->memsz;
+	if (stream->idx && stream->idx->blooms)
+		mem->index += sizeof(CFBLOOMS);
+	mem->stats = stream->stats ? sizeof(struct cfstats) : 0;
+#ifdef CSIO_WITH_ISAL
+	if (stream->backend == CFBACKEND_ISAL && stream->backend_state)
+		mem->codec += sizeof(struct inflate_state);
+#endif
+#ifdef CSIO_WITH_ZSTD
+	if (stream->compression == ZSTD_SEEKABLE && stream->codec_state)
+		mem->codec += ZSTD_sizeof_DCtx((ZSTD_DCtx*)stream->codec_state);
+#endif
+	mem->total = mem->handle + mem->buffer + mem->index + mem->stats
+	           + mem->codec;
+	return 0;
+}
+
+/**@brief Free window, decompressors and statistics of the handle*/
+static void
+free_state(CFILE* cstream)
+{
+	backend_free(cstream);
+	codec_free(cstream);
+	free(cstream->buf);
+	free(cstream->stats);
+	cstream->buf = NULL;
+	cstream->stats = NULL;
+}
+
+/**@brief Close cfile and clear resources*/
+void
+cfclose(CFILE** cstream)
+{
+	if ((*cstream))
+	{
+		if ((*cstream)->idx)
+			cfindex_release((*cstream)->idx);
 		if ((*cstream)->need_close)
 			if ((*cstream)->stream)
 				fclose((*cstream)->stream);
 		if ((*cstream)->compression == DICTZIP)
 			inflateEnd(&(*cstream)->zst);
+		free_state(*cstream);
 		clear((*cstream));
 		free((*cstream));
 	}
 	(*cstream) = NULL;
 }
 
+/**@brief Cached index of a recently opened file*/
+typedef struct
+{
+	uint64_t          file[4]; //!< device, inode, size, mtime (ns)
+	CFINDEX*          idx;     //!< NULL - the entry is empty
+	size_t            idxsz;
+	CompressionMethod compression;
+	uint16_t          chlen;
+	uint64_t          size;
+} CFPOOL_INDEX;
+
+/**@brief Pool of closed handles and cache of indexes
+ *
+ * Closed handles keep their window, decompressor states and statistics
+ * memory, cfpool_open takes them back and reuses the memory if the new
+ * stream has the same chunk length (backend, compression method). The
+ * index cache is direct mapped by the file identity hash: a collision
+ * replaces the older entry. All operations take the pool mutex for a
+ * few pointer moves only, files are opened and scanned outside it.*/
+struct CFPOOL
+{
+	pthread_mutex_t lock;
+	CFILE**         free;
+	size_t          nfree;
+	size_t          maxfree;
+	CFPOOL_INDEX*   indexes;
+	size_t          nindexes; //!< power of two or 0 - no cache
+	struct cfpool_stats st;
+};
+
+/**@brief Create pool of handles
+ *
+ * @param handles - max count of closed handles kept for reuse
+ * @param indexes - index cache size, rounded up to the power of two (0 -
+ * indexes are not cached)
+ * @return NULL on error*/
+CFPOOL*
+cfpool_create(size_t handles, size_t indexes)
+{
+	CFPOOL* pool = (CFPOOL*)malloc(sizeof(CFPOOL));
+	if (!pool)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(pool, 0, sizeof(CFPOOL));
+	size_t n = 0;
+	if (indexes > 0)
+		for (n = 1; n < indexes; n <<= 1);
+	pool->maxfree = handles;
+	pool->nindexes = n;
+	pool->free = (CFILE**)malloc((handles ? handles : 1)*sizeof(CFILE*));
+	pool->indexes = (CFPOOL_INDEX*)calloc(n ? n : 1, sizeof(CFPOOL_INDEX));
+	if (!pool->free || !pool->indexes
+	 || pthread_mutex_init(&pool->lock, NULL) != 0)
+	{
+		free(pool->free);
+		free(pool->indexes);
+		free(pool);
+		errno = ENOMEM;
+		return NULL;
+	}
+	return pool;
+}
+
+/**@brief Destroy the pool (handles opened from it stay valid and must
+ * be closed with cfclose)*/
+void
+cfpool_destroy(CFPOOL* pool)
+{
+	if (!pool)
+		return;
+	size_t i;
+	for (i = 0; i < pool->nfree; ++i)
+	{
+		free_state(pool->free[i]);
+		free(pool->free[i]);
+	}
+	for (i = 0; i < pool->nindexes; ++i)
+		cfindex_release(pool->indexes[i].idx);
+	pthread_mutex_destroy(&pool->lock);
+	free(pool->free);
+	free(pool->indexes);
+	free(pool);
+}
+
+/**@brief Get counters of the pool
+ * @return 0 on success, -1 on error*/
+int
+cfpool_getstats(CFPOOL* pool, struct cfpool_stats* stats)
+{
+	if (!pool || !stats)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	pthread_mutex_lock(&pool->lock);
+	*stats = pool->st;
+	stats->free = pool->nfree;
+	pthread_mutex_unlock(&pool->lock);
+	return 0;
+}
+
+static CFPOOL_INDEX*
+cfpool_index(CFPOOL* pool, const uint64_t* file)
+{
+	uint64_t h = 0;
+	size_t i;
+	for (i = 0; i < 4; ++i)
+		h = (h ^ file[i])*0x100000001b3ULL;
+	return &pool->indexes[(h ^ (h >> 29)) & (pool->nindexes - 1)];
+}
+
+/**@brief Move reusable memory of the pooled handle to the new one*/
+static void
+cfpool_adopt(CFILE* cstream, CFILE* old)
+{
+	if (!cstream->buf && old->buf && old->chlen == cstream->chlen)
+	{
+		cstream->buf = old->buf;
+		old->buf = NULL;
+	}
+	if (!cstream->backend_state && old->backend == cstream->backend)
+	{
+		cstream->backend_state = old->backend_state;
+		old->backend_state = NULL;
+	}
+	if (!cstream->codec_state && old->compression == cstream->compression)
+	{
+		cstream->codec_state = old->codec_state;
+		old->codec_state = NULL;
+	}
+	free_state(old);
+}
+
+/**@brief cfopen analogue, that reuses closed handles of the pool and
+ * cached indexes
+ *
+ * The index of a chunked file is cached by its device, inode, size and
+ * modification time, so reopening the same unchanged file doesn't read
+ * anything (not even the header) and only fopen and fstat are done.
+ * The handle must be returned by cfpool_close (cfclose works too, but
+ * the memory is not reused then).
+ * @return NULL on error*/
+CFILE*
+cfpool_open(CFPOOL* pool, const char* name)
+{
+	if (!pool || !name)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	FILE* stream = fopen(name, "rb");
+	if (!stream)
+		return NULL;
+	struct stat st;
+	if (fstat(fileno(stream), &st) != 0)
+	{
+		fclose(stream);
+		return NULL;
+	}
+	uint64_t file[4] = {st.st_dev, st.st_ino, st.st_size,
+		(uint64_t)st.st_mtim.tv_sec*1000000000 + st.st_mtim.tv_nsec};
+	CFILE old;
+	memset(&old, 0, sizeof(CFILE));
+	CFILE* cstream = NULL;
+	CFPOOL_INDEX cached;
+	memset(&cached, 0, sizeof(cached));
+	pthread_mutex_lock(&pool->lock);
+	++pool->st.opens;
+	if (pool->nfree > 0)
+	{
+		cstream = pool->free[--pool->nfree];
+		++pool->st.reuses;
+	}
+	CFPOOL_INDEX* ent = pool->nindexes ? cfpool_index(pool, file) : NULL;
+	if (ent && ent->idx && memcmp(ent->file, file, sizeof(file)) == 0)
+	{
+		cached = *ent;
+		cached.idx = cfindex_ref(ent->idx);
+		++pool->st.index_hits;
+	}
+	else if (ent)
+	{
+		++pool->st.index_misses;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	if (cstream)
+		old = *cstream;
+	else if (!(cstream = (CFILE*)malloc(sizeof(CFILE))))
+	{
+		cfindex_release(cached.idx);
+		fclose(stream);
+		errno = ENOMEM;
+		return NULL;
+	}
+	memset(cstream, 0, sizeof(CFILE));
+	if (cached.idx)
+	{
+		cstream->stream = stream;
+		cstream->compression = cached.compression;
+		cstream->chlen = cached.chlen;
+		cstream->size = cached.size;
+		cstream->idx = cached.idx;
+		cstream->idxsz = cached.idxsz;
+		const char* env_stats = getenv("CSIO_STATS");
+		init_defaults(cstream,
+			env_stats && *env_stats && strcmp(env_stats, "0") != 0
+			? now_ns() : 0);
+	}
+	else if (init_stream(stream, cstream) != 0)
+	{
+		free_state(&old);
+		free(cstream);
+		fclose(stream);
+		return NULL;
+	}
+	else if (ent && is_chunked(cstream->compression))
+	{
+		pthread_mutex_lock(&pool->lock);
+		CFINDEX* prev = ent->idx;
+		memcpy(ent->file, file, sizeof(file));
+		ent->idx = cfindex_ref(cstream->idx);
+		ent->idxsz = cstream->idxsz;
+		ent->compression = cstream->compression;
+		ent->chlen = cstream->chlen;
+		ent->size = cstream->size;
+		pthread_mutex_unlock(&pool->lock);
+		cfindex_release(prev);
+	}
+	cstream->need_close = 1;
+	cfpool_adopt(cstream, &old);
+	return cstream;
+}
+
+/**@brief Close the handle and return its memory to the pool
+ *
+ * If the pool is full, the handle is closed with cfclose.*/
+void
+cfpool_close(CFPOOL* pool, CFILE** cstream)
+{
+	if (!pool || !*cstream || (*cstream)->init_magic != INITIALIZED)
+	{
+		cfclose(cstream);
+		return;
+	}
+	pthread_mutex_lock(&pool->lock);
+	int keep = pool->nfree < pool->maxfree;
+	pthread_mutex_unlock(&pool->lock);
+	if (!keep)
+	{
+		cfclose(cstream);
+		return;
+	}
+	CFILE* h = *cstream;
+	*cstream = NULL;
+	cfindex_release(h->idx);
+	if (h->need_close && h->stream)
+		fclose(h->stream);
+	h->stream = NULL;
+	h->idx = NULL;
+	h->idxsz = 0;
+	h->cache = NULL;
+	h->init_magic = 0;
+	pthread_mutex_lock(&pool->lock);
+	if (pool->nfree < pool->maxfree)
+	{
+		pool->free[pool->nfree++] = h;
+		h = NULL;
+	}
+	pthread_mutex_unlock(&pool->lock);
+	if (h)
+	{
+		free_state(h);
+		free(h);
+	}
+}
+
 /**@brief Check for End of file*/
 int
 cfeof(CFILE* cstream)
 {
-	if (cstream->compression == NONE)
-		return feof(cstream->stream);
 	if (cferror(cstream))
 		return 1;
-	else if (cstream->compression == DICTZIP)
+	else if (is_chunked(cstream->compression)
+	      || cstream->compression == NONE)
 		return cstream->eof;
 	return 1;
 }
@@ -516,30 +2226,448 @@ cfseeko(CFILE* stream, off_t offset, int mode)
 {
 	if(!stream)
 		return -1;
-	if (stream->compression == DICTZIP)
+	if (is_chunked(stream->compression) || stream->compression == NONE)
 	{
-		stream->eof = 0;
+		off_t newpos = stream->currpos;
 		switch (mode)
 		{
-			case SEEK_SET: stream->currpos = offset; break;
-			case SEEK_CUR: stream->currpos += offset; break;
-			case SEEK_END: stream->currpos =
-			               stream->size + offset < stream->size ?
-			                   stream->size + offset : stream->size;
+			case SEEK_SET: newpos = offset; break;
+			case SEEK_CUR: newpos += offset; break;
+			case SEEK_END: past_end(stream, stream->size);
+			               newpos =
+			               stream->size + offset < stream->size ?
+			                   stream->size + offset : stream->size;
+		}
+		if (newpos < 0)
+		{
+			errno = EINVAL;
+			return -1;
+		}
+		if (stream->stats)
+			++stream->stats->seeks;
+		stream->currpos = newpos;
+		stream->eof = 0;
+		if(stream->currpos >= stream->size)
+			stream->eof = 1;
+	}
+	else
+	{
+		errno = ENOSYS;
+		return -1;
+	}
+	return 0;
+}
+
+/**@brief Allocate line counts of chcnt chunks (blocks are not filled)*/
+static CFLINES*
+lines_alloc(size_t chcnt)
+{
+	size_t blocks = (chcnt + CFINDEX_BLOCK - 1)/CFINDEX_BLOCK;
+	size_t sz = sizeof(CFLINES)
+	          + (blocks + 1)*sizeof(uint64_t)
+	          + chcnt*sizeof(uint16_t);
+	CFLINES* lines = (CFLINES*)malloc(sz);
+	if (!lines)
+		return NULL;
+	lines->memsz = sz;
+	lines->chcnt = chcnt;
+	lines->block = (uint64_t*)(lines + 1);
+	lines->counts = (uint16_t*)(lines->block + blocks + 1);
+	return lines;
+}
+
+/**@brief Fill block counts from the chunks counts*/
+static void
+lines_sum(CFLINES* lines)
+{
+	uint64_t sum = 0;
+	size_t i;
+	for (i = 0; i < lines->chcnt; ++i)
+	{
+		if (i % CFINDEX_BLOCK == 0)
+			lines->block[i/CFINDEX_BLOCK] = sum;
+		sum += lines->counts[i];
+	}
+	lines->block[(lines->chcnt + CFINDEX_BLOCK - 1)/CFINDEX_BLOCK] = sum;
+}
+
+/**@brief Offset after the last dictzip member (trailer members start
+ * there)*/
+static off_t
+dictzip_end(CFILE* cstream)
+{
+	off_t off;
+	size_t len;
+	if (cfindex_chunk(cstream->idx, cfindex_chunks(cstream->idx) - 1,
+	                  &off, &len) != 1)
+		return -1;
+	return off + len + EMPTY_FINISH_BLOCK_LEN + GZIP_CRC32_LEN + 4;
+}
+
+/**@brief Read up to want bytes of the extra field of the trailer member
+ * (LN, BF) at off
+ * @return size of the member, 0 if there is no trailer member*/
+static size_t
+trailer_read(CFILE* cstream, off_t off, unsigned char* xbuf, size_t want)
+{
+	unsigned char hdr[TRAILER_HEADER_LEN];
+	if (stream_pread(cstream, hdr, sizeof(hdr), off) != sizeof(hdr)
+	 || memcmp(hdr, GZIP_DEFLATE_ID, 3) != 0 || hdr[3] != FEXTRA)
+		return 0;
+	size_t xlen = hdr[10] | hdr[11] << 8;
+	if (want > xlen)
+		want = xlen;
+	if (xlen < 2*2
+	 || stream_pread(cstream, xbuf, want, off + sizeof(hdr)) != want)
+		return 0;
+	return sizeof(hdr) + xlen + TRAILER_TAIL_LEN;
+}
+
+/**@brief Read line counts from LN members after the dictzip data
+ * @return NULL if there are no (valid) LN members*/
+static CFLINES*
+lines_load(CFILE* cstream)
+{
+	size_t chcnt = cfindex_chunks(cstream->idx);
+	off_t off = dictzip_end(cstream);
+	if (off < 0)
+		return NULL;
+	CFLINES* lines = lines_alloc(chcnt);
+	unsigned char* xbuf = (unsigned char*)malloc(0xffff);
+	size_t next = 0, msize;
+	while (lines && xbuf && next < chcnt
+	    && (msize = trailer_read(cstream, off, xbuf, 0xffff)) != 0)
+	{
+		size_t xlen = msize - TRAILER_HEADER_LEN - TRAILER_TAIL_LEN;
+		if (xlen < 2*2 + 2 + 4 + 2 || xbuf[0] != 'L' || xbuf[1] != 'N')
+			break;
+		size_t exlen = xbuf[2] | xbuf[3] << 8;
+		size_t first = get_le32(xbuf + 6);
+		size_t cnt = xbuf[10] | xbuf[11] << 8;
+		if (exlen + 2*2 > xlen || exlen < 2 + 4 + 2 + cnt*2
+		 || xbuf[4] != 1 || xbuf[5] != 0 || first != next
+		 || cnt == 0 || cnt > chcnt - next)
+			break;
+		size_t i;
+		for (i = 0; i < cnt; ++i)
+			lines->counts[next + i] = xbuf[12 + 2*i]
+			                        | xbuf[12 + 2*i + 1] << 8;
+		next += cnt;
+		off += msize;
+	}
+	free(xbuf);
+	if (lines && next < chcnt)
+	{
+		free(lines);
+		return NULL;
+	}
+	if (lines)
+		lines_sum(lines);
+	return lines;
+}
+
+/**@brief Find the n-th (from 1) '\n' in the memory
+ * @return pointer to it or NULL (n is decreased by the count found)*/
+static const char*
+find_newline(const char* p, size_t len, uint64_t* n)
+{
+	const char* end = p + len;
+	while (p < end)
+	{
+		const char* nl = (const char*)memchr(p, '\n', end - p);
+		if (!nl)
+			break;
+		if (--*n == 0)
+			return nl;
+		p = nl + 1;
+	}
+	return NULL;
+}
+
+/**@brief Count newlines of all chunks (decompresses the whole stream)*/
+static CFLINES*
+lines_count(CFILE* cstream)
+{
+	size_t chcnt = cfindex_chunks(cstream->idx);
+	CFLINES* lines = lines_alloc(chcnt);
+	if (!lines)
+		return NULL;
+	size_t i;
+	for (i = 0; i < chcnt; ++i)
+	{
+		if (fill_buf(cstream, (off_t)i*cstream->chlen) != 1)
+		{
+			free(lines);
+			return NULL;
+		}
+		uint64_t n = UINT64_MAX;
+		find_newline(cstream->buf, cstream->bufsz, &n);
+		lines->counts[i] = (uint16_t)(UINT64_MAX - n);
+	}
+	lines_sum(lines);
+	return lines;
+}
+
+/**@brief Line counts of the stream: stored in the index, loaded from LN
+ * members or counted (index is shared, so the first one is kept)*/
+static const CFLINES*
+lines_get(CFILE* cstream)
+{
+	CFINDEX* idx = cstream->idx;
+	if (!idx)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	CFLINES* lines = __atomic_load_n(&idx->lines, __ATOMIC_ACQUIRE);
+	if (lines)
+		return lines;
+	if (cstream->compression == DICTZIP)
+		lines = lines_load(cstream);
+	if (!lines)
+		lines = lines_count(cstream);
+	if (!lines)
+		return NULL;
+	if (!__sync_bool_compare_and_swap(&idx->lines, NULL, lines))
+	{
+		free(lines);
+		lines = idx->lines;
+	}
+	return lines;
+}
+
+/**@brief Set position to the beginning of the line (from 0)
+ *
+ * Chunked streams use newline counts of chunks (LN members written by
+ * dzip --line-index, otherwise they are counted on the first call and
+ * kept in the index), so the seek is a binary search and one chunk
+ * decompression. Uncompressed streams are scanned from the beginning.
+ * Position after the last '\n' is a valid line (at the end of stream,
+ * if the stream ends with '\n').
+ * @return 0 on success, -1 on error (EINVAL - no such line)*/
+int
+cfseekline(CFILE* stream, uint64_t line)
+{
+	if (cferror(stream))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (stream->compression != NONE && !is_chunked(stream->compression))
+	{
+		errno = ENOSYS;
+		return -1;
+	}
+	if (line == 0)
+		return cfseeko(stream, 0, SEEK_SET);
+	off_t pos = 0;
+	uint64_t n = line;
+	if (stream->compression == NONE)
+	{
+		for (;;)
+		{
+			if (past_end(stream, pos))
+			{
+				errno = EINVAL;
+				return -1;
+			}
+			if (fill_buf(stream, pos) != 1)
+				return -1;
+			const char* nl = find_newline(stream->buf, stream->bufsz, &n);
+			if (nl)
+				return cfseeko(stream,
+				               stream->bufoff + (nl - stream->buf) + 1,
+				               SEEK_SET);
+			pos = stream->bufoff + stream->bufsz;
+		}
+	}
+	const CFLINES* lines = lines_get(stream);
+	if (!lines)
+		return -1;
+	size_t blocks = (lines->chcnt + CFINDEX_BLOCK - 1)/CFINDEX_BLOCK;
+	if (line > lines->block[blocks])
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	/* the last block with less then line newlines before it*/
+	size_t lo = 0, hi = blocks;
+	while (hi - lo > 1)
+	{
+		size_t mid = lo + (hi - lo)/2;
+		if (lines->block[mid] < line)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	size_t i = lo*CFINDEX_BLOCK;
+	n -= lines->block[lo];
+	while (n > lines->counts[i])
+		n -= lines->counts[i++];
+	if (fill_buf(stream, (off_t)i*stream->chlen) != 1)
+		return -1;
+	const char* nl = find_newline(stream->buf, stream->bufsz, &n);
+	if (!nl)
+	{
+		errno = EFAULT;
+		return -1;
+	}
+	return cfseeko(stream, stream->bufoff + (nl - stream->buf) + 1,
+	               SEEK_SET);
+}
+
+/**@brief Bit positions of the n-gram in the filter of fsize bytes*/
+static void
+bloom_bits(uint32_t gram, size_t fsize, size_t* bits)
+{
+	uint64_t h = gram*0x9E3779B97F4A7C15ULL;
+	size_t mask = fsize*8 - 1;
+	bits[0] = (size_t)(h >> 48) & mask;
+	bits[1] = (size_t)(h >> 32) & mask;
+}
+
+/**@brief Add 4-byte n-grams of the data to the bloom filter
+ *
+ * Used by dzip --bloom. Every n-gram (read as little endian integer)
+ * sets CFBLOOM_HASHES bits taken from its multiplicative hash.
+ * @param fsize - filter size in bytes (power of 2)*/
+void
+cfbloom_add(uint8_t* filter, size_t fsize, const void* data, size_t len)
+{
+	const unsigned char* p = (const unsigned char*)data;
+	size_t i, bits[CFBLOOM_HASHES];
+	for (i = 0; i + CFBLOOM_GRAM <= len; ++i)
+	{
+		bloom_bits(get_le32(p + i), fsize, bits);
+		filter[bits[0] >> 3] |= 1 << (bits[0] & 7);
+		filter[bits[1] >> 3] |= 1 << (bits[1] & 7);
+	}
+}
+
+/**@brief Find BF members after the dictzip data (and LN members)
+ * @return location (fsize is 0 if there are no filters), NULL on error*/
+static CFBLOOMS*
+blooms_locate(CFILE* cstream)
+{
+	CFBLOOMS* blooms = (CFBLOOMS*)calloc(1, sizeof(CFBLOOMS));
+	if (!blooms || cstream->compression != DICTZIP)
+		return blooms;
+	off_t off = dictzip_end(cstream);
+	unsigned char xbuf[2*2 + 12];
+	size_t msize;
+	while (off >= 0)
+	{
+		memset(xbuf, 0, sizeof(xbuf));
+		if ((msize = trailer_read(cstream, off, xbuf, sizeof(xbuf))) == 0)
+			break;
+		if (xbuf[0] == 'L' && xbuf[1] == 'N')
+		{
+			off += msize;
+			continue;
+		}
+		size_t per = xbuf[10] | xbuf[11] << 8;
+		size_t fsize = xbuf[12] | xbuf[13] << 8;
+		if (xbuf[0] == 'B' && xbuf[1] == 'F' && xbuf[4] == 1
+		 && xbuf[5] == 0 && get_le32(xbuf + 6) == 0
+		 && xbuf[14] == CFBLOOM_GRAM && xbuf[15] == CFBLOOM_HASHES
+		 && fsize >= CFBLOOM_MIN_SIZE && fsize <= CFBLOOM_MAX_SIZE
+		 && (fsize & (fsize - 1)) == 0 && per > 0
+		 && msize >= TRAILER_HEADER_LEN + sizeof(xbuf) + per*fsize
+		             + TRAILER_TAIL_LEN)
+		{
+			blooms->base = off;
+			blooms->msize = msize;
+			blooms->per = per;
+			blooms->fsize = fsize;
+		}
+		break;
+	}
+	return blooms;
+}
+
+/**@brief Chunk filters location (kept in the shared index)*/
+static const CFBLOOMS*
+blooms_get(CFILE* cstream)
+{
+	CFINDEX* idx = cstream->idx;
+	CFBLOOMS* blooms = __atomic_load_n(&idx->blooms, __ATOMIC_ACQUIRE);
+	if (blooms)
+		return blooms;
+	if (!(blooms = blooms_locate(cstream)))
+		return NULL;
+	if (!__sync_bool_compare_and_swap(&idx->blooms, NULL, blooms))
+	{
+		free(blooms);
+		blooms = idx->blooms;
+	}
+	return blooms;
+}
+
+/**@brief Check, if an occurrence of data may start in the chunks
+ * [chunk, chunk + count)
+ *
+ * Bloom filters of the chunks (BF members, see dzip --bloom) are
+ * checked for up to 64 first n-grams of the data. An n-gram of such
+ * occurrence ends in the chunks or in the next one, so it must be in
+ * one of count + 1 filters. Filters are read from the file, nothing
+ * is decompressed.
+ * @return 0 - there is no occurrence, 1 - there may be one (also if
+ * the stream has no filters or data is shorter than CFBLOOM_GRAM), -1 on
+ * error*/
+int
+cfchunk_may_contain(CFILE* stream, size_t chunk, size_t count,
+                    const void* data, size_t len)
+{
+	if (cferror(stream) || (!data && len))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (!is_chunked(stream->compression) || !stream->idx)
+		return 1;
+	size_t chcnt = cfindex_chunks(stream->idx);
+	if (chunk >= chcnt || count == 0)
+		return 0;
+	const CFBLOOMS* blooms = blooms_get(stream);
+	if (!blooms)
+		return -1;
+	if (blooms->fsize == 0 || len < CFBLOOM_GRAM)
+		return 1;
+	/* n-grams, that end not farther than the next chunk*/
+	size_t grams = len - CFBLOOM_GRAM + 1;
+	if (grams > 64)
+		grams = 64;
+	if (grams > stream->chlen - CFBLOOM_GRAM + 1)
+		grams = stream->chlen - CFBLOOM_GRAM + 1;
+	const unsigned char* p = (const unsigned char*)data;
+	size_t bits[64][CFBLOOM_HASHES];
+	size_t i;
+	for (i = 0; i < grams; ++i)
+		bloom_bits(get_le32(p + i), blooms->fsize, bits[i]);
+	uint64_t missing = grams == 64 ? ~(uint64_t)0
+	                               : ((uint64_t)1 << grams) - 1;
+	unsigned char filter[CFBLOOM_MAX_SIZE];
+	size_t c, last = chunk + count < chcnt ? chunk + count : chcnt - 1;
+	for (c = chunk; c <= last && missing; ++c)
+	{
+		off_t off = blooms->base + (off_t)(c/blooms->per)*blooms->msize
+		          + TRAILER_HEADER_LEN + 2*2 + 12
+		          + (off_t)(c%blooms->per)*blooms->fsize;
+		if (stream_pread(stream, filter, blooms->fsize, off)
+		    != blooms->fsize)
+		{
+			errno = EFAULT;
+			return -1;
+		}
+		for (i = 0; i < grams; ++i)
+		{
+			if ((missing & (uint64_t)1 << i)
+			 && (filter[bits[i][0] >> 3] & 1 << (bits[i][0] & 7))
+			 && (filter[bits[i][1] >> 3] & 1 << (bits[i][1] & 7)))
+				missing &= ~((uint64_t)1 << i);
 		}
-		if(stream->currpos >= stream->size)
-			stream->eof = 1;
-	}
-	else if (stream->compression == NONE)
-	{
-		return fseeko(stream->stream, offset, mode);
-	}
-	else
-	{
-		errno = ENOSYS;
-		return -1;
 	}
-	return 0;
+	return missing ? 0 : 1;
 }
 
 /**@brief Tell current logical position*/
@@ -553,11 +2681,10 @@ cftell(CFILE* stream)
 off_t
 cftello(CFILE* stream)
 {
-	if (stream->compression == NONE)
-		return ftello(stream->stream);
 	if (cferror(stream))
 		return -1;
-	else if (stream->compression == DICTZIP)
+	else if (is_chunked(stream->compression)
+	      || stream->compression == NONE)
 		return stream->currpos;
 	errno = EINVAL;
 	return -1;
@@ -574,7 +2701,7 @@ cfread(void* dest, size_t size, size_t count, CFILE* stream)
 		errno = EINVAL;
 		return 0;
 	}
-	if (stream->compression == DICTZIP)
+	if (is_chunked(stream->compression))
 	{
 		if (stream->idxsz == 0 || stream->idx == NULL)
 		{
@@ -611,6 +2738,8 @@ cfread(void* dest, size_t size, size_t count, CFILE* stream)
 		if (need_to_set_eof)
 			stream->eof = 1;
 		stream->currpos = pos;
+		if (stream->stats)
+			stream->stats->delivered_bytes += copied;
 		return copied/size;
 	}
 	else if (stream->compression == NONE)
@@ -620,7 +2749,22 @@ cfread(void* dest, size_t size, size_t count, CFILE* stream)
 			errno = EINVAL;
 			return 0;
 		}
-		return fread(dest, size, count, stream->stream);
+		off_t pos = stream->currpos;
+		size_t want = size*count;
+		if (past_end(stream, pos + want) && (uint64_t)pos >= stream->size)
+		{
+			stream->eof = 1;
+			return 0;
+		}
+		if (want > stream->size - pos)
+			want = stream->size - pos;
+		size_t copied = stream_pread(stream, dest, want, pos);
+		if (copied < size*count)
+			stream->eof = 1;
+		stream->currpos = pos + copied;
+		if (stream->stats)
+			stream->stats->delivered_bytes += copied;
+		return copied/size;
 	}
 	else
 	{
@@ -629,22 +2773,172 @@ cfread(void* dest, size_t size, size_t count, CFILE* stream)
 	}
 }
 
-/**@ fgetc analogue*/
-int
-cfgetc(CFILE* stream)
+/**@brief Find the end of the line in the window at the current
+ * position
+ * @return bytes up to and including '\n' (or up to max or the window
+ * end), 0 on eof, -1 on error. nl is set if '\n' is found*/
+static ssize_t
+scan_line(CFILE* stream, size_t max, int* nl)
 {
-	if (stream->compression == NONE)
+	*nl = 0;
+	if (past_end(stream, stream->currpos))
+	{
+		stream->eof = 1;
+		return 0;
+	}
+	if (fill_buf(stream, stream->currpos) != 1)
+		return -1;
+	const char* p = stream->buf + (stream->currpos - stream->bufoff);
+	size_t avail = stream->bufoff + stream->bufsz - stream->currpos;
+	if (avail > max)
+		avail = max;
+	/* memchr is vectorized by the libc*/
+	const char* end = (const char*)memchr(p, '\n', avail);
+	if (!end)
+		return avail;
+	*nl = 1;
+	return end - p + 1;
+}
+
+/**@brief fgets analogue
+ *
+ * Reads at most size - 1 bytes up to and including '\n'. Lines are
+ * searched with memchr in the decompressed window and copied by
+ * window parts, lines may span chunks.
+ * @return s, NULL on eof (nothing read) or error*/
+char*
+cfgets(char* s, int size, CFILE* stream)
+{
+	if (!s || size <= 0 || cferror(stream))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	if (stream->compression != NONE && !is_chunked(stream->compression))
+	{
+		errno = ENOSYS;
+		return NULL;
+	}
+	size_t len = 0;
+	int nl = 0;
+	while (!nl && len < (size_t)size - 1)
+	{
+		ssize_t take = scan_line(stream, size - 1 - len, &nl);
+		if (take < 0)
+			return NULL;
+		if (take == 0)
+			break;
+		memcpy(s + len, stream->buf + (stream->currpos - stream->bufoff),
+		       take);
+		len += take;
+		stream->currpos += take;
+	}
+	if (len == 0 && size > 1)
+		return NULL;
+	s[len] = '\0';
+	if (stream->stats)
+		stream->stats->delivered_bytes += len;
+	return s;
+}
+
+/**@brief getline analogue
+ *
+ * The line (with '\n', if any) is stored into *lineptr, that is
+ * (re)allocated as needed, *n is its size.
+ * @return length of the line, -1 on eof (nothing read) or error*/
+ssize_t
+cfgetline(char** lineptr, size_t* n, CFILE* stream)
+{
+	if (!lineptr || !n || cferror(stream))
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (stream->compression != NONE && !is_chunked(stream->compression))
+	{
+		errno = ENOSYS;
+		return -1;
+	}
+	if (!*lineptr)
+		*n = 0;
+	size_t len = 0;
+	int nl = 0;
+	while (!nl)
+	{
+		ssize_t take = scan_line(stream, (size_t)-1, &nl);
+		if (take < 0)
+			return -1;
+		if (take == 0)
+			break;
+		if (len + take + 1 > *n)
+		{
+			size_t sz = *n ? *n : 120;
+			while (sz < len + take + 1)
+				sz *= 2;
+			char* p = (char*)realloc(*lineptr, sz);
+			if (!p)
+			{
+				errno = ENOMEM;
+				return -1;
+			}
+			*lineptr = p;
+			*n = sz;
+		}
+		memcpy(*lineptr + len,
+		       stream->buf + (stream->currpos - stream->bufoff), take);
+		len += take;
+		stream->currpos += take;
+	}
+	if (len == 0)
+		return -1;
+	(*lineptr)[len] = '\0';
+	if (stream->stats)
+		stream->stats->delivered_bytes += len;
+	return len;
+}
+
+/**@brief Get the buffer window at the current position (zero-copy
+ * read)
+ *
+ * The window is renewed if the position is out of it, the position is
+ * not changed (use cfseeko to consume bytes). The memory is valid until
+ * the next read or close of the handle.
+ * @return pointer to the byte at the current position (len - bytes
+ * available from it in the window), NULL on eof or error*/
+const char*
+cfgetbuf(CFILE* stream, size_t* len)
+{
+	if (cferror(stream) || !len)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	*len = 0;
+	if (past_end(stream, stream->currpos))
 	{
-		return fgetc(stream->stream);
+		stream->eof = 1;
+		return NULL;
 	}
-	else if (stream->compression == DICTZIP)
+	if (fill_buf(stream, stream->currpos) != 1)
+		return NULL;
+	*len = stream->bufoff + stream->bufsz - stream->currpos;
+	return stream->buf + (stream->currpos - stream->bufoff);
+}
+
+/**@brief cfgetc slow path
+ *
+ * Called by inline cfgetc() when currpos is out of the buffer window.*/
+int
+cfgetc_slow(CFILE* stream)
+{
+	if (is_chunked(stream->compression) || stream->compression == NONE)
 	{
 		if (cferror(stream))
 		{
 			errno = EINVAL;
 			return EOF;
 		}
-		if (stream->currpos == stream->size)
+		if (past_end(stream, stream->currpos))
 		{
 			stream->eof = 1;
 			return EOF;
@@ -654,6 +2948,8 @@ cfgetc(CFILE* stream)
 			errno = EFAULT;
 			return EOF;
 		}
+		if (stream->stats)
+			++stream->stats->delivered_bytes;
 		return (int)((unsigned char)stream->buf[stream->currpos++ - stream->bufoff]);
 	}
 	else
@@ -664,3 +2960,724 @@ cfgetc(CFILE* stream)
 }
 
 
+
+/**@brief Asynchronous read request (see cfread_async)*/
+typedef struct CFAIO_REQ
+{
+	struct CFAIO_REQ* next;
+	cfaio_cb          cb;
+	void*             arg;
+	size_t            size;    //!< bytes to deliver
+	int               pending; //!< operations in flight (+1 on submit)
+	int               err;     //!< the first error
+} CFAIO_REQ;
+
+/**@brief Part of the request: compressed chunk or a range of the
+ * uncompressed stream*/
+typedef struct CFAIO_OP
+{
+	struct CFAIO_OP* next;
+	CFAIO_REQ*       req;
+	CFILE*           stream;
+	off_t            off;    //!< offset in the file
+	size_t           len;    //!< bytes to read
+	size_t           got;    //!< bytes read
+	char*            data;   //!< read destination
+	char*            out;    //!< decompressed part destination
+	size_t           skip;   //!< chunk bytes before the part
+	size_t           outlen; //!< part length
+	int              err;
+} CFAIO_OP;
+
+#ifdef CSIO_WITH_IO_URING
+/**@brief io_uring instance (raw syscalls, no liburing dependency)
+ *
+ * The submission queue is filled under the lock by any thread, the
+ * completion queue is consumed by the single reaper thread, that is woken
+ * up by the eventfd registered in the ring. Not more then entries reads
+ * are in the ring, so the completion queue (twice bigger) never
+ * overflows, the rest waits in the backlog.*/
+typedef struct
+{
+	int                  fd;
+	unsigned             entries;
+	unsigned*            sq_head;
+	unsigned*            sq_tail;
+	unsigned*            sq_mask;
+	unsigned*            sq_array;
+	struct io_uring_sqe* sqes;
+	unsigned*            cq_head;
+	unsigned*            cq_tail;
+	unsigned*            cq_mask;
+	struct io_uring_cqe* cqes;
+	void*                sq_ptr;
+	size_t               sq_sz;
+	void*                cq_ptr;
+	size_t               cq_sz;
+	size_t               sqes_sz;
+	pthread_mutex_t      lock;
+	unsigned             queued;    //!< reads in the ring
+	unsigned             unsubmitted;
+	CFAIO_OP*            backlog;
+	CFAIO_OP**           backlog_tail;
+	int                  failed;    //!< errno of the broken ring
+	int                  stop;
+	int                  efd;       //!< signaled on completions
+	pthread_t            reaper;
+} CFAIO_RING;
+#endif
+
+/**@brief Asynchronous reads engine
+ *
+ * Requests are split into operations (chunks). Compressed data is read
+ * with io_uring (if it is available) or with pread(2) on the workers,
+ * chunks are decompressed by the workers. Completed requests are queued
+ * and the eventfd is signaled, callbacks are run by cfaio_poll in the
+ * caller's thread.*/
+struct CFAIO
+{
+	pthread_mutex_t lock;
+	pthread_cond_t  cond;
+	CFAIO_OP*       work;     //!< operations for the workers
+	CFAIO_OP**      work_tail;
+	CFAIO_REQ*      done;     //!< completed requests
+	CFAIO_REQ**     done_tail;
+	size_t          active;   //!< requests not completed yet
+	int             stop;
+	int             efd;
+	pthread_t*      workers;
+	size_t          nworkers;
+	void*           ring;     //!< CFAIO_RING, NULL - pread on workers
+};
+
+/**@brief Release operation reference of the request, queue completed
+ * request for cfaio_poll*/
+static void
+aio_req_put(CFAIO* aio, CFAIO_REQ* req, int err)
+{
+	pthread_mutex_lock(&aio->lock);
+	if (err && !req->err)
+		req->err = err;
+	int completed = --req->pending == 0;
+	if (completed)
+	{
+		req->next = NULL;
+		*aio->done_tail = req;
+		aio->done_tail = &req->next;
+		--aio->active;
+		pthread_cond_broadcast(&aio->cond);
+	}
+	pthread_mutex_unlock(&aio->lock);
+	if (completed)
+	{
+		uint64_t one = 1;
+		while (write(aio->efd, &one, sizeof(one)) == -1 && errno == EINTR);
+	}
+}
+
+static void
+aio_op_done(CFAIO* aio, CFAIO_OP* op)
+{
+	CFAIO_REQ* req = op->req;
+	int err = op->err;
+	free(op);
+	aio_req_put(aio, req, err);
+}
+
+/**@brief Pass the operation to the workers*/
+static void
+aio_work(CFAIO* aio, CFAIO_OP* op)
+{
+	op->next = NULL;
+	pthread_mutex_lock(&aio->lock);
+	*aio->work_tail = op;
+	aio->work_tail = &op->next;
+	pthread_cond_signal(&aio->cond);
+	pthread_mutex_unlock(&aio->lock);
+}
+
+/**@brief Decompress the chunk of the operation with the worker's
+ * handle w into the destination
+ *
+ * Whole chunks are decompressed right into the destination, parts are
+ * decompressed into own buffer and copied.*/
+static int
+aio_decompress(CFILE* w, char* own, CFAIO_OP* op)
+{
+	const CFILE* s = op->stream;
+	if (w->backend != s->backend)
+	{
+		backend_free(w);
+		w->backend = s->backend;
+	}
+	if (w->compression != s->compression)
+	{
+		codec_free(w);
+		w->compression = s->compression;
+	}
+	w->chlen = s->chlen;
+	int direct = op->skip == 0 && op->outlen == s->chlen;
+	w->buf = direct ? op->out : own;
+	int rs = decompress_chunk(w, op->data, op->len);
+	w->buf = own;
+	if (rs < 0 || (size_t)rs < op->skip + op->outlen)
+		return -1;
+	if (!direct)
+		memcpy(op->out, own + op->skip, op->outlen);
+	return 0;
+}
+
+static void*
+aio_worker(void* arg)
+{
+	CFAIO* aio = (CFAIO*)arg;
+	CFILE w;
+	memset(&w, 0, sizeof(w));
+	char* own = (char*)malloc(0x10000);
+	w.buf = own;
+	for (;;)
+	{
+		pthread_mutex_lock(&aio->lock);
+		while (!aio->work && !aio->stop)
+			pthread_cond_wait(&aio->cond, &aio->lock);
+		CFAIO_OP* op = aio->work;
+		if (op)
+		{
+			aio->work = op->next;
+			if (!aio->work)
+				aio->work_tail = &aio->work;
+		}
+		pthread_mutex_unlock(&aio->lock);
+		if (!op)
+			break;
+		if (!aio->ring && !op->err)
+		{
+			op->got = pread_full(fileno(op->stream->stream), op->data,
+					op->len, op->off);
+			if (op->got != op->len)
+				op->err = EFAULT;
+		}
+		if (!op->err && op->stream->compression != NONE
+		 && (!own || aio_decompress(&w, own, op) != 0))
+			op->err = EFAULT;
+		aio_op_done(aio, op);
+	}
+	w.buf = own;
+	free_state(&w);
+	return NULL;
+}
+
+#ifdef CSIO_WITH_IO_URING
+/**@brief Put read of the operation to the submission queue or to the
+ * backlog, if the ring is full
+ * @note ring lock must be held*/
+static void
+ring_push(CFAIO_RING* r, CFAIO_OP* op)
+{
+	if (r->queued == r->entries)
+	{
+		op->next = NULL;
+		*r->backlog_tail = op;
+		r->backlog_tail = &op->next;
+		return;
+	}
+	unsigned tail = *r->sq_tail;
+	unsigned i = tail & *r->sq_mask;
+	struct io_uring_sqe* sqe = &r->sqes[i];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_READ;
+	sqe->fd = fileno(op->stream->stream);
+	sqe->addr = (uint64_t)(uintptr_t)(op->data + op->got);
+	sqe->len = op->len - op->got;
+	sqe->off = op->off + op->got;
+	sqe->user_data = (uint64_t)(uintptr_t)op;
+	r->sq_array[i] = i;
+	__atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+	++r->queued;
+	++r->unsubmitted;
+}
+
+/**@brief Submit queued reads
+ *
+ * If io_uring_enter fails not because of a signal or a full completion
+ * queue, the ring is marked as failed and the reads, that were not
+ * submitted, are taken back from the submission queue. The reads in the
+ * kernel are completed as usual.
+ * @return taken back and backlog reads with the error (to be completed
+ * by the caller), NULL if the ring is not failed
+ * @note ring lock must be held*/
+static CFAIO_OP*
+ring_submit(CFAIO_RING* r)
+{
+	while (r->unsubmitted > 0 && !r->failed)
+	{
+		int rs = syscall(__NR_io_uring_enter, r->fd, r->unsubmitted, 0, 0,
+				NULL, 0);
+		if (rs > 0)
+			r->unsubmitted -= rs;
+		else if (rs < 0 && errno != EINTR && errno != EAGAIN
+		      && errno != EBUSY)
+			r->failed = errno;
+	}
+	if (!r->failed)
+		return NULL;
+	CFAIO_OP* failed = r->backlog;
+	r->backlog = NULL;
+	r->backlog_tail = &r->backlog;
+	/* the kernel doesn't look at the entries after its head without
+	 * io_uring_enter*/
+	unsigned head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+	unsigned tail;
+	for (tail = *r->sq_tail; tail != head; --tail)
+	{
+		unsigned i = r->sq_array[(tail - 1) & *r->sq_mask];
+		CFAIO_OP* op = (CFAIO_OP*)(uintptr_t)r->sqes[i].user_data;
+		op->next = failed;
+		failed = op;
+		--r->queued;
+	}
+	__atomic_store_n(r->sq_tail, head, __ATOMIC_RELEASE);
+	r->unsubmitted = 0;
+	CFAIO_OP* op;
+	for (op = failed; op; op = op->next)
+		op->err = r->failed;
+	return failed;
+}
+
+/**@brief Reaper thread: passes completed reads to the workers and
+ * resubmits short ones*/
+static void*
+ring_reaper(void* arg)
+{
+	CFAIO* aio = (CFAIO*)arg;
+	CFAIO_RING* r = (CFAIO_RING*)aio->ring;
+	int stop = 0;
+	while (!stop)
+	{
+		uint64_t cnt;
+		while (read(r->efd, &cnt, sizeof(cnt)) == -1 && errno == EINTR);
+		/* ops were filled by the submitters under the lock*/
+		pthread_mutex_lock(&r->lock);
+		stop = r->stop;
+		unsigned head = *r->cq_head;
+		unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+		CFAIO_OP* ready = NULL;
+		CFAIO_OP* again = NULL;
+		unsigned n = 0;
+		for (; head != tail; ++head, ++n)
+		{
+			struct io_uring_cqe* cqe = &r->cqes[head & *r->cq_mask];
+			CFAIO_OP* op = (CFAIO_OP*)(uintptr_t)cqe->user_data;
+			if (cqe->res < 0)
+				op->err = -cqe->res;
+			else if (cqe->res == 0)
+				op->err = EFAULT;
+			else if ((op->got += cqe->res) < op->len)
+			{
+				op->next = again;
+				again = op;
+				continue;
+			}
+			op->next = ready;
+			ready = op;
+		}
+		__atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+		r->queued -= n;
+		while (again)
+		{
+			CFAIO_OP* op = again;
+			again = op->next;
+			ring_push(r, op);
+		}
+		while (r->backlog && r->queued < r->entries)
+		{
+			CFAIO_OP* op = r->backlog;
+			r->backlog = op->next;
+			if (!r->backlog)
+				r->backlog_tail = &r->backlog;
+			ring_push(r, op);
+		}
+		CFAIO_OP* failed = ring_submit(r);
+		pthread_mutex_unlock(&r->lock);
+		while (failed)
+		{
+			CFAIO_OP* op = failed;
+			failed = op->next;
+			aio_op_done(aio, op);
+		}
+		while (ready)
+		{
+			CFAIO_OP* op = ready;
+			ready = op->next;
+			if (op->err || op->stream->compression == NONE)
+				aio_op_done(aio, op);
+			else
+				aio_work(aio, op);
+		}
+	}
+	return NULL;
+}
+
+static void
+ring_destroy(CFAIO_RING* r)
+{
+	if (r->sqes)
+		munmap(r->sqes, r->sqes_sz);
+	if (r->cq_ptr && r->cq_ptr != r->sq_ptr)
+		munmap(r->cq_ptr, r->cq_sz);
+	if (r->sq_ptr)
+		munmap(r->sq_ptr, r->sq_sz);
+	close(r->fd);
+	if (r->efd != -1)
+		close(r->efd);
+	pthread_mutex_destroy(&r->lock);
+	free(r);
+}
+
+/**@brief Set up io_uring with depth entries
+ * @return NULL if io_uring is not available (or the kernel is older
+ * then 5.6 without IORING_OP_READ)*/
+static CFAIO_RING*
+ring_create(unsigned depth)
+{
+	struct io_uring_params p;
+	memset(&p, 0, sizeof(p));
+	int fd = syscall(__NR_io_uring_setup, depth, &p);
+	if (fd < 0)
+		return NULL;
+	CFAIO_RING* r = (CFAIO_RING*)calloc(1, sizeof(CFAIO_RING));
+	if (!r || !(p.features & IORING_FEAT_RW_CUR_POS)
+	 || pthread_mutex_init(&r->lock, NULL) != 0)
+	{
+		free(r);
+		close(fd);
+		return NULL;
+	}
+	r->fd = fd;
+	r->efd = eventfd(0, EFD_CLOEXEC);
+	r->entries = p.sq_entries;
+	r->backlog_tail = &r->backlog;
+	r->sq_sz = p.sq_off.array + p.sq_entries*sizeof(unsigned);
+	r->cq_sz = p.cq_off.cqes + p.cq_entries*sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		r->sq_sz = r->cq_sz = r->sq_sz > r->cq_sz ? r->sq_sz : r->cq_sz;
+	r->sqes_sz = p.sq_entries*sizeof(struct io_uring_sqe);
+	r->sq_ptr = mmap(NULL, r->sq_sz, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (r->sq_ptr == MAP_FAILED)
+		r->sq_ptr = NULL;
+	r->cq_ptr = p.features & IORING_FEAT_SINGLE_MMAP ? r->sq_ptr
+		: mmap(NULL, r->cq_sz, PROT_READ | PROT_WRITE,
+		       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+	if (r->cq_ptr == MAP_FAILED)
+		r->cq_ptr = NULL;
+	r->sqes = (struct io_uring_sqe*)mmap(NULL, r->sqes_sz,
+			PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd,
+			IORING_OFF_SQES);
+	if (r->sqes == MAP_FAILED)
+		r->sqes = NULL;
+	if (!r->sq_ptr || !r->cq_ptr || !r->sqes || r->efd == -1
+	 || syscall(__NR_io_uring_register, fd, IORING_REGISTER_EVENTFD,
+	            &r->efd, 1) != 0)
+	{
+		ring_destroy(r);
+		return NULL;
+	}
+	char* sq = (char*)r->sq_ptr;
+	char* cq = (char*)r->cq_ptr;
+	r->sq_head = (unsigned*)(sq + p.sq_off.head);
+	r->sq_tail = (unsigned*)(sq + p.sq_off.tail);
+	r->sq_mask = (unsigned*)(sq + p.sq_off.ring_mask);
+	r->sq_array = (unsigned*)(sq + p.sq_off.array);
+	r->cq_head = (unsigned*)(cq + p.cq_off.head);
+	r->cq_tail = (unsigned*)(cq + p.cq_off.tail);
+	r->cq_mask = (unsigned*)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe*)(cq + p.cq_off.cqes);
+	return r;
+}
+#endif
+
+/**@brief Create asynchronous reads engine
+ *
+ * @param depth - max reads in flight in io_uring (0 - don't use
+ * io_uring, read with pread(2) on the workers, it is also the fallback
+ * if io_uring is not available)
+ * @param workers - decompression threads (0 - 1)
+ * @return NULL on error*/
+CFAIO*
+cfaio_create(unsigned depth, unsigned workers)
+{
+	CFAIO* aio = (CFAIO*)calloc(1, sizeof(CFAIO));
+	if (!aio)
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+	aio->work_tail = &aio->work;
+	aio->done_tail = &aio->done;
+	aio->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	aio->nworkers = workers ? workers : 1;
+	aio->workers = (pthread_t*)calloc(aio->nworkers, sizeof(pthread_t));
+	if (aio->efd == -1 || !aio->workers
+	 || pthread_mutex_init(&aio->lock, NULL) != 0)
+	{
+		if (aio->efd != -1)
+			close(aio->efd);
+		free(aio->workers);
+		free(aio);
+		errno = ENOMEM;
+		return NULL;
+	}
+	pthread_cond_init(&aio->cond, NULL);
+#ifdef CSIO_WITH_IO_URING
+	if (depth > 0 && (aio->ring = ring_create(depth)) != NULL
+	 && pthread_create(&((CFAIO_RING*)aio->ring)->reaper, NULL,
+	                   ring_reaper, aio) != 0)
+	{
+		ring_destroy((CFAIO_RING*)aio->ring);
+		aio->ring = NULL;
+	}
+#endif
+	size_t i;
+	for (i = 0; i < aio->nworkers; ++i)
+	{
+		if (pthread_create(&aio->workers[i], NULL, aio_worker, aio) != 0)
+		{
+			aio->nworkers = i;
+			cfaio_destroy(aio);
+			errno = EAGAIN;
+			return NULL;
+		}
+	}
+	return aio;
+}
+
+/**@brief Wait for all requests in flight and destroy the engine
+ *
+ * Callbacks of the requests, that were not delivered by cfaio_poll, are
+ * not called.*/
+void
+cfaio_destroy(CFAIO* aio)
+{
+	if (!aio)
+		return;
+	pthread_mutex_lock(&aio->lock);
+	while (aio->active > 0)
+		pthread_cond_wait(&aio->cond, &aio->lock);
+	aio->stop = 1;
+	pthread_cond_broadcast(&aio->cond);
+	pthread_mutex_unlock(&aio->lock);
+	size_t i;
+	for (i = 0; i < aio->nworkers; ++i)
+		pthread_join(aio->workers[i], NULL);
+#ifdef CSIO_WITH_IO_URING
+	if (aio->ring)
+	{
+		CFAIO_RING* r = (CFAIO_RING*)aio->ring;
+		pthread_mutex_lock(&r->lock);
+		r->stop = 1;
+		pthread_mutex_unlock(&r->lock);
+		uint64_t one = 1;
+		while (write(r->efd, &one, sizeof(one)) == -1 && errno == EINTR);
+		pthread_join(r->reaper, NULL);
+		ring_destroy(r);
+	}
+#endif
+	while (aio->done)
+	{
+		CFAIO_REQ* req = aio->done;
+		aio->done = req->next;
+		free(req);
+	}
+	close(aio->efd);
+	pthread_cond_destroy(&aio->cond);
+	pthread_mutex_destroy(&aio->lock);
+	free(aio->workers);
+	free(aio);
+}
+
+/**@brief Descriptor, that is readable when there are completed
+ * requests (for poll/epoll of the event loop)*/
+int
+cfaio_fd(CFAIO* aio)
+{
+	if (!aio)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	return aio->efd;
+}
+
+/**@brief Check if reads are submitted with io_uring*/
+int
+cfaio_uring(CFAIO* aio)
+{
+	return aio && aio->ring ? 1 : 0;
+}
+
+/**@brief pread(2) analogue, that doesn't block
+ *
+ * Reads count bytes at offset of the decompressed stream into dest.
+ * The callback is called by cfaio_poll with count of bytes read (less
+ * then count at the end of the stream) or -1 and errno value. Position
+ * and buffer window of the handle are not changed, so the handle may be
+ * used by other (synchronous) reads at the same time, but it must not
+ * be closed until the callback is called. Thousands of reads can be in
+ * flight: they wait in the io_uring and in the queue of the workers.
+ * @return 0 on success (the callback will be called), -1 on error*/
+int
+cfread_async(CFAIO* aio, CFILE* stream, void* dest, size_t count,
+		off_t offset, cfaio_cb cb, void* arg)
+{
+	if (!aio || cferror(stream) || (!dest && count) || offset < 0 || !cb)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	if (stream->compression != NONE && !is_chunked(stream->compression))
+	{
+		errno = ENOSYS;
+		return -1;
+	}
+	size_t want = (uint64_t)offset >= stream->size ? 0
+		: (count < stream->size - offset ? count : stream->size - offset);
+	CFAIO_REQ* req = (CFAIO_REQ*)calloc(1, sizeof(CFAIO_REQ));
+	if (!req)
+	{
+		errno = ENOMEM;
+		return -1;
+	}
+	req->cb = cb;
+	req->arg = arg;
+	req->size = want;
+	req->pending = 1;
+	/* uncompressed ranges are read right into dest by 1G parts*/
+	const off_t part = stream->compression == NONE ? (off_t)1 << 30
+	                                               : (off_t)stream->chlen;
+	CFAIO_OP* ops = NULL;
+	CFAIO_OP** tail = &ops;
+	off_t pos = offset;
+	const off_t end = offset + want;
+	while (pos < end)
+	{
+		off_t first = pos - pos % part;
+		off_t last = first + part < end ? first + part : end;
+		off_t off = pos;
+		size_t len = last - pos;
+		if (stream->compression != NONE
+		 && cfindex_chunk(stream->idx, pos/part, &off, &len) != 1)
+			break;
+		/* inflate_libdeflate appends the empty final block to the input*/
+		CFAIO_OP* op = (CFAIO_OP*)calloc(1, sizeof(CFAIO_OP)
+			+ (stream->compression == NONE ? 0
+			                               : len + EMPTY_FINISH_BLOCK_LEN));
+		if (!op)
+			break;
+		op->req = req;
+		op->stream = stream;
+		op->off = off;
+		op->len = len;
+		op->out = (char*)dest + (pos - offset);
+		op->data = stream->compression == NONE ? op->out : (char*)(op + 1);
+		op->skip = pos - first;
+		op->outlen = last - pos;
+		*tail = op;
+		tail = &op->next;
+		++req->pending;
+		pos = last;
+	}
+	if (pos < end)
+	{
+		while (ops)
+		{
+			CFAIO_OP* op = ops;
+			ops = op->next;
+			free(op);
+		}
+		free(req);
+		errno = ENOMEM;
+		return -1;
+	}
+	pthread_mutex_lock(&aio->lock);
+	++aio->active;
+	pthread_mutex_unlock(&aio->lock);
+#ifdef CSIO_WITH_IO_URING
+	if (aio->ring)
+	{
+		CFAIO_RING* r = (CFAIO_RING*)aio->ring;
+		pthread_mutex_lock(&r->lock);
+		while (ops && !r->failed)
+		{
+			CFAIO_OP* op = ops;
+			ops = op->next;
+			ring_push(r, op);
+		}
+		CFAIO_OP* failed = ring_submit(r);
+		int err = r->failed;
+		pthread_mutex_unlock(&r->lock);
+		while (failed)
+		{
+			CFAIO_OP* op = failed;
+			failed = op->next;
+			aio_op_done(aio, op);
+		}
+		/* the workers complete them with the error*/
+		CFAIO_OP* op;
+		for (op = ops; op; op = op->next)
+			op->err = err;
+	}
+#endif
+	while (ops)
+	{
+		CFAIO_OP* op = ops;
+		ops = op->next;
+		aio_work(aio, op);
+	}
+	aio_req_put(aio, req, 0);
+	return 0;
+}
+
+/**@brief Call callbacks of the completed requests
+ *
+ * @param timeout_ms - time to wait for the first completion (0 - don't
+ * wait, -1 - infinitely)
+ * @return count of called callbacks, -1 on error*/
+int
+cfaio_poll(CFAIO* aio, int timeout_ms)
+{
+	if (!aio)
+	{
+		errno = EINVAL;
+		return -1;
+	}
+	uint64_t cnt;
+	pthread_mutex_lock(&aio->lock);
+	int empty = aio->done == NULL;
+	pthread_mutex_unlock(&aio->lock);
+	if (empty && timeout_ms != 0)
+	{
+		struct pollfd pfd;
+		pfd.fd = aio->efd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, timeout_ms) == -1 && errno != EINTR)
+			return -1;
+	}
+	if (read(aio->efd, &cnt, sizeof(cnt)) == -1 && errno != EAGAIN)
+		return -1;
+	pthread_mutex_lock(&aio->lock);
+	CFAIO_REQ* done = aio->done;
+	aio->done = NULL;
+	aio->done_tail = &aio->done;
+	pthread_mutex_unlock(&aio->lock);
+	int rs = 0;
+	while (done)
+	{
+		CFAIO_REQ* req = done;
+		done = req->next;
+		req->cb(req->arg, req->err ? -1 : (ssize_t)req->size, req->err);
+		free(req);
+		++rs;
+	}
+	return rs;
+}
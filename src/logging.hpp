@@ -1,12 +1,13 @@
-#include <easylogging++.h>
-
 #ifndef __LOGGING_HPP__
 #define __LOGGING_HPP__
 
-namespace csio {
-
+// must be defined before the include, otherwise the logger isn't locked
 #define ELPP_THREAD_SAFE
 #define ELPP_FORCE_USE_STD_THREAD
+#include <easylogging++.h>
+
+namespace csio {
+
 #define INIT_LOGGING INITIALIZE_EASYLOGGINGPP
 
 using namespace el;
@@ -0,0 +1,583 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 14:10:02
+ *
+ * @brief csio and dzip benchmarks.
+ *
+ * Corpora are generated on the first use in TEST_TMP_DIR and
+ * compressed with dzip (in-process):
+ *
+ * - random  - incompressible bytes;
+ * - letters - random letters and digits;
+ * - text    - words from a small vocabulary split into lines.
+ *
+ * Corpus size is CSIO_BENCH_MB environment variable (default 32).
+ * Results are warm page cache numbers, there is no cache dropping.
+ *
+ * Use Google Benchmark options to get machine-readable results, e.g.:
+ *
+ * 	csio_benchmark --benchmark_out=bench.json --benchmark_out_format=json
+ * */
+
+#include <benchmark/benchmark.h>
+#include <csio.h>
+#include <csio_config.h>
+#include <CompressManager.hpp>
+#include <logging.hpp>
+#include <getopt.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+INIT_LOGGING
+
+namespace {
+
+const char* CORPORA[] = {"random", "letters", "text"};
+
+size_t
+corpus_size()
+{
+	const char* mb = getenv("CSIO_BENCH_MB");
+	size_t rs = mb ? strtoul(mb, NULL, 10) : 0;
+	return (rs > 0 ? rs : 32)*1024*1024;
+}
+
+std::string
+corpus_path(const std::string& kind)
+{
+	return std::string(TEST_TMP_DIR) + "/csio_bench_" + kind;
+}
+
+bool
+file_exists(const std::string& fname, size_t sz = 0)
+{
+	struct stat st;
+	if (stat(fname.c_str(), &st) != 0)
+		return false;
+	return sz == 0 || (size_t)st.st_size == sz;
+}
+
+/**@brief run dzip in-process
+ * @return false on error*/
+bool
+dzip(const std::string& ifname, const std::string& ofname,
+		int threads, int level, int batch = 16,
+		CFBackend backend = CFBACKEND_ZLIB)
+{
+	std::vector<std::string> args = {"dzip", "-f",
+		"-j", std::to_string(threads),
+		"-l", std::to_string(level),
+		"-b", std::to_string(batch),
+		"-z", cfbackend_name(backend),
+		"-o", ofname, ifname};
+	std::vector<char*> argv;
+	for (size_t i = 0; i < args.size(); ++i)
+		argv.push_back(&args[i][0]);
+	optind = 0;
+	csio::Config cfg;
+	if (cfg.ParseArgs(argv.size(), argv.data()) <= 0)
+		return false;
+	csio::CompressManager cmprs(cfg);
+	cmprs.Loop();
+	return file_exists(ofname);
+}
+
+void
+generate(const std::string& kind, const std::string& fname, size_t sz)
+{
+	std::mt19937_64 rnd(0x484F584E);
+	std::vector<char> buf(sz);
+	if (kind == "random")
+	{
+		for (size_t i = 0; i < sz; ++i)
+			buf[i] = (char)rnd();
+	}
+	else if (kind == "letters")
+	{
+		const char abc[] = "abcdefghijklmnopqrstuvwxyz"
+		                   "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789";
+		for (size_t i = 0; i < sz; ++i)
+			buf[i] = abc[rnd()%(sizeof(abc) - 1)];
+	}
+	else
+	{
+		std::vector<std::string> words;
+		for (size_t i = 0; i < 5000; ++i)
+		{
+			std::string word(2 + rnd()%9, ' ');
+			for (size_t j = 0; j < word.size(); ++j)
+				word[j] = 'a' + rnd()%26;
+			words.push_back(word);
+		}
+		// skewed to the frequent words, like a natural text
+		std::geometric_distribution<size_t> freq(0.002);
+		size_t pos = 0, inline_words = 0;
+		while (pos < sz)
+		{
+			const std::string& word = words[freq(rnd)%words.size()];
+			for (size_t j = 0; j < word.size() && pos < sz; ++j)
+				buf[pos++] = word[j];
+			if (pos < sz)
+				buf[pos++] = ++inline_words%12 == 0 ? '\n' : ' ';
+		}
+	}
+	FILE* f = fopen(fname.c_str(), "wb");
+	if (!f || fwrite(buf.data(), 1, sz, f) != sz)
+	{
+		fprintf(stderr, "Error writing corpus %s\n", fname.c_str());
+		exit(1);
+	}
+	fclose(f);
+}
+
+/**@brief generate (once) raw and compressed corpus
+ * @return path of the raw corpus, compressed one is path + ".dz"*/
+const std::string&
+corpus(const std::string& kind)
+{
+	static std::map<std::string, std::string> ready;
+	std::map<std::string, std::string>::iterator i = ready.find(kind);
+	if (i != ready.end())
+		return i->second;
+	std::string fname = corpus_path(kind);
+	size_t sz = corpus_size();
+	bool fresh = !file_exists(fname, sz);
+	if (fresh)
+		generate(kind, fname, sz);
+	if ((fresh || !file_exists(fname + ".dz"))
+	 && !dzip(fname, fname + ".dz", 2, 9))
+	{
+		fprintf(stderr, "Error compressing corpus %s\n", fname.c_str());
+		exit(1);
+	}
+	return ready[kind] = fname;
+}
+
+double
+percentile(std::vector<double>& v, double p)
+{
+	if (v.empty())
+		return 0;
+	size_t n = std::min(v.size() - 1, (size_t)(p*v.size()));
+	std::nth_element(v.begin(), v.begin() + n, v.end());
+	return v[n];
+}
+
+////////////////////////////////////////////////////////////////////////
+// benchmarks
+
+void
+BM_cfopen(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind) + ".dz";
+	for (auto _ : state)
+	{
+		CFILE* file = cfopen(fname.c_str(), "rb");
+		if (!file)
+		{
+			state.SkipWithError("cfopen failed");
+			break;
+		}
+		cfclose(&file);
+	}
+}
+
+/**@brief reopen with cfpool_open (handle and index are reused)*/
+void
+BM_cfopen_pool(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind) + ".dz";
+	CFPOOL* pool = cfpool_create(1, 1);
+	for (auto _ : state)
+	{
+		CFILE* file = cfpool_open(pool, fname.c_str());
+		if (!file)
+		{
+			state.SkipWithError("cfpool_open failed");
+			break;
+		}
+		cfpool_close(pool, &file);
+	}
+	cfpool_destroy(pool);
+}
+
+/**@brief sequential read, optional arg: inflate backend*/
+void
+BM_cfread_seq(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind) + ".dz";
+	CFILE* file = cfopen(fname.c_str(), "rb");
+	if (state.range(0) != CFBACKEND_ZLIB
+	 && cfsetbackend(file, (CFBackend)state.range(0)) != 0)
+	{
+		state.SkipWithError("backend is not available");
+		cfclose(&file);
+		return;
+	}
+	std::vector<char> buf(0x10000);
+	size_t bytes = 0;
+	for (auto _ : state)
+	{
+		cfseeko(file, 0, SEEK_SET);
+		size_t rs;
+		while ((rs = cfread(buf.data(), 1, buf.size(), file)) > 0)
+			bytes += rs;
+	}
+	state.SetBytesProcessed(bytes);
+	cfclose(&file);
+}
+
+void
+BM_cfgetc(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind) + ".dz";
+	CFILE* file = cfopen(fname.c_str(), "rb");
+	size_t bytes = 0;
+	for (auto _ : state)
+	{
+		cfseeko(file, 0, SEEK_SET);
+		int c;
+		while ((c = cfgetc(file)) != EOF)
+			benchmark::DoNotOptimize(c);
+		bytes += file->size;
+	}
+	state.SetBytesProcessed(bytes);
+	cfclose(&file);
+}
+
+/**@brief line by line reading with cfgetline (lines/s is reported)*/
+void
+BM_cfgetline(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind) + ".dz";
+	CFILE* file = cfopen(fname.c_str(), "rb");
+	char* line = NULL;
+	size_t linesz = 0;
+	size_t bytes = 0, lines = 0;
+	for (auto _ : state)
+	{
+		cfseeko(file, 0, SEEK_SET);
+		ssize_t rs;
+		while ((rs = cfgetline(&line, &linesz, file)) != -1)
+		{
+			benchmark::DoNotOptimize(line);
+			++lines;
+		}
+		bytes += file->size;
+	}
+	state.SetBytesProcessed(bytes);
+	state.counters["lines"] = benchmark::Counter(lines,
+		benchmark::Counter::kIsRate);
+	free(line);
+	cfclose(&file);
+}
+
+/**@brief cfseekline to random lines (the table of newline counts is
+ * built by the first call, before the measurement)*/
+void
+BM_cfseekline(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind) + ".dz";
+	CFILE* file = cfopen(fname.c_str(), "rb");
+	cfseekline(file, 1);
+	uint64_t lines = 1;
+	while (cfseekline(file, lines*2) == 0)
+		lines *= 2;
+	std::mt19937_64 rnd(42);
+	std::uniform_int_distribution<uint64_t> dist(0, lines);
+	for (auto _ : state)
+	{
+		if (cfseekline(file, dist(rnd)) != 0)
+		{
+			state.SkipWithError("cfseekline failed");
+			break;
+		}
+		benchmark::DoNotOptimize(cfgetc(file));
+	}
+	cfclose(&file);
+}
+
+/**@brief `zcat | wc -l` reference for BM_cfgetline*/
+void
+BM_zcat_wc(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind) + ".dz";
+	std::string cmd = "zcat < " + fname + " | wc -l";
+	size_t bytes = 0, lines = 0;
+	for (auto _ : state)
+	{
+		FILE* p = popen(cmd.c_str(), "r");
+		unsigned long rs = 0;
+		if (!p || fscanf(p, "%lu", &rs) != 1)
+		{
+			if (p)
+				pclose(p);
+			state.SkipWithError("zcat failed");
+			break;
+		}
+		pclose(p);
+		lines += rs;
+		bytes += corpus_size();
+	}
+	state.SetBytesProcessed(bytes);
+	state.counters["lines"] = benchmark::Counter(lines,
+		benchmark::Counter::kIsRate);
+}
+
+/**@brief random reads of state.range(0) bytes
+ *
+ * Besides the mean time per iteration (1 read) reports latency
+ * percentiles in microseconds.*/
+template<bool COMPRESSED> void
+BM_random_read(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind) + (COMPRESSED ? ".dz" : "");
+	const size_t readsz = state.range(0);
+	std::vector<char> buf(readsz);
+	std::mt19937_64 rnd(42);
+	std::vector<double> lat;
+	CFILE* cfile = NULL;
+	FILE* file = NULL;
+	size_t sz = corpus_size();
+	if (COMPRESSED)
+		cfile = cfopen(fname.c_str(), "rb");
+	else
+		file = fopen(fname.c_str(), "rb");
+	for (auto _ : state)
+	{
+		off_t off = rnd()%(sz - readsz);
+		auto start = std::chrono::steady_clock::now();
+		size_t rs;
+		if (COMPRESSED)
+		{
+			cfseeko(cfile, off, SEEK_SET);
+			rs = cfread(buf.data(), 1, readsz, cfile);
+		}
+		else
+		{
+			fseeko(file, off, SEEK_SET);
+			rs = fread(buf.data(), 1, readsz, file);
+		}
+		auto end = std::chrono::steady_clock::now();
+		if (rs != readsz)
+		{
+			state.SkipWithError("read failed");
+			break;
+		}
+		lat.push_back(std::chrono::duration<double, std::micro>(
+					end - start).count());
+	}
+	state.SetBytesProcessed(state.iterations()*readsz);
+	state.counters["p50_us"] = percentile(lat, 0.50);
+	state.counters["p90_us"] = percentile(lat, 0.90);
+	state.counters["p99_us"] = percentile(lat, 0.99);
+	if (cfile)
+		cfclose(&cfile);
+	if (file)
+		fclose(file);
+}
+
+/**@brief Chunk cache shared by BM_cfread_threads handles*/
+CFCACHE*
+shared_cache()
+{
+	static CFCACHE* cache = cfcache_create(2*corpus_size() + (64 << 20), 64);
+	return cache;
+}
+
+/**@brief concurrent random 4K reads, every thread opens its own handle
+ *
+ * Arg: attach handles to the shared chunk cache (1) or not (0). The
+ * cache is warm after the first run, hit rate is reported.*/
+void
+BM_cfread_threads(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind) + ".dz";
+	const size_t readsz = 4096;
+	std::vector<char> buf(readsz);
+	std::mt19937_64 rnd(state.thread_index());
+	size_t sz = corpus_size();
+	CFILE* cfile = cfopen(fname.c_str(), "rb");
+	if (!cfile || (state.range(0) && cfsetcache(cfile, shared_cache()) != 0))
+	{
+		state.SkipWithError("cfopen failed");
+		cfclose(&cfile);
+		return;
+	}
+	struct cfcache_stats before, after;
+	cfcache_getstats(shared_cache(), &before);
+	for (auto _ : state)
+	{
+		cfseeko(cfile, rnd()%(sz - readsz), SEEK_SET);
+		if (cfread(buf.data(), 1, readsz, cfile) != readsz)
+		{
+			state.SkipWithError("read failed");
+			break;
+		}
+	}
+	state.SetBytesProcessed(state.iterations()*readsz);
+	cfcache_getstats(shared_cache(), &after);
+	if (state.range(0) && state.thread_index() == 0)
+		state.counters["hit_rate"] = (double)(after.hits - before.hits)
+			/ std::max<uint64_t>(1, after.hits + after.misses
+			                        - before.hits - before.misses);
+	cfclose(&cfile);
+}
+
+/**@brief batches of random 4K cfread_async reads on one handle
+ *
+ * Args: reads in flight, io_uring depth (0 - pread on the workers).
+ * 4 decompression workers.*/
+void
+BM_cfread_async(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind) + ".dz";
+	const size_t readsz = 4096;
+	const size_t inflight = state.range(0);
+	std::vector<char> buf(readsz*inflight);
+	std::mt19937_64 rnd(42);
+	size_t sz = corpus_size();
+	CFILE* cfile = cfopen(fname.c_str(), "rb");
+	CFAIO* aio = cfaio_create(state.range(1), 4);
+	if (!cfile || !aio)
+	{
+		state.SkipWithError("init failed");
+		cfclose(&cfile);
+		cfaio_destroy(aio);
+		return;
+	}
+	size_t failed = 0;
+	auto done = [](void* arg, ssize_t rs, int) {
+		if (rs != 4096)
+			++*(size_t*)arg;
+	};
+	for (auto _ : state)
+	{
+		for (size_t i = 0; i < inflight; ++i)
+			cfread_async(aio, cfile, &buf[i*readsz], readsz,
+				rnd()%(sz - readsz), done, &failed);
+		for (size_t n = 0; n < inflight; )
+			n += cfaio_poll(aio, -1);
+	}
+	if (failed)
+		state.SkipWithError("read failed");
+	state.SetBytesProcessed(state.iterations()*inflight*readsz);
+	state.counters["uring"] = cfaio_uring(aio);
+	cfaio_destroy(aio);
+	cfclose(&cfile);
+}
+
+/**@brief dzip compression, NARGS args: threads, level[, batch[, backend]]*/
+template<int NARGS> void
+BM_dzip(benchmark::State& state, std::string kind)
+{
+	std::string fname = corpus(kind);
+	std::string ofname = fname + ".bench.dz";
+	int batch = NARGS > 2 ? state.range(2) : 16;
+	CFBackend backend = NARGS > 3
+		? (CFBackend)state.range(3) : CFBACKEND_ZLIB;
+	if (!cfbackend_available(backend))
+	{
+		state.SkipWithError("backend is not available");
+		return;
+	}
+	for (auto _ : state)
+	{
+		if (!dzip(fname, ofname, state.range(0), state.range(1), batch,
+		          backend))
+		{
+			state.SkipWithError("dzip failed");
+			break;
+		}
+	}
+	state.SetBytesProcessed(state.iterations()*corpus_size());
+	struct stat st;
+	if (stat(ofname.c_str(), &st) == 0)
+		state.counters["ratio"] = (double)st.st_size/corpus_size();
+	remove(ofname.c_str());
+}
+
+} // namespace
+
+int
+main(int argc, char* argv[])
+{
+	el::Loggers::reconfigureAllLoggers(
+		el::ConfigurationType::ToStandardOutput, "false");
+	for (size_t i = 0; i < sizeof(CORPORA)/sizeof(CORPORA[0]); ++i)
+	{
+		std::string kind = CORPORA[i];
+		benchmark::RegisterBenchmark(("cfopen/" + kind).c_str(),
+			BM_cfopen, kind)->Unit(benchmark::kMicrosecond);
+		benchmark::RegisterBenchmark(("cfopen_pool/" + kind).c_str(),
+			BM_cfopen_pool, kind)->Unit(benchmark::kMicrosecond);
+		benchmark::RegisterBenchmark(("cfread_seq/" + kind).c_str(),
+			BM_cfread_seq, kind)->Arg(CFBACKEND_ZLIB)
+			->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(("cfread_seq_backend/" + kind).c_str(),
+			BM_cfread_seq, kind)
+			->ArgName("backend")
+			->Arg(CFBACKEND_LIBDEFLATE)->Arg(CFBACKEND_ISAL)
+			->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(("cfgetc/" + kind).c_str(),
+			BM_cfgetc, kind)->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(("cfgetline/" + kind).c_str(),
+			BM_cfgetline, kind)->Unit(benchmark::kMillisecond);
+		benchmark::RegisterBenchmark(("cfseekline/" + kind).c_str(),
+			BM_cfseekline, kind)->Unit(benchmark::kMicrosecond);
+		benchmark::RegisterBenchmark(("zcat_wc/" + kind).c_str(),
+			BM_zcat_wc, kind)->Unit(benchmark::kMillisecond)
+			->UseRealTime();
+		benchmark::RegisterBenchmark(("cfread_random/" + kind).c_str(),
+			BM_random_read<true>, kind)
+			->Arg(16)->Arg(4096)->Arg(65536)
+			->Unit(benchmark::kMicrosecond);
+		benchmark::RegisterBenchmark(("cfread_threads/" + kind).c_str(),
+			BM_cfread_threads, kind)
+			->ArgName("cache")->Arg(0)->Arg(1)
+			->ThreadRange(1, 64)
+			->Unit(benchmark::kMicrosecond)
+			->UseRealTime();
+		benchmark::RegisterBenchmark(("cfread_async/" + kind).c_str(),
+			BM_cfread_async, kind)
+			->ArgNames({"inflight", "depth"})
+			->ArgsProduct({{1, 64, 1024}, {0, 256}})
+			->Unit(benchmark::kMicrosecond)
+			->UseRealTime();
+		benchmark::RegisterBenchmark(("fread_random/" + kind).c_str(),
+			BM_random_read<false>, kind)
+			->Arg(16)->Arg(4096)->Arg(65536)
+			->Unit(benchmark::kMicrosecond);
+		benchmark::RegisterBenchmark(("dzip/" + kind).c_str(),
+			BM_dzip<2>, kind)
+			->ArgNames({"j", "l"})
+			->ArgsProduct({{1, 2, 4}, {1, 6, 9}})
+			->Unit(benchmark::kMillisecond)
+			->UseRealTime();
+		benchmark::RegisterBenchmark(("dzip_batch/" + kind).c_str(),
+			BM_dzip<3>, kind)
+			->ArgNames({"j", "l", "b"})
+			->ArgsProduct({{4}, {1}, {1, 4, 16, 64}})
+			->Unit(benchmark::kMillisecond)
+			->UseRealTime();
+		benchmark::RegisterBenchmark(("dzip_backend/" + kind).c_str(),
+			BM_dzip<4>, kind)
+			->ArgNames({"j", "l", "b", "backend"})
+			->ArgsProduct({{4}, {1, 6, 9}, {16},
+			               {CFBACKEND_ZLIB, CFBACKEND_ISAL}})
+			->Unit(benchmark::kMillisecond)
+			->UseRealTime();
+	}
+	benchmark::Initialize(&argc, argv);
+	if (benchmark::ReportUnrecognizedArguments(argc, argv))
+		return 1;
+	benchmark::RunSpecifiedBenchmarks();
+	benchmark::Shutdown();
+	return 0;
+}
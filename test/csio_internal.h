@@ -29,7 +29,13 @@ CompressionMethod get_compression(FILE* );
 int               get_gzip_header(FILE*, GZIPHeader* );
 int               get_gzip_stat(FILE*, size_t*, size_t*, size_t*);
 int               init_dictzip(FILE*, CFILE*);
+int               init_trailer(FILE*, CFILE*);
 int               fill_buf(CFILE* cstream, off_t pos);
+CFINDEX*          cfindex_ref(CFINDEX* idx);
+void              cfindex_release(CFINDEX* idx);
+size_t            cfindex_chunks(const CFINDEX* idx);
+int               cfindex_chunk(const CFINDEX* idx, size_t chunk_no,
+                                off_t* off, size_t* len);
 #ifdef __cplusplus
 }
 #endif
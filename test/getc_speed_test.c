@@ -0,0 +1,108 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 11:05:12
+ *
+ * Byte-at-a-time read throughput: fgetc over the plain file against
+ * cfgetc over the compressed one (cfread is given for the reference).*/
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <time.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <csio.h>
+
+typedef struct
+{
+	char      filename[256];
+	char      cfilename[256];
+} Config;
+
+int cfg_parse_args(int argc, char* argv[], Config* cfg)
+{
+	if (argc >= 3)
+	{
+		snprintf(cfg->filename, sizeof(cfg->filename), "%s", argv[1]);
+		snprintf(cfg->cfilename, sizeof(cfg->cfilename), "%s", argv[2]);
+	}
+	return 0;
+}
+
+void cfg_set_defaults(Config* cfg)
+{
+	snprintf(cfg->filename, sizeof(cfg->filename), "/tmp/random.file");
+	snprintf(cfg->cfilename, sizeof(cfg->cfilename), "/tmp/random.file.dz");
+}
+
+uint64_t now_usec()
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec*1000000 + ts.tv_nsec/1000;
+}
+
+void
+report(const char* name, uint64_t bytes, uint64_t sum, uint64_t elapsed)
+{
+	printf("%-7s %12lu bytes %10lu usec %10.2f MB/s (sum %lu)\n",
+			name, (unsigned long)bytes, (unsigned long)elapsed,
+			elapsed ? (double)bytes/elapsed : 0.0,
+			(unsigned long)sum);
+}
+
+int
+main(int argc, char* argv[])
+{
+	Config cfg;
+	cfg_set_defaults(&cfg);
+	if (cfg_parse_args(argc, argv, &cfg) != 0)
+		return 0;
+	FILE* file = fopen(cfg.filename, "rb");
+	CFILE* cfile = cfopen(cfg.cfilename, "rb");
+	if (!file || !cfile)
+	{
+		printf("Error opening %s or %s\n", cfg.filename, cfg.cfilename);
+		return 1;
+	}
+
+	uint64_t start, bytes = 0, sum = 0, csum;
+	int c;
+
+	start = now_usec();
+	while ((c = fgetc(file)) != EOF)
+	{
+		sum += c;
+		++bytes;
+	}
+	report("fgetc", bytes, sum, now_usec() - start);
+
+	csum = sum;
+	bytes = sum = 0;
+	start = now_usec();
+	while ((c = cfgetc(cfile)) != EOF)
+	{
+		sum += c;
+		++bytes;
+	}
+	report("cfgetc", bytes, sum, now_usec() - start);
+	if (sum != csum)
+		printf("cfgetc data differs from fgetc\n");
+
+	char* readbuf = (char*)malloc(0x10000);
+	size_t rs, i;
+	cfseeko(cfile, 0, SEEK_SET);
+	bytes = sum = 0;
+	start = now_usec();
+	while ((rs = cfread(readbuf, 1, 0x10000, cfile)) > 0)
+	{
+		for (i = 0; i < rs; ++i)
+			sum += (unsigned char)readbuf[i];
+		bytes += rs;
+	}
+	report("cfread", bytes, sum, now_usec() - start);
+
+	free(readbuf);
+	cfclose(&cfile);
+	fclose(file);
+	return 0;
+}
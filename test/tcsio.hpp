@@ -101,37 +101,37 @@ TEST_F(TestCSIO, fill_buf )
 {
 	size_t i;
 	CFILE* file = cfinit(sample);
-	memset(file->buf, 1, file->chlen + 1);
+	if (file->buf)
+		memset(file->buf, 1, file->chlen);
 	ASSERT_EQ(fill_buf(file, 0), 1);
 	ASSERT_EQ(file->bufsz, file->chlen);
 	for(i = 0; i < file->chlen; ++i)
 		ASSERT_EQ(file->buf[i], 0);
-	ASSERT_EQ(file->buf[i], 1);
 
 	// last in memb
-	memset(file->buf, 1, file->chlen + 1);
+	if (file->buf)
+		memset(file->buf, 1, file->chlen);
 	ASSERT_EQ(fill_buf(file, file->chlen*0x7FFA + 1), 1); 
 	ASSERT_EQ(file->bufsz, file->chlen);
 	for(i = 0; i < file->chlen; ++i)
 		ASSERT_EQ(file->buf[i], 0);
-	ASSERT_EQ(file->buf[i], 1);
 
 	// first in next memb
-	memset(file->buf, 1, file->chlen + 1);
+	if (file->buf)
+		memset(file->buf, 1, file->chlen);
 	ASSERT_EQ(fill_buf(file, file->chlen*0x7FFA + file->chlen + 1), 1);
 	ASSERT_EQ(file->bufsz, file->chlen);
 	for(i = 0; i < file->chlen; ++i)
 		ASSERT_EQ(file->buf[i], 0);
-	ASSERT_EQ(file->buf[i], 1);
 
 	// the very last
 	const unsigned long FILESZ = 2560L*1024*1024;
-	memset(file->buf, 1, file->chlen + 1);
+	if (file->buf)
+		memset(file->buf, 1, file->chlen);
 	ASSERT_EQ(fill_buf(file, FILESZ - 1), 1);
 	ASSERT_EQ(file->bufsz, 56795);
 	for(i = 0; i < 56795; ++i)
 		ASSERT_EQ(file->buf[i], 0);
-	ASSERT_EQ(file->buf[i], 1);
 
 	ASSERT_EQ(fill_buf(file, FILESZ), -1);
 }
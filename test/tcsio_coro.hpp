@@ -0,0 +1,128 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 21:40:12 */
+
+#ifndef __TCSIO_CORO_HPP__
+#define __TCSIO_CORO_HPP__
+
+#include <csio_coro.hpp>
+#include <csio_config.h>
+#include <random>
+#include <string>
+#include <vector>
+
+/**@brief Fire and forget coroutine*/
+struct Detached
+{
+	struct promise_type
+	{
+		Detached get_return_object() { return Detached(); }
+		std::suspend_never initial_suspend() noexcept { return {}; }
+		std::suspend_never final_suspend() noexcept { return {}; }
+		void return_void() {}
+		void unhandled_exception() { std::terminate(); }
+	};
+};
+
+struct CoroRead
+{
+	off_t            off;
+	std::vector<char> buf;
+	csio::ReadResult rs;
+	bool             done;
+};
+
+Detached
+read_at(csio::Reader& reader, CoroRead& r, std::stop_token stop = {})
+{
+	r.rs = co_await reader.read_at(r.off, r.buf, stop);
+	r.done = true;
+}
+
+class TestCSIOCoro : public ::testing::Test
+{
+protected:
+	void SetUp()
+	{
+		fname = TEST_SAMPLES_DIR;
+		fname += "/file.dz";
+		cfile = cfopen(fname.c_str(), "rb");
+		ASSERT_EQ(cferror(cfile), 0);
+	}
+	void TearDown()
+	{
+		cfclose(&cfile);
+	}
+	std::string expected(off_t off, size_t len)
+	{
+		std::string rs(len, '\0');
+		cfseeko(cfile, off, SEEK_SET);
+		rs.resize(cfread(&rs[0], 1, len, cfile));
+		return rs;
+	}
+	std::string fname;
+	CFILE* cfile;
+};
+
+TEST_F(TestCSIOCoro, read_at)
+{
+	csio::Reader reader(cfile, 4);
+	ASSERT_TRUE(reader.Valid());
+	std::mt19937 rnd(1);
+	std::vector<CoroRead> reads(50);
+	for (size_t i = 0; i < reads.size(); ++i)
+	{
+		reads[i].off = rnd()%cfile->size;
+		reads[i].buf.resize(rnd()%(2*cfile->chlen) + 1);
+		reads[i].done = false;
+		read_at(reader, reads[i]);
+	}
+	// the rest waits for the slots
+	ASSERT_EQ(reader.Pending(), reads.size());
+	size_t resumed = 0;
+	while (resumed < reads.size())
+		resumed += reader.poll(1000);
+	ASSERT_EQ(reader.Pending(), 0);
+	for (size_t i = 0; i < reads.size(); ++i)
+	{
+		ASSERT_TRUE(reads[i].done);
+		ASSERT_EQ(reads[i].rs.err, 0);
+		std::string exp = expected(reads[i].off, reads[i].buf.size());
+		ASSERT_EQ(reads[i].rs.size, exp.size());
+		ASSERT_EQ(std::string(reads[i].buf.data(), exp.size()), exp);
+	}
+}
+
+TEST_F(TestCSIOCoro, cancel)
+{
+	csio::Reader reader(cfile, 1);
+	ASSERT_TRUE(reader.Valid());
+	std::stop_source stopped;
+	stopped.request_stop();
+	CoroRead early = {0, std::vector<char>(10), {0, 0}, false};
+	read_at(reader, early, stopped.get_token());
+	ASSERT_TRUE(early.done);
+	ASSERT_EQ(early.rs.err, ECANCELED);
+
+	std::stop_source first, queued;
+	CoroRead r1 = {0, std::vector<char>(100), {0, 0}, false};
+	CoroRead r2 = {1, std::vector<char>(100), {0, 0}, false};
+	CoroRead r3 = {2, std::vector<char>(100), {0, 0}, false};
+	read_at(reader, r1, first.get_token());
+	read_at(reader, r2, queued.get_token());
+	read_at(reader, r3);
+	ASSERT_EQ(reader.Pending(), 3);
+	// waiting read is resumed by poll, in flight - after completion
+	queued.request_stop();
+	first.request_stop();
+	ASSERT_FALSE(r2.done);
+	size_t resumed = 0;
+	while (resumed < 3)
+		resumed += reader.poll(1000);
+	ASSERT_EQ(r1.rs.err, ECANCELED);
+	ASSERT_EQ(r2.rs.err, ECANCELED);
+	ASSERT_EQ(r3.rs.err, 0);
+	ASSERT_EQ(r3.rs.size, r3.buf.size());
+	ASSERT_EQ(std::string(r3.buf.data(), 100), expected(2, 100));
+}
+
+#endif // __TCSIO_CORO_HPP__
@@ -87,8 +87,183 @@ TEST_F(TestCSIODictzip, init_dictzip)
 	ASSERT_EQ(cfile.compression, DICTZIP);
 	ASSERT_TRUE(cfile.stream != NULL);
 	ASSERT_TRUE(cfile.idx != NULL);
-	ASSERT_EQ(cfile.idxsz, (0x7ffa + 0x0002)*8);
-	ASSERT_NO_FATAL_FAILURE(free(cfile.idx));
+	ASSERT_EQ(cfindex_chunks(cfile.idx), 0x7ffa + 0x0002);
+	ASSERT_LT(cfile.idxsz, (0x7ffa + 0x0002)*8/3);
+	ASSERT_NO_FATAL_FAILURE(cfindex_release(cfile.idx));
+}
+
+TEST_F(TestCSIODictzip, cfindex_chunk)
+{
+	// walk members and check every chunk offset
+	GZIPHeader hdr;
+	size_t chunk_no = 0;
+	memset(&hdr, 0, sizeof(hdr));
+	while (get_gzip_header(sample, &hdr) == 1)
+	{
+		off_t off = hdr.dataoff;
+		for (size_t i = 0; i < hdr.chcnt; ++i, ++chunk_no)
+		{
+			off_t idxoff;
+			size_t idxlen;
+			ASSERT_EQ(cfindex_chunk(csample->idx, chunk_no,
+			                        &idxoff, &idxlen), 1);
+			ASSERT_EQ(idxoff, off) << chunk_no;
+			ASSERT_EQ(idxlen, hdr.chunks[i]) << chunk_no;
+			off += hdr.chunks[i];
+		}
+	}
+	ASSERT_EQ(chunk_no, 0x7ffa + 0x0002);
+	off_t idxoff;
+	size_t idxlen;
+	ASSERT_EQ(cfindex_chunk(csample->idx, chunk_no, &idxoff, &idxlen), -1);
+}
+
+TEST_F(TestCSIODictzip, cfdup)
+{
+	CFILE* dup = cfdup(csample);
+	ASSERT_EQ(cferror(dup), 0) << strerror(errno);
+	ASSERT_EQ(dup->idx, csample->idx);
+	ASSERT_EQ(dup->size, csample->size);
+	cfseeko(csample, 10, SEEK_SET);
+	ASSERT_EQ(cftello(dup), 0);
+	cfseeko(dup, -1, SEEK_END);
+	ASSERT_EQ(cfgetc(dup), 0);
+	ASSERT_EQ(cfgetc(dup), EOF);
+	ASSERT_EQ(cfgetc(csample), 0);
+	ASSERT_EQ(cftello(csample), 11);
+	ASSERT_NO_FATAL_FAILURE(cfclose(&dup));
+	ASSERT_EQ(cferror(csample), 0);
+	ASSERT_EQ(cfgetc(csample), 0);
+}
+
+TEST_F(TestCSIODictzip, cfgetstats)
+{
+	struct cfstats st;
+	ASSERT_EQ(cfgetstats(csample, &st), -1);
+	ASSERT_EQ(errno, ENOENT);
+	ASSERT_EQ(cfsetstats(csample, 1), 0);
+	char buf[16];
+	ASSERT_EQ(cfread((void*)buf, 1, sizeof(buf), csample), sizeof(buf));
+	ASSERT_EQ(cfread((void*)buf, 1, sizeof(buf), csample), sizeof(buf));
+	cfseeko(csample, -1, SEEK_END);
+	ASSERT_EQ(cfgetc(csample), 0);
+	ASSERT_EQ(cfgetstats(csample, &st), 0);
+	ASSERT_EQ(st.seeks, 1);
+	ASSERT_EQ(st.fetches, 2);
+	ASSERT_EQ(st.buf_misses, 2);
+	ASSERT_EQ(st.buf_hits, 1);
+	ASSERT_EQ(st.inflates, 2);
+	ASSERT_EQ(st.disk_reads, 2);
+	ASSERT_GT(st.disk_bytes, 0);
+	ASSERT_EQ(st.delivered_bytes, 2*sizeof(buf) + 1);
+	ASSERT_GE(st.fetch_ns, st.inflate_ns);
+	ASSERT_EQ(st.index_ns, 0);
+	ASSERT_EQ(cfsetstats(csample, 0), 0);
+	ASSERT_TRUE(csample->stats == NULL);
+}
+
+TEST_F(TestCSIODictzip, cfsetbackend)
+{
+	CFBackend backend;
+	ASSERT_EQ(cfbackend_parse("libdeflate", &backend), 0);
+	ASSERT_EQ(backend, CFBACKEND_LIBDEFLATE);
+	ASSERT_STREQ(cfbackend_name(CFBACKEND_ISAL), "isal");
+	ASSERT_EQ(cfbackend_parse("bzip2", &backend), -1);
+	ASSERT_TRUE(cfbackend_name((CFBackend)10) == NULL);
+	ASSERT_EQ(cfbackend_available(CFBACKEND_ZLIB), 1);
+	ASSERT_EQ(csample->backend, CFBACKEND_ZLIB);
+	for (int i = CFBACKEND_ZLIB; i <= CFBACKEND_ISAL; ++i)
+	{
+		if (!cfbackend_available((CFBackend)i))
+		{
+			ASSERT_EQ(cfsetbackend(csample, (CFBackend)i), -1);
+			ASSERT_EQ(errno, ENOTSUP);
+			continue;
+		}
+		ASSERT_EQ(cfsetbackend(csample, (CFBackend)i), 0);
+		// first chunk, last chunk of the first member and the short
+		// last chunk of the file
+		off_t offs[] = {0, (off_t)csample->chlen*0x7FFA - 1,
+		                (off_t)csample->size - 1};
+		for (size_t j = 0; j < sizeof(offs)/sizeof(offs[0]); ++j)
+		{
+			if (csample->buf)
+				memset(csample->buf, 1, csample->chlen);
+			ASSERT_EQ(fill_buf(csample, offs[j]), 1)
+				<< cfbackend_name((CFBackend)i);
+			ASSERT_EQ(csample->bufsz, offs[j] < csample->size - 1
+				? csample->chlen : 1) << cfbackend_name((CFBackend)i);
+			for(size_t k = 0; k < csample->bufsz; ++k)
+				ASSERT_EQ(csample->buf[k], 0);
+		}
+	}
+}
+
+TEST_F(TestCSIODictzip, cfcache)
+{
+	ASSERT_TRUE(cfcache_create(0xffff, 1) == NULL);
+	ASSERT_EQ(errno, EINVAL);
+	// 1 shard, 4 slots
+	CFCACHE* cache = cfcache_create(4*0x10000, 1);
+	ASSERT_TRUE(cache != NULL);
+	CFILE* other = cfopen(fname.c_str(), "rb");
+	ASSERT_EQ(cferror(other), 0);
+	ASSERT_EQ(cfsetcache(csample, cache), 0);
+	ASSERT_EQ(cfsetcache(other, cache), 0);
+	ASSERT_EQ(cfsetstats(other, 1), 0);
+	ASSERT_EQ(fill_buf(csample, 0), 1);
+	ASSERT_EQ(fill_buf(other, 0), 1);
+	ASSERT_EQ(other->bufsz, csample->bufsz);
+	ASSERT_EQ(memcmp(other->buf, csample->buf, other->bufsz), 0);
+	struct cfstats st;
+	ASSERT_EQ(cfgetstats(other, &st), 0);
+	ASSERT_EQ(st.cache_hits, 1);
+	ASSERT_EQ(st.inflates, 0);
+	struct cfcache_stats cst;
+	ASSERT_EQ(cfcache_getstats(cache, &cst), 0);
+	ASSERT_EQ(cst.hits, 1);
+	ASSERT_EQ(cst.misses, 1);
+	ASSERT_EQ(cst.slots, 4);
+	ASSERT_EQ(cst.used, 1);
+	// short last chunk and eviction
+	for (size_t i = 0; i < 6; ++i)
+		ASSERT_EQ(fill_buf(csample, (off_t)csample->chlen*(i + 1)), 1);
+	ASSERT_EQ(fill_buf(other, csample->size - 1), 1);
+	ASSERT_EQ(other->bufsz, 1);
+	ASSERT_EQ(cfcache_getstats(cache, &cst), 0);
+	ASSERT_EQ(cst.used, 4);
+	ASSERT_EQ(cst.evictions, 4);
+	CFILE* dup = cfdup(other);
+	ASSERT_TRUE(dup->cache == cache);
+	cfclose(&dup);
+	ASSERT_EQ(cfsetcache(other, NULL), 0);
+	cfclose(&other);
+	ASSERT_EQ(cfsetcache(csample, NULL), 0);
+	cfcache_destroy(cache);
+}
+
+TEST_F(TestCSIODictzip, cfgetmem)
+{
+	// the window is allocated on the first read
+	ASSERT_TRUE(csample->buf == NULL);
+	ASSERT_LT(sizeof(CFILE), 1024);
+	struct cfmemstats mem;
+	ASSERT_EQ(cfgetmem(csample, &mem), 0);
+	ASSERT_EQ(mem.handle, sizeof(CFILE));
+	ASSERT_EQ(mem.buffer, 0);
+	ASSERT_EQ(mem.index, csample->idxsz);
+	ASSERT_EQ(mem.total, mem.handle + mem.index + mem.stats + mem.codec);
+	ASSERT_NE(cfgetc(csample), EOF);
+	ASSERT_TRUE(csample->buf != NULL);
+	ASSERT_EQ(cfgetmem(csample, &mem), 0);
+	ASSERT_EQ(mem.buffer, csample->chlen);
+	ASSERT_EQ(mem.total,
+		mem.handle + mem.buffer + mem.index + mem.stats + mem.codec);
+	CFILE* dup = cfdup(csample);
+	ASSERT_TRUE(dup->buf == NULL);
+	cfclose(&dup);
+	ASSERT_EQ(cfgetmem(NULL, &mem), -1);
+	ASSERT_EQ(errno, EINVAL);
 }
 
 TEST_F(TestCSIODictzip, cfopen_cfclose )
@@ -101,32 +276,33 @@ TEST_F(TestCSIODictzip, cfopen_cfclose )
 TEST_F(TestCSIODictzip, fill_buf )
 {
 	size_t i;
-	memset(csample->buf, 1, csample->chlen + 1);
+	if (csample->buf)
+		memset(csample->buf, 1, csample->chlen);
 	ASSERT_EQ(fill_buf(csample, 0), 1);
 	ASSERT_EQ(csample->bufsz, csample->chlen);
 	for(i = 0; i < csample->chlen; ++i)
 		ASSERT_EQ(csample->buf[i], 0);
-	ASSERT_EQ(csample->buf[i], 1);
 
 	// last in memb
-	memset(csample->buf, 1, csample->chlen + 1);
+	if (csample->buf)
+		memset(csample->buf, 1, csample->chlen);
 	ASSERT_EQ(fill_buf(csample, csample->chlen*0x7FFA - 1), 1); 
 	ASSERT_EQ(csample->bufsz, csample->chlen);
 	for(i = 0; i < csample->chlen; ++i)
 		ASSERT_EQ(csample->buf[i], 0);
-	ASSERT_EQ(csample->buf[i], 1);
 
 	// first in next memb
-	memset(csample->buf, 1, csample->chlen + 1);
+	if (csample->buf)
+		memset(csample->buf, 1, csample->chlen);
 	ASSERT_EQ(fill_buf(csample, csample->chlen*0x7FFA), 1);
 	ASSERT_EQ(csample->bufsz, csample->chlen);
 	for(i = 0; i < csample->chlen; ++i)
 		ASSERT_EQ(csample->buf[i], 0) << i;
-	ASSERT_EQ(csample->buf[i], 1);
 
 	// the very last
 	const unsigned long FILESZ = csample->size;
-	memset(csample->buf, 1, csample->chlen + 1);
+	if (csample->buf)
+		memset(csample->buf, 1, csample->chlen);
 	ASSERT_EQ(fill_buf(csample, FILESZ - 1), 1);
 	ASSERT_EQ(csample->bufsz, 1);
 	ASSERT_EQ(csample->buf[0], 0);
@@ -121,6 +121,54 @@ TEST_F(TestCSIONone, cferror)
 	ASSERT_NE(cferror(cfile), 0);
 }
 
+TEST_F(TestCSIONone, pread_window)
+{
+	char buf[16];
+	ASSERT_EQ(cfgetc(csample), 0);
+	ASSERT_EQ(csample->bufoff, 0);
+	ASSERT_EQ(csample->bufsz, 256);
+	ASSERT_EQ(cfread((void*)buf, 1, sizeof(buf), csample), sizeof(buf));
+	ASSERT_EQ(cftello(csample), 1 + sizeof(buf));
+	ASSERT_EQ(cfgetc(csample), 0);
+	ASSERT_EQ(cftello(csample), 2 + sizeof(buf));
+	// stdio position is not used by csio
+	ASSERT_EQ(ftello(sample), 0);
+	ASSERT_EQ(cfseeko(csample, -1, SEEK_SET), -1);
+	ASSERT_EQ(cftello(csample), 2 + sizeof(buf));
+}
+
+TEST_F(TestCSIONone, growing_file)
+{
+	std::string tmp = std::string(TEST_TMP_DIR) + "/csio_growing.log";
+	FILE* out = fopen(tmp.c_str(), "wb");
+	ASSERT_TRUE(out != NULL);
+	ASSERT_GE(fputs("first\n", out), 0);
+	fflush(out);
+	CFILE* file = cfopen(tmp.c_str(), "rb");
+	ASSERT_TRUE(file != NULL);
+	ASSERT_EQ(file->compression, NONE);
+	char buf[64];
+	ASSERT_EQ(cfread(buf, 1, sizeof(buf), file), 6);
+	ASSERT_EQ(cfgetc(file), EOF);
+	ASSERT_EQ(cfeof(file), 1);
+	// data appended after cfopen is read like with stdio
+	ASSERT_GE(fputs("second\n", out), 0);
+	fflush(out);
+	ASSERT_EQ(cfgetc(file), 's');
+	ASSERT_EQ(cfread(buf, 1, sizeof(buf), file), 6);
+	ASSERT_EQ(std::string(buf, 6), "econd\n");
+	ASSERT_GE(fputs("third\n", out), 0);
+	fflush(out);
+	ASSERT_EQ(cfread(buf, 1, sizeof(buf), file), 6);
+	ASSERT_EQ(std::string(buf, 6), "third\n");
+	ASSERT_GE(fputs("last\n", out), 0);
+	fclose(out);
+	ASSERT_EQ(cfseeko(file, -5, SEEK_END), 0);
+	ASSERT_EQ(cftello(file), 6 + 7 + 6);
+	cfclose(&file);
+	remove(tmp.c_str());
+}
+
 TEST_F(TestCSIONone, FILE_is_opened_on_cfclose)
 {
 	ASSERT_NE(cfgetc(csample), EOF);
@@ -0,0 +1,791 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 17:45:31 */
+
+#ifndef __TDZIP_HPP__
+#define __TDZIP_HPP__
+
+#include <CompressManager.hpp>
+#include <csio.h>
+#include <csio_config.h>
+#include <csio_streambuf.hpp>
+#include <fcntl.h>
+#include <getopt.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+class TestDzip : public ::testing::Test
+{
+protected:
+	typedef std::vector<std::string> Args;
+
+	void SetUp()
+	{
+		fname = std::string(TEST_TMP_DIR) + "/csio_tdzip.txt";
+		ofname = fname + ".dz";
+		for (size_t i = 0; i < 1024; ++i)
+			data.push_back('a' + i%26);
+		ASSERT_NO_FATAL_FAILURE(writeInput());
+	}
+	void TearDown()
+	{
+		remove(fname.c_str());
+		remove(ofname.c_str());
+	}
+	/**@brief Write data to the input file*/
+	void writeInput()
+	{
+		FILE* f = fopen(fname.c_str(), "wb");
+		ASSERT_TRUE(f != NULL) << fname;
+		ASSERT_EQ(fwrite(data.data(), 1, data.size(), f), data.size());
+		fclose(f);
+	}
+	/**@brief Parse dzip command line with the options (zlib, 2 threads
+	 * by default)
+	 * @return Config::ParseArgs result*/
+	int parse(const Args& opts, csio::Config& cfg)
+	{
+		Args args = {"dzip", "-f", "-j", "2", "-z", "zlib"};
+		args.insert(args.end(), opts.begin(), opts.end());
+		args.insert(args.end(), {"-o", ofname, fname});
+		std::vector<char*> argv;
+		for (size_t i = 0; i < args.size(); ++i)
+			argv.push_back(&args[i][0]);
+		optind = 0;
+		return cfg.ParseArgs(argv.size(), argv.data());
+	}
+	/**@brief Compress the input file with dzip options*/
+	void compress(const Args& opts = Args())
+	{
+		csio::Config cfg;
+		ASSERT_EQ(parse(opts, cfg), 1);
+		csio::CompressManager cmprs(cfg);
+		cmprs.Loop();
+	}
+	/**@brief Read the handle up to the end and compare with data*/
+	void checkRead(CFILE* cfile)
+	{
+		ASSERT_EQ(cferror(cfile), 0);
+		ASSERT_EQ(cfile->size, data.size());
+		std::string rs(data.size() + 1, '\0');
+		ASSERT_EQ(cfread(&rs[0], 1, rs.size(), cfile), data.size());
+		rs.resize(data.size());
+		ASSERT_EQ(rs, data);
+		ASSERT_TRUE(cfeof(cfile));
+	}
+	/**@brief Read the output with csio and compare with data*/
+	void checkOutput(CompressionMethod method = DICTZIP)
+	{
+		CFILE* cfile = cfopen(ofname.c_str(), "rb");
+		ASSERT_TRUE(cfile != NULL) << strerror(errno);
+		EXPECT_EQ(cfile->compression, method);
+		EXPECT_NO_FATAL_FAILURE(checkRead(cfile));
+		cfclose(&cfile);
+	}
+	/**@brief Decompress the output with zlib (as gzip tools do) and
+	 * compare with data*/
+	void checkGzip()
+	{
+		gzFile gz = gzopen(ofname.c_str(), "rb");
+		ASSERT_TRUE(gz != NULL);
+		std::string rs(data.size() + 1, '\0');
+		ASSERT_EQ(gzread(gz, &rs[0], rs.size()), (int)data.size());
+		gzclose(gz);
+		rs.resize(data.size());
+		ASSERT_EQ(rs, data);
+	}
+	/**@brief Compressed bytes of the output*/
+	std::string rawOutput()
+	{
+		std::string out;
+		FILE* f = fopen(ofname.c_str(), "rb");
+		if (!f)
+			return out;
+		char buf[4096];
+		size_t rs;
+		while ((rs = fread(buf, 1, sizeof(buf), f)) > 0)
+			out.append(buf, rs);
+		fclose(f);
+		return out;
+	}
+	/**@brief Compress data with the seekable format, read and seek it*/
+	void seekable(const char* format, CompressionMethod method,
+	              const char* level = NULL)
+	{
+		// several frames, the last one is short
+		data.clear();
+		for (size_t i = 0; i < 3*CHUNK_SIZE + 100; ++i)
+			data.push_back('a' + (i*7 + i/13)%26);
+		ASSERT_NO_FATAL_FAILURE(writeInput());
+		Args opts = {"-F", format};
+		if (level)
+			opts.insert(opts.end(), {"-l", level});
+		ASSERT_NO_FATAL_FAILURE(compress(opts));
+		ASSERT_NO_FATAL_FAILURE(checkOutput(method));
+		CFILE* cfile = cfopen(ofname.c_str(), "rb");
+		ASSERT_EQ(cferror(cfile), 0);
+		const off_t offs[] = {CHUNK_SIZE*2 + 5, 10, CHUNK_SIZE - 3};
+		for (size_t i = 0; i < sizeof(offs)/sizeof(offs[0]); ++i)
+		{
+			ASSERT_EQ(cfseeko(cfile, offs[i], SEEK_SET), 0);
+			char buf[100];
+			ASSERT_EQ(cfread(buf, 1, sizeof(buf), cfile), sizeof(buf));
+			ASSERT_EQ(std::string(buf, sizeof(buf)),
+			          data.substr(offs[i], sizeof(buf)));
+		}
+		ASSERT_EQ(cfseeko(cfile, -1, SEEK_END), 0);
+		ASSERT_EQ(cfgetc(cfile), data.back());
+		cfclose(&cfile);
+
+		// frames without the seek table are not supported
+		std::string out = rawOutput();
+		FILE* f = fopen(ofname.c_str(), "wb");
+		ASSERT_TRUE(f != NULL);
+		ASSERT_EQ(fwrite(out.data(), 1, out.size() - 20, f), out.size() - 20);
+		fclose(f);
+		errno = 0;
+		ASSERT_TRUE(cfopen(ofname.c_str(), "rb") == NULL);
+		ASSERT_EQ(errno, ENOSYS);
+	}
+	std::string fname;
+	std::string ofname;
+	std::string data;
+};
+
+TEST_F(TestDzip, small_file_latency)
+{
+	std::vector<double> lat;
+	for (size_t i = 0; i < 5; ++i)
+	{
+		auto start = std::chrono::steady_clock::now();
+		ASSERT_NO_FATAL_FAILURE(compress());
+		lat.push_back(std::chrono::duration<double, std::milli>(
+			std::chrono::steady_clock::now() - start).count());
+	}
+	std::sort(lat.begin(), lat.end());
+	// only reported: a wall-clock bound fails on loaded machines (it
+	// was tens of ms with 10ms ticks, a few ms with events)
+	RecordProperty("median_us", (int)(lat[lat.size()/2]*1000));
+	std::cout << "[          ] median latency " << lat[lat.size()/2]
+	          << " ms" << std::endl;
+	ASSERT_NO_FATAL_FAILURE(checkOutput());
+
+	// the loop sleeps until an event, even if the compressors are busy
+	// for a while: no periodic wake ups without --stats
+	std::mt19937 rnd(1);
+	data.clear();
+	for (size_t i = 0; i < 32*CHUNK_SIZE; ++i)
+		data.push_back('a' + rnd()%26);
+	ASSERT_NO_FATAL_FAILURE(writeInput());
+	csio::Config cfg;
+	ASSERT_EQ(parse({"-l", "9"}, cfg), 1);
+	csio::CompressManager cmprs(cfg);
+	cmprs.Loop();
+	ASSERT_EQ(cmprs.PollTimeouts(), 0);
+	ASSERT_NO_FATAL_FAILURE(checkOutput());
+}
+
+TEST_F(TestDzip, backends)
+{
+	for (int c = CFBACKEND_ZLIB; c <= CFBACKEND_ISAL; ++c)
+	{
+		// libdeflate is inflate only
+		if (c == CFBACKEND_LIBDEFLATE || !cfbackend_available((CFBackend)c))
+			continue;
+		ASSERT_NO_FATAL_FAILURE(compress({"-z",
+		                                  cfbackend_name((CFBackend)c)}));
+		for (int d = CFBACKEND_ZLIB; d <= CFBACKEND_ISAL; ++d)
+		{
+			if (!cfbackend_available((CFBackend)d))
+				continue;
+			SCOPED_TRACE(std::string(cfbackend_name((CFBackend)c)) + " -> "
+			             + cfbackend_name((CFBackend)d));
+			CFILE* cfile = cfopen(ofname.c_str(), "rb");
+			ASSERT_EQ(cferror(cfile), 0);
+			ASSERT_EQ(cfsetbackend(cfile, (CFBackend)d), 0);
+			EXPECT_NO_FATAL_FAILURE(checkRead(cfile));
+			cfclose(&cfile);
+		}
+	}
+}
+
+TEST(LevelTuner, choose)
+{
+	// 100 MB/s with 2 compressors
+	csio::LevelTuner tuner(100e6, 2, 9);
+	ASSERT_EQ(tuner.Level(), 9);
+	// 9: 50 MB/s is too slow, estimated 4: 130 MB/s
+	tuner.Account(9, 1000000, 40000000);
+	ASSERT_EQ(tuner.Level(), 4);
+	// 4: 250 MB/s, estimated 6: 153 MB/s
+	tuner.Account(4, 1000000, 8000000);
+	ASSERT_EQ(tuner.Level(), 6);
+	// 6: 80 MB/s is too slow, estimated 5: 192 MB/s
+	tuner.Account(6, 1000000, 25000000);
+	ASSERT_EQ(tuner.Level(), 5);
+	// unreachable target
+	csio::LevelTuner slow(1e12, 1, 6);
+	slow.Account(6, 1000000, 1000000);
+	ASSERT_EQ(slow.Level(), 1);
+}
+
+TEST_F(TestDzip, target_mbps)
+{
+	ASSERT_NO_FATAL_FAILURE(compress({"-t", "1000"}));
+	ASSERT_NO_FATAL_FAILURE(checkOutput());
+	// the tuner knows only zlib levels
+	csio::Config cfg;
+	ASSERT_EQ(parse({"-F", "zstd", "-l", "19", "-t", "2000"}, cfg), -1);
+}
+
+TEST_F(TestDzip, cfcache_threads)
+{
+	data.clear();
+	for (size_t i = 0; i < 20*CHUNK_SIZE; ++i)
+		data.push_back('a' + (i*7 + i/13)%26);
+	ASSERT_NO_FATAL_FAILURE(writeInput());
+	ASSERT_NO_FATAL_FAILURE(compress());
+	// fewer slots then chunks, so chunks are evicted concurrently
+	CFCACHE* cache = cfcache_create(8*0x10000, 4);
+	ASSERT_TRUE(cache != NULL);
+	CFILE* cfile = cfopen(ofname.c_str(), "rb");
+	ASSERT_EQ(cfsetcache(cfile, cache), 0);
+	std::vector<std::thread> threads;
+	std::atomic<int> errors(0);
+	for (int t = 0; t < 4; ++t)
+	{
+		threads.emplace_back([&, t]()
+		{
+			CFILE* dup = cfdup(cfile);
+			std::mt19937 rnd(t);
+			char buf[300];
+			for (int i = 0; i < 500; ++i)
+			{
+				off_t off = rnd()%(data.size() - sizeof(buf));
+				cfseeko(dup, off, SEEK_SET);
+				if (cfread(buf, 1, sizeof(buf), dup) != sizeof(buf)
+				 || memcmp(buf, data.data() + off, sizeof(buf)) != 0)
+					++errors;
+			}
+			cfclose(&dup);
+		});
+	}
+	for (size_t t = 0; t < threads.size(); ++t)
+		threads[t].join();
+	ASSERT_EQ(errors, 0);
+	struct cfcache_stats cst;
+	ASSERT_EQ(cfcache_getstats(cache, &cst), 0);
+	ASSERT_GT(cst.hits, 0);
+	ASSERT_GT(cst.evictions, 0);
+	cfclose(&cfile);
+	cfcache_destroy(cache);
+}
+
+TEST_F(TestDzip, cfpool)
+{
+	ASSERT_NO_FATAL_FAILURE(compress());
+	CFPOOL* pool = cfpool_create(1, 3);
+	ASSERT_TRUE(pool != NULL);
+	std::string rs(data.size(), '\0');
+	CFILE* cfile = cfpool_open(pool, ofname.c_str());
+	ASSERT_EQ(cferror(cfile), 0);
+	ASSERT_EQ(cfread(&rs[0], 1, rs.size(), cfile), data.size());
+	ASSERT_EQ(rs, data);
+	char* buf = cfile->buf;
+	CFILE* prev = cfile;
+	cfpool_close(pool, &cfile);
+	ASSERT_TRUE(cfile == NULL);
+	// the handle, its window and the index are reused
+	cfile = cfpool_open(pool, ofname.c_str());
+	ASSERT_EQ(cferror(cfile), 0);
+	ASSERT_TRUE(cfile == prev);
+	ASSERT_TRUE(cfile->buf == buf);
+	ASSERT_EQ(cfile->size, data.size());
+	ASSERT_EQ(cfseeko(cfile, 10, SEEK_SET), 0);
+	ASSERT_EQ(cfread(&rs[0], 1, rs.size(), cfile), data.size() - 10);
+	ASSERT_EQ(rs.substr(0, data.size() - 10), data.substr(10));
+	struct cfpool_stats st;
+	ASSERT_EQ(cfpool_getstats(pool, &st), 0);
+	ASSERT_EQ(st.opens, 2);
+	ASSERT_EQ(st.reuses, 1);
+	ASSERT_EQ(st.index_hits, 1);
+	ASSERT_EQ(st.index_misses, 1);
+	// the pool keeps one handle, the second one is closed
+	CFILE* plain = cfpool_open(pool, fname.c_str());
+	ASSERT_EQ(cferror(plain), 0);
+	ASSERT_EQ(plain->compression, NONE);
+	cfpool_close(pool, &cfile);
+	cfpool_close(pool, &plain);
+	ASSERT_EQ(cfpool_getstats(pool, &st), 0);
+	ASSERT_EQ(st.free, 1);
+	// modified file is scanned again
+	data.assign(3*CHUNK_SIZE, 'z');
+	ASSERT_NO_FATAL_FAILURE(writeInput());
+	ASSERT_NO_FATAL_FAILURE(compress());
+	cfile = cfpool_open(pool, ofname.c_str());
+	ASSERT_EQ(cferror(cfile), 0);
+	ASSERT_EQ(cfile->size, data.size());
+	ASSERT_EQ(cfseeko(cfile, -1, SEEK_END), 0);
+	ASSERT_EQ(cfgetc(cfile), 'z');
+	ASSERT_EQ(cfpool_getstats(pool, &st), 0);
+	ASSERT_EQ(st.index_misses, 3);
+	cfpool_close(pool, &cfile);
+	errno = 0;
+	ASSERT_TRUE(cfpool_open(pool, "/nonexistent") == NULL);
+	ASSERT_EQ(errno, ENOENT);
+	cfpool_destroy(pool);
+}
+
+TEST_F(TestDzip, cistreambuf)
+{
+	data.clear();
+	for (size_t i = 0; i < 3*CHUNK_SIZE + 100; ++i)
+		data.push_back(i%80 == 79 ? '\n' : 'a' + (i*7 + i/13)%26);
+	ASSERT_NO_FATAL_FAILURE(writeInput());
+	ASSERT_NO_FATAL_FAILURE(compress());
+	const std::string names[] = {ofname, fname};
+	for (size_t n = 0; n < 2; ++n)
+	{
+		csio::cistream in(names[n].c_str());
+		ASSERT_TRUE(in.good());
+		std::string rs((std::istreambuf_iterator<char>(in)),
+		               std::istreambuf_iterator<char>());
+		ASSERT_EQ(rs, data);
+		in.clear();
+		std::string line;
+		size_t lines = 0;
+		ASSERT_TRUE(in.seekg(0));
+		while (std::getline(in, line))
+			++lines;
+		ASSERT_EQ(lines, data.size()/80 + 1);
+		in.clear();
+		ASSERT_TRUE(in.seekg(-10, std::ios_base::end));
+		ASSERT_EQ((size_t)in.tellg(), data.size() - 10);
+		char buf[100];
+		ASSERT_EQ(in.read(buf, sizeof(buf)).gcount(), 10);
+		ASSERT_EQ(std::string(buf, 10), data.substr(data.size() - 10));
+	}
+
+	// the get area is the window, seeks inside it don't fetch
+	CFILE* cfile = cfopen(ofname.c_str(), "rb");
+	ASSERT_EQ(cfsetstats(cfile, 1), 0);
+	{
+		csio::cistream in(cfile);
+		ASSERT_TRUE(in.seekg(CHUNK_SIZE + 10));
+		ASSERT_EQ(in.get(), data[CHUNK_SIZE + 10]);
+		ASSERT_EQ(in.rdbuf()->in_avail(), CHUNK_SIZE - 11);
+		ASSERT_TRUE(in.seekg(-5, std::ios_base::cur));
+		ASSERT_EQ(in.get(), data[CHUNK_SIZE + 6]);
+		ASSERT_TRUE(in.seekg(CHUNK_SIZE));
+		ASSERT_EQ(in.get(), data[CHUNK_SIZE]);
+		struct cfstats st;
+		ASSERT_EQ(cfgetstats(cfile, &st), 0);
+		ASSERT_EQ(st.fetches, 1);
+		ASSERT_TRUE(in.seekg(2*CHUNK_SIZE + 1));
+		ASSERT_EQ(in.get(), data[2*CHUNK_SIZE + 1]);
+		ASSERT_EQ(cfgetstats(cfile, &st), 0);
+		ASSERT_EQ(st.fetches, 2);
+	}
+	// the handle position is synchronized on destruction
+	ASSERT_EQ(cftello(cfile), 2*CHUNK_SIZE + 2);
+	size_t len;
+	const char* p = cfgetbuf(cfile, &len);
+	ASSERT_TRUE(p != NULL);
+	ASSERT_EQ(len, CHUNK_SIZE - 2);
+	ASSERT_EQ(*p, data[2*CHUNK_SIZE + 2]);
+	ASSERT_EQ(cftello(cfile), 2*CHUNK_SIZE + 2);
+	ASSERT_EQ(cfseeko(cfile, 0, SEEK_END), 0);
+	ASSERT_TRUE(cfgetbuf(cfile, &len) == NULL);
+	ASSERT_EQ(len, 0);
+	cfclose(&cfile);
+}
+
+struct AsyncRead
+{
+	off_t       off;
+	std::string buf;
+	ssize_t     rs;
+	int         err;
+	bool        done;
+	static void Done(void* arg, ssize_t rs, int err)
+	{
+		AsyncRead* r = (AsyncRead*)arg;
+		r->rs = rs;
+		r->err = err;
+		r->done = true;
+	}
+};
+
+TEST_F(TestDzip, cfgetline)
+{
+	// short, empty, chunk spanning and longer than a chunk lines, the last
+	// one has no '\n'
+	data.clear();
+	std::vector<std::string> lines;
+	const size_t lens[] = {10, 0, CHUNK_SIZE - 5, 20, 2*CHUNK_SIZE + 3, 1,
+	                       300, 77};
+	for (size_t i = 0; i < sizeof(lens)/sizeof(lens[0]); ++i)
+	{
+		std::string line;
+		for (size_t j = 0; j < lens[i]; ++j)
+			line.push_back('a' + (i + j)%26);
+		if (i + 1 < sizeof(lens)/sizeof(lens[0]))
+			line.push_back('\n');
+		lines.push_back(line);
+		data += line;
+	}
+	ASSERT_NO_FATAL_FAILURE(writeInput());
+	ASSERT_NO_FATAL_FAILURE(compress());
+	const std::string names[] = {ofname, fname};
+	for (size_t n = 0; n < 2; ++n)
+	{
+		CFILE* cfile = cfopen(names[n].c_str(), "rb");
+		ASSERT_TRUE(cfile != NULL);
+		char* line = NULL;
+		size_t linesz = 0;
+		for (size_t i = 0; i < lines.size(); ++i)
+		{
+			ssize_t rs = cfgetline(&line, &linesz, cfile);
+			ASSERT_EQ(rs, (ssize_t)lines[i].size()) << i;
+			ASSERT_EQ(std::string(line, rs), lines[i]) << i;
+			ASSERT_EQ(line[rs], '\0');
+		}
+		ASSERT_EQ(cfgetline(&line, &linesz, cfile), -1);
+		ASSERT_TRUE(cfeof(cfile));
+		free(line);
+
+		// cfgets splits lines longer than the buffer
+		ASSERT_EQ(cfseeko(cfile, 0, SEEK_SET), 0);
+		char buf[64];
+		std::string rs;
+		size_t calls = 0;
+		while (cfgets(buf, sizeof(buf), cfile) != NULL)
+		{
+			size_t len = strlen(buf);
+			ASSERT_GT(len, 0);
+			ASSERT_TRUE(len == sizeof(buf) - 1 || buf[len - 1] == '\n'
+			            || cftello(cfile) == (off_t)data.size());
+			rs += buf;
+			++calls;
+		}
+		ASSERT_EQ(rs, data);
+		ASSERT_GT(calls, lines.size());
+		ASSERT_TRUE(cfgets(buf, sizeof(buf), cfile) == NULL);
+
+		// mixed with cfgetc
+		ASSERT_EQ(cfseeko(cfile, 5, SEEK_SET), 0);
+		ASSERT_EQ(cfgetc(cfile), data[5]);
+		ASSERT_TRUE(cfgets(buf, sizeof(buf), cfile) != NULL);
+		ASSERT_EQ(std::string(buf), data.substr(6, 5));
+		ASSERT_EQ(cfgetc(cfile), '\n');
+		ASSERT_EQ(cftello(cfile), 12);
+		cfclose(&cfile);
+	}
+}
+
+TEST_F(TestDzip, cfseekline)
+{
+	data.clear();
+	std::vector<size_t> starts;
+	for (size_t i = 0; data.size() < 5*CHUNK_SIZE; ++i)
+	{
+		starts.push_back(data.size());
+		// empty lines and a line longer than a chunk
+		size_t len = i == 100 ? 2*CHUNK_SIZE : (i*37)%300;
+		for (size_t j = 0; j < len; ++j)
+			data.push_back('a' + (i + j)%26);
+		data.push_back('\n');
+	}
+	ASSERT_NO_FATAL_FAILURE(writeInput());
+	for (int indexed = 0; indexed < 3; ++indexed)
+	{
+		// 0 - counted on the first call, 1 - LN members, 2 - uncompressed
+		if (indexed < 2)
+		{
+			ASSERT_NO_FATAL_FAILURE(compress(indexed == 1 ? Args{"-n"}
+			                                              : Args()));
+		}
+		CFILE* cfile = cfopen((indexed < 2 ? ofname : fname).c_str(), "rb");
+		ASSERT_TRUE(cfile != NULL);
+		ASSERT_EQ(cfsetstats(cfile, 1), 0);
+		const size_t mid = starts.size()*2/3;
+		ASSERT_EQ(cfseekline(cfile, mid), 0);
+		ASSERT_EQ(cftello(cfile), (off_t)starts[mid]);
+		struct cfstats st;
+		ASSERT_EQ(cfgetstats(cfile, &st), 0);
+		if (indexed == 1)
+		{
+			ASSERT_EQ(st.fetches, 1);
+		}
+		char* line = NULL;
+		size_t linesz = 0;
+		for (size_t i = 0; i < starts.size(); i += (i < 200 ? 1 : 7))
+		{
+			ASSERT_EQ(cfseekline(cfile, i), 0) << i;
+			ASSERT_EQ(cftello(cfile), (off_t)starts[i]) << i;
+			size_t len = (i + 1 < starts.size() ? starts[i + 1]
+			                                    : data.size()) - starts[i];
+			ASSERT_EQ(cfgetline(&line, &linesz, cfile), (ssize_t)len) << i;
+			ASSERT_EQ(std::string(line, len), data.substr(starts[i], len));
+		}
+		free(line);
+		// after the last '\n' - the end
+		ASSERT_EQ(cfseekline(cfile, starts.size()), 0);
+		ASSERT_EQ(cftello(cfile), (off_t)data.size());
+		ASSERT_EQ(cfseekline(cfile, starts.size() + 1), -1);
+		ASSERT_EQ(errno, EINVAL);
+		cfclose(&cfile);
+	}
+	// LN members are empty for gzip tools
+	ASSERT_NO_FATAL_FAILURE(checkGzip());
+}
+
+TEST_F(TestDzip, cfchunk_may_contain)
+{
+	const char* words[] = {"alpha", "beta", "gamma", "delta", "error",
+		"warning", "info", "request", "done", "started", "user", "id"};
+	std::mt19937 rnd(7);
+	data.clear();
+	while (data.size() < 8*CHUNK_SIZE)
+	{
+		data += words[rnd()%(sizeof(words)/sizeof(words[0]))];
+		data += rnd()%10 ? ' ' : '\n';
+	}
+	const std::string needle = "NEEDLE-42-XYZ";
+	const size_t at[] = {4*CHUNK_SIZE - 5, 6*CHUNK_SIZE + 100};
+	for (size_t i = 0; i < 2; ++i)
+		data.replace(at[i], needle.size(), needle);
+	ASSERT_NO_FATAL_FAILURE(writeInput());
+	const size_t chunks = (data.size() + CHUNK_SIZE - 1)/CHUNK_SIZE;
+
+	// without filters everything may be
+	ASSERT_NO_FATAL_FAILURE(compress());
+	CFILE* cfile = cfopen(ofname.c_str(), "rb");
+	ASSERT_TRUE(cfile != NULL);
+	for (size_t c = 0; c < chunks; ++c)
+		ASSERT_EQ(cfchunk_may_contain(cfile, c, 1, needle.data(),
+		                              needle.size()), 1);
+	cfclose(&cfile);
+
+	ASSERT_NO_FATAL_FAILURE(compress({"-n", "-B", "4096"}));
+	cfile = cfopen(ofname.c_str(), "rb");
+	ASSERT_TRUE(cfile != NULL);
+	ASSERT_EQ(cfsetstats(cfile, 1), 0);
+	size_t may = 0;
+	for (size_t c = 0; c < chunks; ++c)
+	{
+		int rs = cfchunk_may_contain(cfile, c, 1, needle.data(),
+		                             needle.size());
+		ASSERT_NE(rs, -1);
+		if (c == at[0]/CHUNK_SIZE || c == at[1]/CHUNK_SIZE)
+		{
+			ASSERT_EQ(rs, 1) << c;
+		}
+		may += rs;
+	}
+	ASSERT_LE(may, 3);
+	ASSERT_EQ(cfchunk_may_contain(cfile, 0, chunks, needle.data(),
+	                              needle.size()), 1);
+	ASSERT_EQ(cfchunk_may_contain(cfile, 0, 1, "XY", 2), 1);
+	struct cfstats st;
+	ASSERT_EQ(cfgetstats(cfile, &st), 0);
+	ASSERT_EQ(st.inflates, 0);
+	// no false negatives, occurrences on the chunk ends too
+	for (size_t i = 0; i < 200; ++i)
+	{
+		size_t pos = i < 8 ? (i + 1)*CHUNK_SIZE - 1 - i
+		                   : rnd()%(data.size() - 4);
+		size_t len = std::min<size_t>(4 + rnd()%16, data.size() - pos);
+		ASSERT_EQ(cfchunk_may_contain(cfile, pos/CHUNK_SIZE, 1,
+		                              &data[pos], len), 1) << pos;
+	}
+	// LN members are before BF ones
+	ASSERT_EQ(cfseekline(cfile, 1), 0);
+	ASSERT_EQ(cftello(cfile), (off_t)data.find('\n') + 1);
+	cfclose(&cfile);
+	ASSERT_NO_FATAL_FAILURE(checkGzip());
+}
+
+TEST_F(TestDzip, trailer_index)
+{
+	data.clear();
+	for (size_t i = 0; i < 6*CHUNK_SIZE + 33; ++i)
+		data.push_back(i % 71 == 70 ? '\n' : 'a' + (i*7 + i/13)%26);
+	ASSERT_NO_FATAL_FAILURE(writeInput());
+	ASSERT_NO_FATAL_FAILURE(compress({"-T", "-n", "-B", "1024"}));
+	// members are written without RA_EXTRA
+	std::string out = rawOutput();
+	ASSERT_GT(out.size(), 3);
+	ASSERT_EQ(out[3] & FEXTRA, 0);
+	ASSERT_NO_FATAL_FAILURE(checkOutput());
+	ASSERT_NO_FATAL_FAILURE(checkGzip());
+	CFILE* cfile = cfopen(ofname.c_str(), "rb");
+	ASSERT_TRUE(cfile != NULL);
+	const off_t offs[] = {CHUNK_SIZE*5 + 5, 10, CHUNK_SIZE*6};
+	for (size_t i = 0; i < sizeof(offs)/sizeof(offs[0]); ++i)
+	{
+		ASSERT_EQ(cfseeko(cfile, offs[i], SEEK_SET), 0);
+		char buf[30];
+		ASSERT_EQ(cfread(buf, 1, sizeof(buf), cfile), sizeof(buf));
+		ASSERT_EQ(std::string(buf, sizeof(buf)),
+		          data.substr(offs[i], sizeof(buf)));
+	}
+	// LN and BF members are before IX ones
+	ASSERT_EQ(cfseekline(cfile, 100), 0);
+	ASSERT_EQ(cftello(cfile), 100*71);
+	ASSERT_EQ(cfchunk_may_contain(cfile, 3, 1, &data[3*CHUNK_SIZE + 7], 9),
+	          1);
+	cfclose(&cfile);
+
+	// the index is read from the end only
+	FILE* f = fopen(ofname.c_str(), "wb");
+	ASSERT_TRUE(f != NULL);
+	ASSERT_EQ(fwrite(out.data(), 1, out.size() - 1, f), out.size() - 1);
+	fclose(f);
+	errno = 0;
+	ASSERT_TRUE(cfopen(ofname.c_str(), "rb") == NULL);
+	ASSERT_EQ(errno, ENOSYS);
+}
+
+TEST_F(TestDzip, cfread_async)
+{
+	data.clear();
+	for (size_t i = 0; i < 10*CHUNK_SIZE + 7; ++i)
+		data.push_back('a' + (i*7 + i/13)%26);
+	ASSERT_NO_FATAL_FAILURE(writeInput());
+	ASSERT_NO_FATAL_FAILURE(compress());
+	// io_uring (if available) with a small ring and pread on workers
+	const unsigned depths[] = {4, 0};
+	for (size_t d = 0; d < 2; ++d)
+	{
+		CFAIO* aio = cfaio_create(depths[d], 2);
+		ASSERT_TRUE(aio != NULL);
+		ASSERT_GE(cfaio_fd(aio), 0);
+		if (depths[d] == 0)
+		{
+			ASSERT_EQ(cfaio_uring(aio), 0);
+		}
+		const char* names[] = {ofname.c_str(), fname.c_str()};
+		for (size_t n = 0; n < 2; ++n)
+		{
+			CFILE* cfile = cfopen(names[n], "rb");
+			ASSERT_EQ(cferror(cfile), 0);
+			std::mt19937 rnd(d*2 + n);
+			std::vector<AsyncRead> reads(200);
+			for (size_t i = 0; i < reads.size(); ++i)
+			{
+				reads[i].off = rnd()%data.size();
+				reads[i].buf.assign(rnd()%(3*CHUNK_SIZE), '\0');
+				reads[i].done = false;
+				ASSERT_EQ(cfread_async(aio, cfile, &reads[i].buf[0],
+					reads[i].buf.size(), reads[i].off, AsyncRead::Done,
+					&reads[i]), 0);
+			}
+			// zero-length read past the end
+			AsyncRead eof = {(off_t)data.size() + 10, "", 1, 0, false};
+			ASSERT_EQ(cfread_async(aio, cfile, NULL, 0, eof.off,
+				AsyncRead::Done, &eof), 0);
+			size_t done = 0;
+			while (done < reads.size() + 1)
+			{
+				int rs = cfaio_poll(aio, 1000);
+				ASSERT_GT(rs, 0);
+				done += rs;
+			}
+			for (size_t i = 0; i < reads.size(); ++i)
+			{
+				ASSERT_TRUE(reads[i].done);
+				ASSERT_EQ(reads[i].err, 0);
+				std::string expected =
+					data.substr(reads[i].off, reads[i].buf.size());
+				ASSERT_EQ(reads[i].rs, (ssize_t)expected.size());
+				ASSERT_TRUE(reads[i].buf.compare(0, expected.size(),
+					expected) == 0) << names[n] << " " << i;
+			}
+			ASSERT_TRUE(eof.done);
+			ASSERT_EQ(eof.rs, 0);
+			ASSERT_EQ(cfaio_poll(aio, 0), 0);
+			cfclose(&cfile);
+		}
+		cfaio_destroy(aio);
+	}
+}
+
+TEST_F(TestDzip, cfread_async_broken_ring)
+{
+	ASSERT_NO_FATAL_FAILURE(compress());
+	CFAIO* aio = cfaio_create(4, 1);
+	ASSERT_TRUE(aio != NULL);
+	if (!cfaio_uring(aio))
+	{
+		cfaio_destroy(aio);
+		return;
+	}
+	// replace the ring descriptor, so io_uring_enter fails
+	int ring = -1;
+	for (int fd = 0; fd < 1024 && ring == -1; ++fd)
+	{
+		char path[64], link[64];
+		snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+		ssize_t len = readlink(path, link, sizeof(link) - 1);
+		if (len > 0 && std::string(link, len) == "anon_inode:[io_uring]")
+			ring = fd;
+	}
+	ASSERT_NE(ring, -1);
+	int null = open("/dev/null", O_RDONLY);
+	ASSERT_EQ(dup2(null, ring), ring);
+	close(null);
+	CFILE* cfile = cfopen(ofname.c_str(), "rb");
+	ASSERT_EQ(cferror(cfile), 0);
+	// more reads then the ring depth, some of them wait in the backlog
+	std::vector<AsyncRead> reads(20);
+	for (size_t i = 0; i < reads.size(); ++i)
+	{
+		reads[i].off = i*50;
+		reads[i].buf.assign(100, '\0');
+		reads[i].done = false;
+		ASSERT_EQ(cfread_async(aio, cfile, &reads[i].buf[0],
+			reads[i].buf.size(), reads[i].off, AsyncRead::Done,
+			&reads[i]), 0);
+	}
+	size_t done = 0;
+	while (done < reads.size())
+	{
+		int rs = cfaio_poll(aio, 1000);
+		ASSERT_GT(rs, 0);
+		done += rs;
+	}
+	for (size_t i = 0; i < reads.size(); ++i)
+	{
+		ASSERT_TRUE(reads[i].done);
+		ASSERT_EQ(reads[i].rs, -1);
+		ASSERT_NE(reads[i].err, 0);
+	}
+	cfclose(&cfile);
+	cfaio_destroy(aio);
+}
+
+#ifdef CSIO_WITH_ZSTD
+TEST_F(TestDzip, zstd_seekable)
+{
+	ASSERT_NO_FATAL_FAILURE(seekable("zstd", ZSTD_SEEKABLE));
+}
+#endif
+
+#ifdef CSIO_WITH_LZ4
+TEST_F(TestDzip, lz4_seekable)
+{
+	ASSERT_NO_FATAL_FAILURE(seekable("lz4", LZ4_SEEKABLE));
+	// fast compressor
+	ASSERT_NO_FATAL_FAILURE(seekable("lz4", LZ4_SEEKABLE, "1"));
+}
+#endif
+
+#endif // __TDZIP_HPP__
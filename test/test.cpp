@@ -9,6 +9,10 @@
 #include "tcsio_dictzip.hpp"
 #include "tzmq.hpp"
 #include "tMessages.hpp"
+#include "tdzip.hpp"
+#include <logging.hpp>
+
+INIT_LOGGING
 
 // test cases
 
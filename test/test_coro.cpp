@@ -0,0 +1,13 @@
+/**@author hoxnox <hoxnox@gmail.com>
+ * @date 20261018 21:40:12
+ *
+ * @brief csio C++20 interfaces test launcher.*/
+
+#include <gtest/gtest.h>
+#include "tcsio_coro.hpp"
+
+int main(int argc, char *argv[])
+{
+	::testing::InitGoogleTest(&argc, argv);
+	return RUN_ALL_TESTS();
+}